@@ -2,32 +2,200 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
-ASTNode* createASTNode(char* type, char* value, ASTNode* left, ASTNode* right) {
-    ASTNode* node = (ASTNode*)malloc(sizeof(ASTNode));
-    node->type = strdup(type);
-    node->value = value ? strdup(value) : NULL;
+static const char* const nodeKindNames[] = {
+#define AST_NODE_KIND_NAME(name) #name,
+    AST_NODE_KINDS(AST_NODE_KIND_NAME)
+#undef AST_NODE_KIND_NAME
+};
+
+/* --- Arena ---
+   A bump-pointer arena owns every AST node and interned string of one
+   compilation. Blocks double in size, so even huge programs only need a
+   handful of them, and releasing the arena frees those blocks in one go. */
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t size;
+    char data[];
+} ArenaBlock;
+
+#define ARENA_MIN_BLOCK (64 * 1024)
+#define ARENA_MAX_BLOCK (64 * 1024 * 1024)
+#define ARENA_ALIGN 16
+
+static ArenaBlock* arenaHead = NULL;
+static size_t arenaBlockCount = 0;
+static size_t arenaBytesUsed = 0;
+static size_t arenaBytesReserved = 0;
+static size_t astNodeCount = 0;
+
+static void* arenaAlloc(size_t size) {
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (!arenaHead || arenaHead->used + size > arenaHead->size) {
+        size_t blockSize = arenaHead ? arenaHead->size * 2 : ARENA_MIN_BLOCK;
+        if (blockSize > ARENA_MAX_BLOCK)
+            blockSize = ARENA_MAX_BLOCK;
+        if (blockSize < size)
+            blockSize = size;
+        ArenaBlock* block = (ArenaBlock*)malloc(sizeof(ArenaBlock) + blockSize);
+        if (!block) {
+            fprintf(stderr, "Error: out of memory while building the AST\n");
+            exit(EXIT_FAILURE);
+        }
+        block->next = arenaHead;
+        block->used = 0;
+        block->size = blockSize;
+        arenaHead = block;
+        arenaBlockCount++;
+        arenaBytesReserved += blockSize;
+    }
+    void* ptr = arenaHead->data + arenaHead->used;
+    arenaHead->used += size;
+    arenaBytesUsed += size;
+    return ptr;
+}
+
+/* --- String interner ---
+   Open-addressing hash set of every identifier and literal spelling, shared
+   by the lexer and parser so each distinct name is stored once. */
+typedef struct InternEntry {
+    uint64_t hash;
+    char* str;
+} InternEntry;
+
+static InternEntry* internTable = NULL;
+static size_t internCapacity = 0;
+static size_t internCount = 0;
+static size_t internBytes = 0;
+static size_t internLookups = 0;
+static size_t internHits = 0;
+
+static uint64_t hashString(const char* s, size_t len) {
+    uint64_t h = 14695981039346656037ULL;   /* FNV-1a */
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void internGrow(void) {
+    size_t newCapacity = internCapacity ? internCapacity * 2 : 1024;
+    InternEntry* newTable = (InternEntry*)calloc(newCapacity, sizeof(InternEntry));
+    if (!newTable) {
+        fprintf(stderr, "Error: out of memory while interning strings\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < internCapacity; i++) {
+        if (!internTable[i].str) continue;
+        size_t slot = internTable[i].hash & (newCapacity - 1);
+        while (newTable[slot].str)
+            slot = (slot + 1) & (newCapacity - 1);
+        newTable[slot] = internTable[i];
+    }
+    free(internTable);
+    internTable = newTable;
+    internCapacity = newCapacity;
+}
+
+char* internStringLen(const char* s, size_t len) {
+    if (internCount * 2 >= internCapacity)
+        internGrow();
+    internLookups++;
+    uint64_t h = hashString(s, len);
+    size_t slot = h & (internCapacity - 1);
+    while (internTable[slot].str) {
+        InternEntry* e = &internTable[slot];
+        if (e->hash == h && strncmp(e->str, s, len) == 0 && e->str[len] == '\0') {
+            internHits++;
+            return e->str;
+        }
+        slot = (slot + 1) & (internCapacity - 1);
+    }
+    char* copy = (char*)arenaAlloc(len + 1);
+    memcpy(copy, s, len);
+    copy[len] = '\0';
+    internTable[slot].hash = h;
+    internTable[slot].str = copy;
+    internCount++;
+    internBytes += len + 1;
+    return copy;
+}
+
+char* internString(const char* s) {
+    return internStringLen(s, strlen(s));
+}
+
+ASTNode* createASTNode(NodeKind kind, char* value, ASTNode* left, ASTNode* right) {
+    ASTNode* node = (ASTNode*)arenaAlloc(sizeof(ASTNode));
+    node->kind = kind;
+    node->value = value;
     node->left = left;
     node->right = right;
+    node->children = NULL;
+    node->childCount = 0;
+    node->childCapacity = 0;
+    astNodeCount++;
     return node;
 }
 
+ASTNode* createListNode(NodeKind kind, ASTNode* first) {
+    ASTNode* list = createASTNode(kind, NULL, NULL, NULL);
+    return appendChild(list, first);
+}
+
+/* The child array doubles inside the arena; the outgrown copy is simply
+   abandoned, which costs at most as much again as the final array. */
+ASTNode* appendChild(ASTNode* list, ASTNode* child) {
+    if (list->childCount == list->childCapacity) {
+        int newCapacity = list->childCapacity ? list->childCapacity * 2 : 4;
+        ASTNode** children = (ASTNode**)arenaAlloc(newCapacity * sizeof(ASTNode*));
+        if (list->childCount)
+            memcpy(children, list->children, list->childCount * sizeof(ASTNode*));
+        list->children = children;
+        list->childCapacity = newCapacity;
+    }
+    list->children[list->childCount++] = child;
+    return list;
+}
+
+const char* nodeKindName(NodeKind kind) {
+    if (kind < 0 || kind >= NODE_KIND_COUNT)
+        return "UNKNOWN";
+    return nodeKindNames[kind];
+}
+
 void printAST(ASTNode* node, int level) {
     if (!node) return;
     for (int i = 0; i < level; i++) {
         printf("  ");
     }
-    printf("%s: %s\n", node->type, node->value ? node->value : "NULL");
+    printf("%s: %s\n", nodeKindName(node->kind), node->value ? node->value : "NULL");
+    for (int i = 0; i < node->childCount; i++)
+        printAST(node->children[i], level + 1);
     printAST(node->left, level + 1);
     printAST(node->right, level + 1);
 }
 
-void freeAST(ASTNode* node) {
-    if (!node) return;
-    free(node->type);
-    if (node->value)
-        free(node->value);
-    freeAST(node->left);
-    freeAST(node->right);
-    free(node);
+void printMemStats(FILE* out) {
+    fprintf(out, "[cookie] arena: %zu bytes used in %zu blocks (%zu reserved), %zu AST nodes\n",
+            arenaBytesUsed, arenaBlockCount, arenaBytesReserved, astNodeCount);
+    fprintf(out, "[cookie] interned strings: %zu unique (%zu bytes), %zu lookups, %.1f%% hit rate\n",
+            internCount, internBytes, internLookups,
+            internLookups ? 100.0 * (double)internHits / (double)internLookups : 0.0);
+}
+
+void releaseAST(void) {
+    ArenaBlock* block = arenaHead;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(internTable);
+    arenaHead = NULL;
+    internTable = NULL;
+    internCapacity = internCount = 0;
 }
@@ -1,20 +1,71 @@
 #ifndef AST_H
 #define AST_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/* Every kind of AST node. Each entry X(NAME) becomes NODE_NAME in NodeKind,
+   and nodeKindName() maps it back to "NAME" for printAST. */
+#define AST_NODE_KINDS(X) \
+    X(NUMBER) X(FLOAT) X(BOOLEAN) X(CHAR) X(STRING) X(IDENTIFIER) X(TYPE_LITERAL) \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(NEG) \
+    X(LT) X(GT) X(LE) X(GE) X(EQ) X(NE) X(AND) X(OR) X(NOT) \
+    X(CAST_INT) X(CAST_FLOAT) X(CAST_STRING) X(CAST_CHAR) X(TYPE) X(SIZE) X(METHOD_CALL) \
+    X(ASSIGN_INT) X(ASSIGN_FLOAT) X(ASSIGN_BOOL) X(ASSIGN_CHAR) X(ASSIGN_STRING) X(VAR_DECL) X(REASSIGN) \
+    X(DECL_INT) X(DECL_FLOAT) X(DECL_BOOL) X(DECL_CHAR) X(DECL_STRING) \
+    X(DECL_ARRAY) X(DECL_ARRAY_FLOAT) X(DECL_ARRAY_BOOL) X(DECL_ARRAY_CHAR) X(DECL_ARRAY_STRING) \
+    X(DECL_ARRAY_INIT) X(DECL_ARRAY_INIT_FLOAT) X(DECL_ARRAY_INIT_BOOL) X(DECL_ARRAY_INIT_CHAR) X(DECL_ARRAY_INIT_STRING) \
+    X(ARRAY_ELEM_LIST) X(ARRAY_ACCESS) X(ARRAY_ASSIGN) X(ARRAY_ITERATOR) X(INDEX_LIST) X(DECL_MAP) X(DECL_CHAN) \
+    X(ARRAY_SLICE) X(DECL_SLICE) \
+    X(RECORD_DEF) X(FIELD_LIST) X(FIELD_DECL) X(FIELD) X(FIELD_ASSIGN) \
+    X(DECL_RECORD) X(DECL_RECORD_ARRAY) X(DECL_RECORD_SOA) \
+    X(PRINT) X(PRINT_NEWLINE) X(INLINE) X(INPUT) X(INPUT_EXPR) \
+    X(IF) X(IF_ELSE) X(IF_CHAIN) X(ELSE_IF) X(ELSE) X(IF_ELSE_BODY) \
+    X(LOOP) X(FOR_LOOP) X(RANGE) X(LOOP_UNTIL) X(PARALLEL_LOOP) X(REDUCTION_LIST) X(REDUCTION) \
+    X(SWITCH) X(SWITCH_BODY) X(CASE_LIST) X(CASE) X(DEFAULT) X(BREAK) \
+    X(FUNC_DEF) X(MEMO) X(PARAM_LIST) X(PARAM) X(ARG_LIST) X(CALL) X(RETURN) X(YIELD) X(SPAWN) \
+    X(STATEMENT_LIST) X(GLOBAL_LIST)
+
+typedef enum NodeKind {
+#define AST_NODE_KIND_ENUM(name) NODE_##name,
+    AST_NODE_KINDS(AST_NODE_KIND_ENUM)
+#undef AST_NODE_KIND_ENUM
+    NODE_KIND_COUNT
+} NodeKind;
+
 typedef struct ASTNode {
-    char* type;              // Node type (e.g. "NUMBER", "ASSIGN_INT", "IF", "INPUT", etc.)
+    NodeKind kind;           // Node kind (e.g. NODE_NUMBER, NODE_ASSIGN_INT, NODE_IF, NODE_INPUT_EXPR, etc.)
     char* value;             // Extra string value (identifier name or literal)
-    struct ASTNode* left;    // Left child (used for binary operators, list nodes, etc.)
-    struct ASTNode* right;   // Right child (used for binary operators, list nodes, etc.)
+    struct ASTNode* left;    // Left child (used for binary operators, conditions, bodies, etc.)
+    struct ASTNode* right;   // Right child
+    struct ASTNode** children;  // List nodes only: items in source order
+    int childCount;
+    int childCapacity;
 } ASTNode;
 
-ASTNode* createASTNode(char* type, char* value, ASTNode* left, ASTNode* right);
+/* List nodes hold their items in a flat array instead of a left-deep chain,
+   so long programs are walked with a loop rather than deep recursion. */
+static inline int isListKind(NodeKind kind) {
+    return kind == NODE_STATEMENT_LIST || kind == NODE_GLOBAL_LIST || kind == NODE_ARRAY_ELEM_LIST ||
+           kind == NODE_ARG_LIST || kind == NODE_PARAM_LIST || kind == NODE_CASE_LIST ||
+           kind == NODE_INDEX_LIST || kind == NODE_FIELD_LIST || kind == NODE_REDUCTION_LIST;
+}
+
+/* Nodes and interned strings live in one arena for the whole compilation.
+   `value` is not copied: pass an interned string or a string literal. */
+ASTNode* createASTNode(NodeKind kind, char* value, ASTNode* left, ASTNode* right);
+ASTNode* createListNode(NodeKind kind, ASTNode* first);
+ASTNode* appendChild(ASTNode* list, ASTNode* child);
+char* internString(const char* s);
+char* internStringLen(const char* s, size_t len);
+const char* nodeKindName(NodeKind kind);
 void printAST(ASTNode* node, int level);
-void freeAST(ASTNode* node);
+void printMemStats(FILE* out);
+void releaseAST(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,169 @@
+// Sort benchmark for `make bench-sort`: times each cookie_sort_* routine in
+// runtime.c against qsort on the same random input and checks that both give
+// the same order.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+void cookie_sort_i32(int32_t* data, int32_t n, int32_t desc);
+void cookie_sort_char(char* data, int32_t n, int32_t desc);
+void cookie_sort_bits(uint64_t* words, int32_t n, int32_t desc);
+void cookie_sort_f32(float* data, int32_t n, int32_t desc);
+void cookie_sort_str(char** data, int32_t n, int32_t desc);
+
+#define BENCH_N 5000000
+#define BENCH_STR_N 1000000
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static uint64_t rng(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void* bench_alloc(size_t bytes) {
+    void* p = malloc(bytes);
+    if (!p) {
+        fprintf(stderr, "bench-sort: out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static int cmp_i32(const void* a, const void* b) {
+    int32_t x = *(const int32_t*)a, y = *(const int32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_char(const void* a, const void* b) {
+    return (int)*(const unsigned char*)a - (int)*(const unsigned char*)b;
+}
+
+static int cmp_f32(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_str(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void report(const char* type, int n, double ours, double theirs, int same) {
+    printf("%-5s %8d  cookie_sort %8.1f ms  qsort %8.1f ms  %5.1fx%s\n", type, n, ours, theirs,
+           theirs / (ours > 0 ? ours : 1e-3), same ? "" : "  MISMATCH");
+}
+
+static void bench_i32(void) {
+    int32_t* a = bench_alloc(BENCH_N * sizeof(int32_t));
+    int32_t* b = bench_alloc(BENCH_N * sizeof(int32_t));
+    for (int i = 0; i < BENCH_N; i++)
+        a[i] = b[i] = (int32_t)rng();
+    double t0 = now_ms();
+    cookie_sort_i32(a, BENCH_N, 0);
+    double t1 = now_ms();
+    qsort(b, BENCH_N, sizeof(int32_t), cmp_i32);
+    double t2 = now_ms();
+    report("int", BENCH_N, t1 - t0, t2 - t1, memcmp(a, b, BENCH_N * sizeof(int32_t)) == 0);
+    free(a);
+    free(b);
+}
+
+static void bench_f32(void) {
+    float* a = bench_alloc(BENCH_N * sizeof(float));
+    float* b = bench_alloc(BENCH_N * sizeof(float));
+    for (int i = 0; i < BENCH_N; i++)
+        a[i] = b[i] = (float)((int64_t)(rng() % 2000001) - 1000000) / 7.0f;
+    double t0 = now_ms();
+    cookie_sort_f32(a, BENCH_N, 0);
+    double t1 = now_ms();
+    qsort(b, BENCH_N, sizeof(float), cmp_f32);
+    double t2 = now_ms();
+    report("float", BENCH_N, t1 - t0, t2 - t1, memcmp(a, b, BENCH_N * sizeof(float)) == 0);
+    free(a);
+    free(b);
+}
+
+static void bench_char(void) {
+    char* a = bench_alloc(BENCH_N);
+    char* b = bench_alloc(BENCH_N);
+    for (int i = 0; i < BENCH_N; i++)
+        a[i] = b[i] = (char)(' ' + rng() % 95);
+    double t0 = now_ms();
+    cookie_sort_char(a, BENCH_N, 0);
+    double t1 = now_ms();
+    qsort(b, BENCH_N, 1, cmp_char);
+    double t2 = now_ms();
+    report("char", BENCH_N, t1 - t0, t2 - t1, memcmp(a, b, BENCH_N) == 0);
+    free(a);
+    free(b);
+}
+
+// Bools are packed 64 to a word in arrays; qsort gets one byte per bool.
+static void bench_bool(void) {
+    size_t words = (BENCH_N + 63) / 64;
+    uint64_t* a = bench_alloc(words * sizeof(uint64_t));
+    char* b = bench_alloc(BENCH_N);
+    memset(a, 0, words * sizeof(uint64_t));
+    for (int i = 0; i < BENCH_N; i++) {
+        b[i] = rng() & 1;
+        a[i >> 6] |= (uint64_t)b[i] << (i & 63);
+    }
+    double t0 = now_ms();
+    cookie_sort_bits(a, BENCH_N, 0);
+    double t1 = now_ms();
+    qsort(b, BENCH_N, 1, cmp_char);
+    double t2 = now_ms();
+    int same = 1;
+    for (int i = 0; i < BENCH_N && same; i++)
+        same = (int)((a[i >> 6] >> (i & 63)) & 1) == b[i];
+    report("bool", BENCH_N, t1 - t0, t2 - t1, same);
+    free(a);
+    free(b);
+}
+
+// Strings share a few prefixes, like keys or paths often do.
+static void bench_str(void) {
+    static const char* prefixes[] = {"", "user_", "user_id_", "item/", "item/archive/"};
+    char** a = bench_alloc(BENCH_STR_N * sizeof(char*));
+    char** b = bench_alloc(BENCH_STR_N * sizeof(char*));
+    char* text = bench_alloc((size_t)BENCH_STR_N * 32);
+    for (int i = 0; i < BENCH_STR_N; i++) {
+        char* s = text + (size_t)i * 32;
+        int len = sprintf(s, "%s", prefixes[rng() % 5]);
+        for (int k = 1 + rng() % 10; k > 0; k--)
+            s[len++] = (char)('a' + rng() % 26);
+        s[len] = '\0';
+        a[i] = b[i] = s;
+    }
+    double t0 = now_ms();
+    cookie_sort_str(a, BENCH_STR_N, 0);
+    double t1 = now_ms();
+    qsort(b, BENCH_STR_N, sizeof(char*), cmp_str);
+    double t2 = now_ms();
+    int same = 1;
+    for (int i = 0; i < BENCH_STR_N && same; i++)
+        same = strcmp(a[i], b[i]) == 0;
+    report("str", BENCH_STR_N, t1 - t0, t2 - t1, same);
+    free(a);
+    free(b);
+    free(text);
+}
+
+int main(void) {
+    bench_i32();
+    bench_f32();
+    bench_char();
+    bench_bool();
+    bench_str();
+    return 0;
+}
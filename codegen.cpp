@@ -1,4 +1,5 @@
 #include <map>
+#include <set>
 #include <vector>
 #include <functional>
 #include "llvm/IR/IRBuilder.h"
@@ -13,25 +14,51 @@
 #include "llvm/IR/GlobalVariable.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/Instructions.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#if LLVM_VERSION_MAJOR >= 17
+#include "llvm/TargetParser/Host.h"
+#else
+#include "llvm/Support/Host.h"
+#endif
 #include "ast.h"
 #include <iostream>
 #include <cstring>
 #include <cstdlib>
+#include <cstdio>
+#include <chrono>
 using namespace llvm;
 
 // Forward declarations for helper functions.
 Value *generateIR(ASTNode *node, Function* currentFunction);
-void extractParams(ASTNode* paramNode, std::vector<Type*>& types, std::vector<std::string>& names);
-void extractArgs(ASTNode* argNode, std::vector<Value*>& args, Function* currentFunction);
+void extractParams(ASTNode* paramList, std::vector<Type*>& types, std::vector<std::string>& names);
+void extractArgs(ASTNode* argList, Function* callee, std::vector<Value*>& args, Function* currentFunction);
 void generateFunctions(ASTNode* node);
 void generateGlobalStatements(ASTNode* node, Function* mainFunc);
 
 extern "C" int yyparse();
+extern "C" FILE *yyin;
+extern "C" void cookie_flush(void);  // runtime.c
 extern ASTNode* root;
 extern void printAST(ASTNode* node, int level);
 
-LLVMContext Context;
+// The context lives on the heap so that `cookie run` can hand ownership to the JIT.
+LLVMContext &Context = *new LLVMContext();
 Module *TheModule = new Module("GoofyLang", Context);
 IRBuilder<> Builder(Context);
 std::map<std::string, Value*> NamedValues;
@@ -45,92 +72,169 @@ static AllocaInst* CreateEntryBlockAlloca(Function* TheFunction, const std::stri
   return TmpB.CreateAlloca(type, nullptr, VarName);
 }
 
-// Helper: Get or create declaration for printf.
-Function* getPrintfFunction() {
-  Function *printfFunc = TheModule->getFunction("printf");
-  if (!printfFunc) {
-    std::vector<Type*> printfArgs;
-    printfArgs.push_back(PointerType::get(Type::getInt8Ty(Context), 0));
-    FunctionType* printfType = FunctionType::get(Type::getInt32Ty(Context), printfArgs, true);
-    printfFunc = Function::Create(printfType, Function::ExternalLinkage, "printf", TheModule);
-  }
-  return printfFunc;
+// Utility: the items of a flattened list node (STATEMENT_LIST, GLOBAL_LIST, ARG_LIST, ...).
+// Any other node is a list of one; null is the empty list.
+static ArrayRef<ASTNode*> listItems(ASTNode *const &node) {
+  if (!node)
+    return {};
+  if (isListKind(node->kind))
+    return ArrayRef<ASTNode*>(node->children, node->childCount);
+  return ArrayRef<ASTNode*>(node);
 }
 
-Function* getIntToStrFunction() {
-  Function *f = TheModule->getFunction("int_to_string");
+// --- Strings ---
+// A string is an i8* to NUL-terminated data preceded by an 8-byte header
+// {i32 len, i32 cap} (see CookieStr in runtime.c).
+static Type* getStringType() {
+  return PointerType::get(Type::getInt8Ty(Context), 0);
+}
+
+// --- Records ---
+// `type Point { float x; float y; }` declares a named LLVM struct with one
+// member per field, in order. Records are values: a record variable is an
+// alloca of the struct, and fields are reached with a struct GEP.
+struct RecordInfo {
+  StructType *type;
+  std::vector<std::string> fieldNames;
+};
+static std::map<std::string, RecordInfo> Records;
+
+static const RecordInfo* lookupRecord(Type *type) {
+  StructType *structType = dyn_cast<StructType>(type);
+  if (!structType || !structType->hasName())
+    return nullptr;
+  auto it = Records.find(structType->getName().str());
+  return it != Records.end() && it->second.type == structType ? &it->second : nullptr;
+}
+
+static PointerType* getChanRuntimeType();
+
+// Helper: The LLVM type for a type name as written in parameters ("int", "string", "Point", "chan<int>", ...).
+static Type* getTypeFromName(const std::string &typeStr) {
+  if (typeStr.compare(0, 5, "chan<") == 0 && typeStr.back() == '>')
+    return getChanRuntimeType();
+  if (typeStr == "float") return Type::getFloatTy(Context);
+  if (typeStr == "bool") return Type::getInt1Ty(Context);
+  if (typeStr == "char") return Type::getInt8Ty(Context);
+  if (typeStr == "string") return getStringType();
+  auto it = Records.find(typeStr);
+  if (it != Records.end())
+    return it->second.type;
+  if (typeStr != "int")
+    report_fatal_error(Twine("Unknown type '") + typeStr + "'");
+  return Type::getInt32Ty(Context);
+}
+
+// Helper: Get or create the declaration of a runtime.c function.
+static Function* getRuntimeFunction(const char *name, Type *retType, ArrayRef<Type*> args) {
+  Function *f = TheModule->getFunction(name);
   if (!f) {
-    std::vector<Type*> args;
-    args.push_back(Type::getInt32Ty(Context));
-    FunctionType* ft = FunctionType::get(PointerType::get(Type::getInt8Ty(Context), 0), args, false);
-    f = Function::Create(ft, Function::ExternalLinkage, "int_to_string", TheModule);
+    FunctionType* ft = FunctionType::get(retType, args, false);
+    f = Function::Create(ft, Function::ExternalLinkage, name, TheModule);
   }
   return f;
 }
 
+Function* getIntToStrFunction() {
+  return getRuntimeFunction("cookie_str_from_i32", getStringType(), {Type::getInt32Ty(Context)});
+}
+
 Function* getCharToStrFunction() {
-  Function *f = TheModule->getFunction("char_to_string");
-  if (!f) {
-    std::vector<Type*> args;
-    args.push_back(Type::getInt8Ty(Context));
-    FunctionType* ft = FunctionType::get(PointerType::get(Type::getInt8Ty(Context), 0), args, false);
-    f = Function::Create(ft, Function::ExternalLinkage, "char_to_string", TheModule);
-  }
-  return f;
+  return getRuntimeFunction("cookie_str_from_char", getStringType(), {Type::getInt32Ty(Context)});
 }
 
-// Global format strings.
-GlobalVariable* getFormatStringInt() {
-  GlobalVariable *fmtStrVar = TheModule->getNamedGlobal(".str_int");
-  if (!fmtStrVar) {
-    Constant *formatStr = ConstantDataArray::getString(Context, "%d\n", true);
-    fmtStrVar = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                   GlobalValue::PrivateLinkage, formatStr, ".str_int");
-  }
-  return fmtStrVar;
+Function* getStrLenFunction() {
+  return getRuntimeFunction("cookie_str_len", Type::getInt32Ty(Context), {getStringType()});
+}
+
+Function* getStrAtFunction() {
+  return getRuntimeFunction("cookie_str_at", Type::getInt32Ty(Context), {getStringType(), Type::getInt32Ty(Context)});
+}
+
+Function* getStrConcatNFunction() {
+  return getRuntimeFunction("cookie_str_concat_n", getStringType(),
+                        {PointerType::get(getStringType(), 0), Type::getInt32Ty(Context)});
 }
 
-GlobalVariable* getFormatStringFloat() {
-  GlobalVariable *fmtStrVar = TheModule->getNamedGlobal(".str_float");
-  if (!fmtStrVar) {
-    Constant *formatStr = ConstantDataArray::getString(Context, "%.1f\n", true);
-    fmtStrVar = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                   GlobalValue::PrivateLinkage, formatStr, ".str_float");
+Function* getStrAppendFunction() {
+  return getRuntimeFunction("cookie_str_append", getStringType(), {getStringType(), getStringType()});
+}
+
+Function* getStrShareFunction() {
+  return getRuntimeFunction("cookie_str_share", getStringType(), {getStringType()});
+}
+
+// Helper: A constant string with its header, emitted once per distinct text.
+static Constant* getStringConstant(StringRef text) {
+  static std::map<std::string, GlobalVariable*> StringConstants;
+  GlobalVariable *&gv = StringConstants[text.str()];
+  if (!gv || gv->getParent() != TheModule) {
+    Type *i32 = Type::getInt32Ty(Context);
+    Constant *data = ConstantDataArray::getString(Context, text, true);
+    Constant *len = ConstantInt::get(i32, text.size());
+    Constant *init = ConstantStruct::getAnon({len, len, data});
+    gv = new GlobalVariable(*TheModule, init->getType(), true,
+                            GlobalValue::PrivateLinkage, init, ".str");
+    gv->setUnnamedAddr(GlobalValue::UnnamedAddr::Global);
   }
-  return fmtStrVar;
+  Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
+  Constant *indices[] = {zero, ConstantInt::get(Type::getInt32Ty(Context), 2), zero};
+  return ConstantExpr::getInBoundsGetElementPtr(gv->getValueType(), gv, indices);
 }
 
-GlobalVariable* getFormatStringChar() {
-  GlobalVariable *fmtStrVar = TheModule->getNamedGlobal(".str_char");
-  if (!fmtStrVar) {
-    Constant *formatStr = ConstantDataArray::getString(Context, "%c\n", true);
-    fmtStrVar = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                   GlobalValue::PrivateLinkage, formatStr, ".str_char");
+// Output runtime functions: void cookie_write_<kind>(T) in runtime.c.
+static Function* getWriteFunction(const char *name, Type *argType) {
+  Function *f = TheModule->getFunction(name);
+  if (!f) {
+    std::vector<Type*> args;
+    if (argType)
+      args.push_back(argType);
+    FunctionType* ft = FunctionType::get(Type::getVoidTy(Context), args, false);
+    f = Function::Create(ft, Function::ExternalLinkage, name, TheModule);
   }
-  return fmtStrVar;
+  return f;
 }
 
-GlobalVariable* getFormatStringStr() {
-  GlobalVariable *fmtStrVar = TheModule->getNamedGlobal(".str_string");
-  if (!fmtStrVar) {
-    Constant *formatStr = ConstantDataArray::getString(Context, "%s\n", true);
-    fmtStrVar = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                   GlobalValue::PrivateLinkage, formatStr, ".str_string");
+Function* getWriteNewlineFunction() {
+  return getWriteFunction("cookie_write_newline", nullptr);
+}
+
+// Helper: Write one value (without a newline) the way print/inline format it.
+// Chars and bools are widened to i32 to keep the runtime ABI simple.
+static void emitWriteValue(Value *val) {
+  Type *ty = val->getType();
+  Type *i32 = Type::getInt32Ty(Context);
+  if (const RecordInfo *record = lookupRecord(ty)) {
+    // Point(x: 1.5, y: 2.0)
+    Function *writeStr = getWriteFunction("cookie_write_str", getStringType());
+    std::string text = record->type->getName().str() + "(";
+    for (unsigned k = 0; k < record->fieldNames.size(); k++) {
+      text += (k ? ", " : "") + record->fieldNames[k] + ": ";
+      Builder.CreateCall(writeStr, {getStringConstant(text)});
+      emitWriteValue(Builder.CreateExtractValue(val, k, record->fieldNames[k]));
+      text.clear();
+    }
+    Builder.CreateCall(writeStr, {getStringConstant(text + ")")});
+  } else if (ty->isIntegerTy(1)) {
+    Builder.CreateCall(getWriteFunction("cookie_write_bool", i32), {Builder.CreateZExt(val, i32, "boolarg")});
+  } else if (ty->isIntegerTy(8)) {
+    Builder.CreateCall(getWriteFunction("cookie_write_char", i32), {Builder.CreateZExt(val, i32, "chararg")});
+  } else if (ty->isFloatTy()) {
+    Builder.CreateCall(getWriteFunction("cookie_write_f32", ty), {val});
+  } else if (ty == PointerType::get(Type::getInt8Ty(Context), 0)) {
+    Builder.CreateCall(getWriteFunction("cookie_write_str", ty), {val});
+  } else if (ty->isPointerTy()) {
+    Builder.CreateCall(getWriteFunction("cookie_write_i32", i32), {Builder.CreatePtrToInt(val, i32, "ptrarg")});
+  } else if (ty->isIntegerTy()) {
+    Builder.CreateCall(getWriteFunction("cookie_write_i32", i32), {Builder.CreateIntCast(val, i32, true, "intarg")});
+  } else {
+    report_fatal_error("print: unsupported value type");
   }
-  return fmtStrVar;
 }
 
 // Helper: String concatenation.
 Function* getConcatFunction() {
-  Function *concatFunc = TheModule->getFunction("concat_strings");
-  if (!concatFunc) {
-    std::vector<Type*> concatArgs;
-    concatArgs.push_back(PointerType::get(Type::getInt8Ty(Context), 0));
-    concatArgs.push_back(PointerType::get(Type::getInt8Ty(Context), 0));
-    FunctionType* concatType = FunctionType::get(PointerType::get(Type::getInt8Ty(Context), 0), concatArgs, false);
-    concatFunc = Function::Create(concatType, Function::ExternalLinkage, "concat_strings", TheModule);
-  }
-  return concatFunc;
+  return getRuntimeFunction("cookie_str_concat", getStringType(), {getStringType(), getStringType()});
 }
 
 // Input runtime functions.
@@ -175,6 +279,36 @@ Function* getReadStringFunction() {
   return readStrFunc;
 }
 
+// Whole-array input: void read_<type>_array(T *data, i32 count).
+Function* getReadArrayFunction(Type *elemType) {
+  const char *name = "read_int_array";
+  if (elemType->isFloatTy()) name = "read_float_array";
+  else if (elemType->isIntegerTy(1)) name = "read_bool_array";
+  else if (elemType->isIntegerTy(8)) name = "read_char_array";
+  else if (elemType->isPointerTy()) name = "read_string_array";
+  Function *f = TheModule->getFunction(name);
+  if (!f) {
+    // Bool arrays are packed into i64 words.
+    Type *storeType = elemType->isIntegerTy(1) ? Type::getInt64Ty(Context) : elemType;
+    std::vector<Type*> args = {PointerType::get(storeType, 0), Type::getInt32Ty(Context)};
+    FunctionType* ft = FunctionType::get(Type::getVoidTy(Context), args, false);
+    f = Function::Create(ft, Function::ExternalLinkage, name, TheModule);
+  }
+  return f;
+}
+
+// Helper: Runtime sort for arrays of elemType, called as (data, count, desc).
+Function* getSortFunction(Type *elemType) {
+  const char *name = "cookie_sort_i32";
+  if (elemType->isFloatTy()) name = "cookie_sort_f32";
+  else if (elemType->isIntegerTy(1)) name = "cookie_sort_bits";
+  else if (elemType->isIntegerTy(8)) name = "cookie_sort_char";
+  else if (elemType->isPointerTy()) name = "cookie_sort_str";
+  Type *storeType = elemType->isIntegerTy(1) ? Type::getInt64Ty(Context) : elemType;
+  Type *i32 = Type::getInt32Ty(Context);
+  return getRuntimeFunction(name, Type::getVoidTy(Context), {PointerType::get(storeType, 0), i32, i32});
+}
+
 Function* getStrToIntFunction() {
   Function *f = TheModule->getFunction("string_to_int");
   if (!f) {
@@ -186,26 +320,1681 @@ Function* getStrToIntFunction() {
   return f;
 }
 
+// --- Arrays ---
+// An array variable is stored one of three ways:
+//  - Fixed: [N x T], when the size is a constant and the array never grows.
+//    Up to StackArrayLimit bytes it is an entry-block alloca; above that it
+//    is a zero-initialized global (BSS) in main.
+//  - Mapped: a fixed array above StackArrayLimit in any other function. An
+//    entry-block slot holds a [N x T]* to pages mapped by the runtime, which
+//    are unmapped before every return.
+//  - Vector: an entry-block alloca of a cookie.array header {i8* data, i32 len,
+//    i32 cap} (CookieArray in runtime.c) whose data comes from the runtime.
+//    Used when the size is only known at run time, or when the function calls
+//    push/pop/resize on the name. The header is zeroed on entry and its data
+//    is freed before every return.
+//  - Slice: an entry-block alloca of a {T* data, i32 len} view into another
+//    array's storage. Array parameters and returns are slices, as are
+//    `int s[] = arr[lo:hi]` declarations. A slice owns nothing, so nothing is
+//    freed, and multi-dimensional arrays are seen through one as flat.
+// Bool arrays are packed: in every layout the storage is i64 words holding 64
+// elements each, and elements are read and written with shift/mask.
+// Multi-dimensional arrays (int m[r][c]) are one row-major block of r*c
+// elements. Fixed and Mapped ones have a nested [r x [c x T]] type, so an
+// element is one GEP with all subscripts and LLVM sees the strides. A Vector
+// keeps its extents in an entry-block [rank x i32] and is indexed flat.
+// Whole-array operations (loops, input, sort, reductions) see all elements
+// in row-major order.
+// An array of records is an array of structs in any of these layouts. An
+// `soa` record array instead keeps each field in an array of its own (its
+// column, named "ps.x"), so a loop over one field streams through contiguous
+// memory; a whole element is gathered from, or scattered to, the columns.
+// ArrayVars records the layout of each array variable, keyed by its storage.
+struct ArrayInfo {
+  enum Kind { Fixed, Mapped, Vector, Slice } kind;
+  Type *elemType;     // the element type the program sees (i1 for bool)
+  uint64_t fixedLen;  // elements, for Fixed and Mapped
+  bool packed;
+  unsigned rank = 1;                // number of dimensions
+  std::vector<uint64_t> fixedDims;  // extents, for multi-dimensional Fixed and Mapped
+  Value *dimsSlot = nullptr;        // extents, for multi-dimensional Vector
+  bool borrowed = false;            // a Slice into storage the caller owns
+  std::vector<Value*> columns;      // field columns, for an soa record array
+};
+static std::map<Value*, ArrayInfo> ArrayVars;
+// Mapped and Vector arrays declared in the function being generated.
+static std::vector<Value*> FunctionOwnedArrays;
+// Largest fixed array kept on the stack, in bytes (-stack-array-limit).
+static uint64_t StackArrayLimit = 1 << 20;
+// Ask for transparent huge pages for arrays placed off the stack (-huge-pages).
+static bool HugePages = false;
+// Names the function being generated calls push/pop/resize on.
+static std::set<std::string> GrowableArrays;
+// Nonzero while a parallel loop body is being generated.
+static int ParallelBodyDepth = 0;
+// Number of loop bodies around the statement being generated.
+static int LoopDepth = 0;
+
+static StructType* getArrayHeaderType() {
+  static StructType *HeaderType = nullptr;
+  if (!HeaderType)
+    HeaderType = StructType::create(Context, {getStringType(), Type::getInt32Ty(Context), Type::getInt32Ty(Context)},
+                                    "cookie.array");
+  return HeaderType;
+}
+
+// Helper: The {T*, i32} type of a slice of T elements (i64 words for bool).
+static StructType* getSliceType(Type *elemType) {
+  Type *slotType = elemType->isIntegerTy(1) ? Type::getInt64Ty(Context) : elemType;
+  return StructType::get(Context, {PointerType::get(slotType, 0), Type::getInt32Ty(Context)});
+}
+
+// Helper: The type as a slice type, or null. Records are named structs, so
+// only the literal {T*, i32} structs are slices.
+static StructType* asSliceType(Type *type) {
+  StructType *structType = dyn_cast<StructType>(type);
+  return structType && structType->isLiteral() ? structType : nullptr;
+}
+
+// Helper: Declarations of the cookie_array_* runtime functions.
+static Function* getArrayFunction(const char *name, Type *retType, ArrayRef<Type*> extraArgs) {
+  std::vector<Type*> args = {PointerType::get(getArrayHeaderType(), 0)};
+  args.insert(args.end(), extraArgs.begin(), extraArgs.end());
+  return getRuntimeFunction(name, retType, args);
+}
+
+// Helper: The element type of the array declared by a DECL_ARRAY* node.
+static Type* getArrayElementType(NodeKind kind) {
+  switch (kind) {
+  case NODE_DECL_ARRAY_FLOAT: case NODE_DECL_ARRAY_INIT_FLOAT:
+    return Type::getFloatTy(Context);
+  case NODE_DECL_ARRAY_BOOL: case NODE_DECL_ARRAY_INIT_BOOL:
+    return Type::getInt1Ty(Context);
+  case NODE_DECL_ARRAY_CHAR: case NODE_DECL_ARRAY_INIT_CHAR:
+    return Type::getInt8Ty(Context);
+  case NODE_DECL_ARRAY_STRING: case NODE_DECL_ARRAY_INIT_STRING:
+    return getStringType();
+  default:
+    return Type::getInt32Ty(Context);
+  }
+}
+
+// Helper: The element size (an i64) passed to the runtime.
+static Constant* getElementSize(Type *elemType) {
+  return ConstantExpr::getSizeOf(elemType);
+}
+
+static const ArrayInfo* lookupArray(Value *storage) {
+  auto it = ArrayVars.find(storage);
+  return it == ArrayVars.end() ? nullptr : &it->second;
+}
+
+// Helper: The storage of the array named by an identifier node, or null.
+static Value* lookupArrayVar(ASTNode *node, const ArrayInfo *&info) {
+  info = nullptr;
+  if (!node || node->kind != NODE_IDENTIFIER)
+    return nullptr;
+  auto it = NamedValues.find(node->value);
+  if (it == NamedValues.end() || !(info = lookupArray(it->second)))
+    return nullptr;
+  return it->second;
+}
+
+// Helper: TBAA access tags. Array elements are tagged with their type and
+// vector header fields with a type of their own, so LLVM knows a store to an
+// element never changes a header and can keep a vector's data pointer in a
+// register through a loop. Aggregates and other accesses stay untagged.
+static MDNode* getTBAATag(StringRef typeName) {
+  static std::map<std::string, MDNode*> Tags;
+  MDNode *&tag = Tags[typeName.str()];
+  if (!tag) {
+    MDBuilder MDB(Context);
+    static MDNode *Root = MDB.createTBAARoot("cookie");
+    MDNode *typeNode = MDB.createTBAAScalarTypeNode(typeName, Root);
+    tag = MDB.createTBAAStructTagNode(typeNode, typeNode, 0);
+  }
+  return tag;
+}
+
+static Instruction* tagArrayHeader(Instruction *access) {
+  access->setMetadata(LLVMContext::MD_tbaa, getTBAATag("cookie.array header"));
+  return access;
+}
+
+static Instruction* tagArrayElement(Instruction *access, Type *type) {
+  if (type->isStructTy())
+    return access;
+  std::string typeName;
+  raw_string_ostream os(typeName);
+  type->print(os);
+  access->setMetadata(LLVMContext::MD_tbaa, getTBAATag(os.str()));
+  return access;
+}
+
+static Value* emitArrayLength(Value *storage, const ArrayInfo &info) {
+  if (!info.columns.empty())
+    return emitArrayLength(info.columns[0], *lookupArray(info.columns[0]));
+  if (info.kind == ArrayInfo::Fixed || info.kind == ArrayInfo::Mapped)
+    return ConstantInt::get(Type::getInt32Ty(Context), info.fixedLen);
+  if (info.kind == ArrayInfo::Slice) {
+    Value *lenPtr = Builder.CreateStructGEP(getSliceType(info.elemType), storage, 1, "array_len_ptr");
+    return Builder.CreateLoad(Type::getInt32Ty(Context), lenPtr, "array_len");
+  }
+  Value *lenPtr = Builder.CreateStructGEP(getArrayHeaderType(), storage, 1, "array_len_ptr");
+  return tagArrayHeader(Builder.CreateLoad(Type::getInt32Ty(Context), lenPtr, "array_len"));
+}
+
+// Helper: The type of one storage slot: the element, or an i64 word of bools.
+static Type* getSlotType(const ArrayInfo &info) {
+  return info.packed ? Type::getInt64Ty(Context) : info.elemType;
+}
+
+// Helper: Whether elements are addressed through the nested array type.
+static bool isNestedArray(const ArrayInfo &info) {
+  return info.rank > 1 && !info.packed && info.kind != ArrayInfo::Vector;
+}
+
+// Helper: The [N x T] (or [words x i64], or nested [r x [c x T]]) type of a
+// fixed or mapped array.
+static ArrayType* getFixedArrayType(const ArrayInfo &info) {
+  if (!isNestedArray(info))
+    return ArrayType::get(getSlotType(info), info.packed ? (info.fixedLen + 63) / 64 : info.fixedLen);
+  Type *type = info.elemType;
+  for (auto it = info.fixedDims.rbegin(); it != info.fixedDims.rend(); ++it)
+    type = ArrayType::get(type, *it);
+  return cast<ArrayType>(type);
+}
+
+// Helper: The [N x T]* held in a mapped array's slot.
+static Value* emitMappedArray(Value *slot, const ArrayInfo &info) {
+  return Builder.CreateLoad(PointerType::get(getFixedArrayType(info), 0), slot, "mapped_array");
+}
+
+// Helper: Pointer to the first storage slot. A vector's data is reloaded each
+// time, since push/resize may have moved it.
+static Value* emitArrayData(Value *storage, const ArrayInfo &info) {
+  if (!info.columns.empty())
+    report_fatal_error("An soa record array is not one block of elements; use one of its field columns");
+  if (info.kind == ArrayInfo::Mapped)
+    storage = emitMappedArray(storage, info);
+  if (info.kind == ArrayInfo::Slice) {
+    StructType *sliceType = getSliceType(info.elemType);
+    Value *dataPtr = Builder.CreateStructGEP(sliceType, storage, 0, "slice_data_ptr");
+    return Builder.CreateLoad(sliceType->getElementType(0), dataPtr, "array_data");
+  }
+  if (info.kind != ArrayInfo::Vector) {
+    std::vector<Value*> zeros(isNestedArray(info) ? info.rank + 1 : 2, ConstantInt::get(Type::getInt32Ty(Context), 0));
+    return Builder.CreateInBoundsGEP(getFixedArrayType(info), storage, zeros, "array_data");
+  }
+  Value *dataPtr = Builder.CreateStructGEP(getArrayHeaderType(), storage, 0, "array_data_ptr");
+  Value *data = tagArrayHeader(Builder.CreateLoad(getStringType(), dataPtr, "array_data_raw"));
+  return Builder.CreateBitCast(data, PointerType::get(getSlotType(info), 0), "array_data");
+}
+
+// Helper: Pointer to the storage slot at a 0-based index.
+static Value* emitArraySlotPtr(Value *storage, const ArrayInfo &info, Value *index) {
+  if (info.kind == ArrayInfo::Vector || info.kind == ArrayInfo::Slice || isNestedArray(info))
+    return Builder.CreateGEP(getSlotType(info), emitArrayData(storage, info), index, "arrayelem");
+  if (info.kind == ArrayInfo::Mapped)
+    storage = emitMappedArray(storage, info);
+  Value *indices[] = {ConstantInt::get(Type::getInt32Ty(Context), 0), index};
+  return Builder.CreateGEP(getFixedArrayType(info), storage, indices, "arrayelem");
+}
+
+// Helper: For a packed element index, the pointer to its word and its bit
+// as a single-bit i64 mask.
+static Value* emitBitSlot(Value *storage, const ArrayInfo &info, Value *index, Value *&mask) {
+  Type *i64 = Type::getInt64Ty(Context);
+  Value *word = Builder.CreateLShr(index, ConstantInt::get(index->getType(), 6), "bit_word");
+  Value *bit = Builder.CreateAnd(Builder.CreateZExt(index, i64), ConstantInt::get(i64, 63), "bit_index");
+  mask = Builder.CreateShl(ConstantInt::get(i64, 1), bit, "bit_mask");
+  return emitArraySlotPtr(storage, info, word);
+}
+
+// Helper: Load the element at a 0-based index.
+static Value* emitArrayLoad(Value *storage, const ArrayInfo &info, Value *index) {
+  if (!info.columns.empty()) {
+    Value *record = UndefValue::get(info.elemType);
+    for (unsigned k = 0; k < info.columns.size(); k++)
+      record = Builder.CreateInsertValue(record, emitArrayLoad(info.columns[k], *lookupArray(info.columns[k]), index), k);
+    return record;
+  }
+  if (!info.packed)
+    return tagArrayElement(Builder.CreateLoad(info.elemType, emitArraySlotPtr(storage, info, index), "array_elem"),
+                           info.elemType);
+  Value *mask;
+  Value *wordPtr = emitBitSlot(storage, info, index, mask);
+  Value *word = tagArrayElement(Builder.CreateLoad(Type::getInt64Ty(Context), wordPtr, "bit_word_val"),
+                                Type::getInt64Ty(Context));
+  return Builder.CreateICmpNE(Builder.CreateAnd(word, mask), ConstantInt::get(word->getType(), 0), "array_elem");
+}
+
+// Helper: Store an element (already of the element type) at a 0-based index.
+static void emitArrayStore(Value *storage, const ArrayInfo &info, Value *index, Value *val) {
+  if (!info.columns.empty()) {
+    for (unsigned k = 0; k < info.columns.size(); k++)
+      emitArrayStore(info.columns[k], *lookupArray(info.columns[k]), index, Builder.CreateExtractValue(val, k));
+    return;
+  }
+  if (!info.packed) {
+    tagArrayElement(Builder.CreateStore(val, emitArraySlotPtr(storage, info, index)), info.elemType);
+    return;
+  }
+  Value *mask;
+  Value *wordPtr = emitBitSlot(storage, info, index, mask);
+  Type *i64 = Type::getInt64Ty(Context);
+  // Another thread may be writing other bits of the same word: pieces of a
+  // parallel loop split at any index, and an array parameter may be shared
+  // with a task. Those stores clear and set the bit atomically.
+  if (ParallelBodyDepth > 0 || info.borrowed) {
+    ConstantInt *constVal = dyn_cast<ConstantInt>(val);
+    if (!constVal || constVal->isZero())
+      Builder.CreateAtomicRMW(AtomicRMWInst::And, wordPtr, Builder.CreateNot(mask), MaybeAlign(8),
+                              AtomicOrdering::Monotonic);
+    if (!constVal || !constVal->isZero())
+      Builder.CreateAtomicRMW(AtomicRMWInst::Or, wordPtr,
+                              constVal ? mask : Builder.CreateSelect(val, mask, ConstantInt::get(i64, 0), "bit_set"),
+                              MaybeAlign(8), AtomicOrdering::Monotonic);
+    return;
+  }
+  Value *word = tagArrayElement(Builder.CreateLoad(i64, wordPtr, "bit_word_val"), i64);
+  Value *cleared = Builder.CreateAnd(word, Builder.CreateNot(mask), "bit_cleared");
+  Value *set = Builder.CreateSelect(val, mask, ConstantInt::get(i64, 0), "bit_set");
+  tagArrayElement(Builder.CreateStore(Builder.CreateOr(cleared, set), wordPtr), i64);
+}
+
+// Helper: The extent of dimension k.
+static Value* emitArrayDim(Value *storage, const ArrayInfo &info, unsigned k) {
+  if (info.rank == 1)
+    return emitArrayLength(storage, info);
+  Type *i32 = Type::getInt32Ty(Context);
+  if (info.kind != ArrayInfo::Vector)
+    return ConstantInt::get(i32, info.fixedDims[k]);
+  ArrayType *dimsType = ArrayType::get(i32, info.rank);
+  return Builder.CreateLoad(i32, Builder.CreateConstInBoundsGEP2_32(dimsType, info.dimsSlot, 0, k), "array_dim");
+}
+
+// Helper: Evaluate the subscripts of an access (one expression, or an
+// INDEX_LIST) as 0-based i32 indices.
+static std::vector<Value*> emitArrayIndices(ASTNode *indexNode, Function *currentFunction) {
+  std::vector<Value*> indices;
+  ArrayRef<ASTNode*> items = indexNode->kind == NODE_INDEX_LIST ? listItems(indexNode) : ArrayRef<ASTNode*>(indexNode);
+  for (ASTNode *item : items) {
+    Value *index = generateIR(item, currentFunction);
+    if (!index->getType()->isIntegerTy(32))
+      index = Builder.CreateIntCast(index, Type::getInt32Ty(Context), true, "indexCast");
+    // nsw: a valid 1-based index is at least 1, so this never wraps, and
+    // LLVM can see a[i] step through memory even where i starts at a
+    // run-time value (the pieces of a parallel loop).
+    indices.push_back(Builder.CreateNSWSub(index, ConstantInt::get(Type::getInt32Ty(Context), 1), "index_adj"));
+  }
+  return indices;
+}
+
+// Helper: Row-major position of the block selected by the leading indices:
+// the element's flat index when every dimension is given, or the first
+// element of a row (or plane) when fewer are.
+static Value* emitFlatIndex(Value *storage, const ArrayInfo &info, ArrayRef<Value*> indices) {
+  Value *flat = indices[0];
+  for (unsigned k = 1; k < info.rank; k++) {
+    flat = Builder.CreateMul(flat, emitArrayDim(storage, info, k), "flat_index");
+    if (k < indices.size())
+      flat = Builder.CreateAdd(flat, indices[k], "flat_index");
+  }
+  return flat;
+}
+
+// Helper: Pointer to an element of a nested (fixed multi-dimensional) array.
+static Value* emitNestedElementPtr(Value *storage, const ArrayInfo &info, ArrayRef<Value*> indices) {
+  if (info.kind == ArrayInfo::Mapped)
+    storage = emitMappedArray(storage, info);
+  std::vector<Value*> gepIndices = {ConstantInt::get(Type::getInt32Ty(Context), 0)};
+  gepIndices.insert(gepIndices.end(), indices.begin(), indices.end());
+  return Builder.CreateGEP(getFixedArrayType(info), storage, gepIndices, "arrayelem");
+}
+
+static void checkSubscriptCount(const ArrayInfo &info, ArrayRef<Value*> indices) {
+  if (indices.size() != info.rank)
+    report_fatal_error(Twine("array element access needs ") + Twine(info.rank) + " subscripts");
+}
+
+// Helper: Load the element at 0-based subscripts, one per dimension.
+static Value* emitArrayLoadAt(Value *storage, const ArrayInfo &info, ArrayRef<Value*> indices) {
+  checkSubscriptCount(info, indices);
+  if (isNestedArray(info))
+    return Builder.CreateLoad(info.elemType, emitNestedElementPtr(storage, info, indices), "array_elem");
+  return emitArrayLoad(storage, info, emitFlatIndex(storage, info, indices));
+}
+
+static void emitArrayStoreAt(Value *storage, const ArrayInfo &info, ArrayRef<Value*> indices, Value *val) {
+  checkSubscriptCount(info, indices);
+  if (isNestedArray(info))
+    Builder.CreateStore(val, emitNestedElementPtr(storage, info, indices));
+  else
+    emitArrayStore(storage, info, emitFlatIndex(storage, info, indices), val);
+}
+
+// Helper: Run `body` with the loop variable set to each element at 0-based
+// flat positions [start, end), read in place.
+static Value* emitElementLoop(const char *loopVarName, Value *storage, const ArrayInfo &info, Value *start,
+                              Value *end, ASTNode *body, Function *currentFunction) {
+  Type *i32 = Type::getInt32Ty(Context);
+  AllocaInst *indexAlloca = CreateEntryBlockAlloca(currentFunction, "elem_iter_index", i32);
+  Builder.CreateStore(start, indexAlloca);
+
+  BasicBlock *condBB = BasicBlock::Create(Context, "elem_iter.cond", currentFunction);
+  BasicBlock *bodyBB = BasicBlock::Create(Context, "elem_iter.body", currentFunction);
+  BasicBlock *afterBB = BasicBlock::Create(Context, "elem_iter.after", currentFunction);
+  Builder.CreateBr(condBB);
+  Builder.SetInsertPoint(condBB);
+  Value *cur = Builder.CreateLoad(i32, indexAlloca, "elem_index");
+  Builder.CreateCondBr(Builder.CreateICmpSLT(cur, end, "elem_iter_cond"), bodyBB, afterBB);
+
+  Builder.SetInsertPoint(bodyBB);
+  Value *elemVal = emitArrayLoad(storage, info, cur);
+  Value *loopVarAlloca = NamedValues[loopVarName];
+  if (!loopVarAlloca) {
+    loopVarAlloca = CreateEntryBlockAlloca(currentFunction, loopVarName, elemVal->getType());
+    NamedValues[loopVarName] = loopVarAlloca;
+  }
+  Builder.CreateStore(elemVal, loopVarAlloca);
+  LoopDepth++;
+  generateIR(body, currentFunction);
+  LoopDepth--;
+  cur = Builder.CreateLoad(i32, indexAlloca, "elem_index");
+  Builder.CreateStore(Builder.CreateAdd(cur, ConstantInt::get(i32, 1), "next_index"), indexAlloca);
+  Builder.CreateBr(condBB);
+  Builder.SetInsertPoint(afterBB);
+  return ConstantInt::get(i32, 0);
+}
+
+// Helper: `loop x : m[i]` over a row (or, with fewer subscripts than
+// dimensions, any sub-block) of a multi-dimensional array. The loop reads
+// the elements in place from the row's flat start, without copying the row.
+static Value* generateRowLoop(const char *loopVarName, Value *storage, const ArrayInfo &info, ASTNode *indexNode,
+                              ASTNode *body, Function *currentFunction) {
+  std::vector<Value*> indices = emitArrayIndices(indexNode, currentFunction);
+  if (indices.size() >= info.rank)
+    report_fatal_error("loop over an array element; give fewer subscripts to loop over a row");
+  Value *start = emitFlatIndex(storage, info, indices);
+  Value *count = emitArrayDim(storage, info, indices.size());
+  for (unsigned k = indices.size() + 1; k < info.rank; k++)
+    count = Builder.CreateMul(count, emitArrayDim(storage, info, k), "row_count");
+  Value *end = Builder.CreateAdd(start, count, "row_end");
+  return emitElementLoop(loopVarName, storage, info, start, end, body, currentFunction);
+}
+
+// Helper: Convert a value to an element type for a store (int <-> float,
+// int -> bool, int <-> char).
+static Value* emitElementCast(Value *val, Type *elemType) {
+  Type *ty = val->getType();
+  if (ty == elemType)
+    return val;
+  if (elemType->isFloatTy() && ty->isIntegerTy())
+    return Builder.CreateSIToFP(val, elemType, "intToFloat");
+  if (elemType->isIntegerTy() && ty->isFloatTy())
+    return Builder.CreateFPToSI(val, elemType, "floatToInt");
+  if (elemType->isIntegerTy(1) && ty->isIntegerTy())
+    return Builder.CreateICmpNE(val, ConstantInt::get(ty, 0), "boolcast");
+  if (elemType->isIntegerTy() && ty->isIntegerTy())
+    return Builder.CreateIntCast(val, elemType, ty->getIntegerBitWidth() > 8, "intcast");
+  report_fatal_error("Array element has the wrong type");
+}
+
+// Helper: Declare an array with the given extents (one per dimension).
+// Elements are zeroed unless the caller stores all of them itself.
+static Value* declareArray(const std::string &name, Type *elemType, ArrayRef<Value*> dims, bool zeroFill,
+                           Function *currentFunction) {
+  Type *i32 = Type::getInt32Ty(Context);
+  std::vector<Value*> extents;
+  bool constDims = true;
+  Value *count = nullptr;
+  for (Value *dim : dims) {
+    if (!dim->getType()->isIntegerTy(32))
+      dim = Builder.CreateIntCast(dim, i32, true, "arraysize");
+    ConstantInt *c = dyn_cast<ConstantInt>(dim);
+    constDims &= c && !c->isNegative();
+    extents.push_back(dim);
+    count = count ? Builder.CreateMul(count, dim, "array_count") : dim;
+  }
+  ConstantInt *constCount = constDims ? dyn_cast<ConstantInt>(count) : nullptr;
+  Value *storage;
+  ArrayInfo info;
+  info.elemType = elemType;
+  info.packed = elemType->isIntegerTy(1);
+  info.rank = extents.size();
+  if (info.rank > 1 && GrowableArrays.count(name))
+    report_fatal_error(Twine("'") + name + "': push/pop/resize need a one-dimensional array");
+  // Bits are stored with read-modify-write, so packed words always start zeroed.
+  if (info.packed)
+    zeroFill = true;
+  if (constCount && !GrowableArrays.count(name)) {
+    info.kind = ArrayInfo::Fixed;
+    info.fixedLen = constCount->getZExtValue();
+    if (info.rank > 1)
+      for (Value *dim : extents)
+        info.fixedDims.push_back(cast<ConstantInt>(dim)->getZExtValue());
+    ArrayType *arrType = getFixedArrayType(info);
+    uint64_t bytes = TheModule->getDataLayout().getTypeAllocSize(arrType);
+    Constant *byteCount = ConstantInt::get(Type::getInt64Ty(Context), bytes);
+    if (bytes <= StackArrayLimit) {
+      storage = CreateEntryBlockAlloca(currentFunction, name, arrType);
+      if (zeroFill)
+        Builder.CreateMemSet(storage, Builder.getInt8(0), byteCount, MaybeAlign());
+    } else if (currentFunction->getName() == "main") {
+      // main runs once, so its large arrays can be globals. The pages start
+      // zeroed; only a declaration inside a loop body runs again and clears them.
+      GlobalVariable *gv = new GlobalVariable(*TheModule, arrType, false, GlobalValue::InternalLinkage,
+                                              ConstantAggregateZero::get(arrType), name);
+      gv->setAlignment(Align(HugePages ? 1 << 21 : 64));
+      storage = gv;
+      Value *data = Builder.CreateBitCast(gv, getStringType(), "array_bytes");
+      if (LoopDepth > 0) {
+        if (zeroFill)
+          Builder.CreateMemSet(gv, Builder.getInt8(0), byteCount, MaybeAlign());
+      } else if (HugePages) {
+        Builder.CreateCall(getRuntimeFunction("cookie_array_advise", Type::getVoidTy(Context),
+                                              {getStringType(), Type::getInt64Ty(Context)}),
+                           {data, byteCount});
+      }
+    } else {
+      // Slot starts null; the runtime maps zeroed pages on the first
+      // declaration and clears them on later ones.
+      info.kind = ArrayInfo::Mapped;
+      Type *arrPtrType = PointerType::get(arrType, 0);
+      AllocaInst *slot = CreateEntryBlockAlloca(currentFunction, name, arrPtrType);
+      IRBuilder<> TmpB(slot->getParent(), std::next(slot->getIterator()));
+      TmpB.CreateStore(Constant::getNullValue(arrPtrType), slot);
+      FunctionOwnedArrays.push_back(slot);
+      Value *old = Builder.CreateBitCast(Builder.CreateLoad(arrPtrType, slot, "mapped_old"), getStringType());
+      Function *mapFn = getRuntimeFunction("cookie_array_map", getStringType(),
+                                           {getStringType(), Type::getInt64Ty(Context), i32});
+      Value *mem = Builder.CreateCall(mapFn, {old, byteCount, ConstantInt::get(i32, HugePages)}, "mapped");
+      Builder.CreateStore(Builder.CreateBitCast(mem, arrPtrType), slot);
+      storage = slot;
+    }
+  } else {
+    info.kind = ArrayInfo::Vector;
+    info.fixedLen = 0;
+    AllocaInst *header = CreateEntryBlockAlloca(currentFunction, name, getArrayHeaderType());
+    IRBuilder<> TmpB(header->getParent(), std::next(header->getIterator()));
+    TmpB.CreateStore(Constant::getNullValue(getArrayHeaderType()), header);
+    FunctionOwnedArrays.push_back(header);
+    if (info.rank > 1) {
+      ArrayType *dimsType = ArrayType::get(i32, info.rank);
+      info.dimsSlot = CreateEntryBlockAlloca(currentFunction, name + ".dims", dimsType);
+      for (unsigned k = 0; k < info.rank; k++)
+        Builder.CreateStore(extents[k], Builder.CreateConstInBoundsGEP2_32(dimsType, info.dimsSlot, 0, k));
+    }
+    if (info.packed)
+      Builder.CreateCall(getArrayFunction("cookie_bits_init", Type::getVoidTy(Context), {i32}), {header, count});
+    else
+      Builder.CreateCall(getArrayFunction("cookie_array_init", Type::getVoidTy(Context), {Type::getInt64Ty(Context), i32}),
+                         {header, getElementSize(elemType), count});
+    storage = header;
+  }
+  ArrayVars[storage] = info;
+  NamedValues[name] = storage;
+  return storage;
+}
+
+// Helper: Collect the array names a function body calls push/pop/resize on.
+static void collectGrowableArrays(ASTNode *node, std::set<std::string> &names) {
+  if (!node)
+    return;
+  if (node->kind == NODE_METHOD_CALL && node->left && node->left->kind == NODE_IDENTIFIER &&
+      (strcmp(node->value, "push") == 0 || strcmp(node->value, "pop") == 0 || strcmp(node->value, "resize") == 0))
+    names.insert(node->left->value);
+  collectGrowableArrays(node->left, names);
+  collectGrowableArrays(node->right, names);
+  for (int i = 0; i < node->childCount; i++)
+    collectGrowableArrays(node->children[i], names);
+}
+
+// Helper: Release the mapped and vector arrays of the function just generated
+// before each of its returns.
+static void emitArrayCleanup(Function *fn) {
+  for (BasicBlock &BB : *fn) {
+    ReturnInst *ret = dyn_cast_or_null<ReturnInst>(BB.getTerminator());
+    if (!ret)
+      continue;
+    IRBuilder<> TmpB(ret);
+    for (Value *storage : FunctionOwnedArrays) {
+      const ArrayInfo &info = ArrayVars[storage];
+      if (info.kind == ArrayInfo::Vector) {
+        TmpB.CreateCall(getArrayFunction("cookie_array_free", Type::getVoidTy(Context), {}), {storage});
+        continue;
+      }
+      ArrayType *arrType = getFixedArrayType(info);
+      Value *mem = TmpB.CreateLoad(PointerType::get(arrType, 0), storage, "mapped_array");
+      Value *bytes = ConstantInt::get(Type::getInt64Ty(Context), TheModule->getDataLayout().getTypeAllocSize(arrType));
+      TmpB.CreateCall(getRuntimeFunction("cookie_array_unmap", Type::getVoidTy(Context),
+                                         {getStringType(), Type::getInt64Ty(Context)}),
+                      {TmpB.CreateBitCast(mem, getStringType()), bytes});
+    }
+  }
+  FunctionOwnedArrays.clear();
+}
+
+// Helper: The slice an expression passes or returns: a whole array (a
+// multi-dimensional one flat), `arr[lo:hi]`, or a call that returns a slice.
+// `borrowed` tells whether the view is into storage the caller owns.
+static Value* emitSliceValue(ASTNode *node, StructType *sliceType, bool &borrowed, Function *currentFunction) {
+  Type *i32 = Type::getInt32Ty(Context);
+  borrowed = false;
+  if (node->kind != NODE_IDENTIFIER && node->kind != NODE_ARRAY_SLICE) {
+    Value *slice = generateIR(node, currentFunction);
+    if (slice->getType() != sliceType)
+      report_fatal_error("Expected an array of a different element type");
+    return slice;
+  }
+  auto it = NamedValues.find(node->value);
+  const ArrayInfo *info = it == NamedValues.end() ? nullptr : lookupArray(it->second);
+  if (!info)
+    report_fatal_error(Twine("'") + node->value + "' is not an array");
+  if (getSliceType(info->elemType) != sliceType)
+    report_fatal_error(Twine("Array '") + node->value + "' has the wrong element type");
+  borrowed = info->borrowed;
+  Value *data = emitArrayData(it->second, *info);
+  Value *len = emitArrayLength(it->second, *info);
+  if (node->kind == NODE_ARRAY_SLICE) {
+    // Bools are packed 64 to a word, so only whole bool arrays can be viewed.
+    if (info->rank > 1 || info->packed)
+      report_fatal_error(Twine("'") + node->value + "[lo:hi]' needs a one-dimensional, non-bool array");
+    Value *lo = Builder.CreateIntCast(generateIR(node->left, currentFunction), i32, true, "slice_lo");
+    Value *hi = Builder.CreateIntCast(generateIR(node->right, currentFunction), i32, true, "slice_hi");
+    Builder.CreateCall(getRuntimeFunction("cookie_array_check_slice", Type::getVoidTy(Context), {i32, i32, i32}),
+                       {lo, hi, len});
+    Value *start = Builder.CreateSub(lo, ConstantInt::get(i32, 1), "slice_start");
+    data = Builder.CreateInBoundsGEP(getSlotType(*info), data, start, "slice_data");
+    len = Builder.CreateSub(hi, start, "slice_len");
+  }
+  Value *slice = Builder.CreateInsertValue(UndefValue::get(sliceType), data, 0);
+  return Builder.CreateInsertValue(slice, len, 1, "slice");
+}
+
+// Helper: Entry-block storage for a slice value.
+static Value* emitSliceStorage(const std::string &name, Type *elemType, Value *slice, bool borrowed,
+                               Function *currentFunction) {
+  AllocaInst *storage = CreateEntryBlockAlloca(currentFunction, name, getSliceType(elemType));
+  Builder.CreateStore(slice, storage);
+  ArrayInfo info;
+  info.kind = ArrayInfo::Slice;
+  info.elemType = elemType;
+  info.fixedLen = 0;
+  info.packed = elemType->isIntegerTy(1);
+  info.borrowed = borrowed;
+  ArrayVars[storage] = info;
+  return storage;
+}
+
+// Helper: Bind a name to a slice value (a parameter or `T name[] = ...`).
+static Value* declareSlice(const std::string &name, Type *elemType, Value *slice, bool borrowed,
+                           Function *currentFunction) {
+  return NamedValues[name] = emitSliceStorage(name, elemType, slice, borrowed, currentFunction);
+}
+
+// Helper: The index of a record field, by name.
+static unsigned getFieldIndex(const RecordInfo &record, const char *field) {
+  for (unsigned k = 0; k < record.fieldNames.size(); k++)
+    if (record.fieldNames[k] == field)
+      return k;
+  report_fatal_error(Twine("Record '") + record.type->getName() + "' has no field '" + field + "'");
+}
+
+// Helper: For `ps.x` (a FIELD or FIELD_ASSIGN node) on an soa record array,
+// the storage of the x column. Null if the object is not an array.
+static Value* lookupColumn(ASTNode *node, const ArrayInfo *&info) {
+  const ArrayInfo *arrayInfo;
+  Value *storage = lookupArrayVar(node->left, arrayInfo);
+  if (!storage)
+    return nullptr;
+  if (arrayInfo->columns.empty())
+    report_fatal_error(Twine("'") + node->left->value + "." + node->value +
+                       "' needs an soa record array; index the array of structs instead");
+  Value *column = arrayInfo->columns[getFieldIndex(*lookupRecord(arrayInfo->elemType), node->value)];
+  info = lookupArray(column);
+  return column;
+}
+
+// Helper: The storage of an array operand of a builtin or loop: an array
+// name, a column of an soa record array, or `arr[lo:hi]` held in a
+// temporary slice.
+static Value* lookupArrayOperand(ASTNode *node, const ArrayInfo *&info, Function *currentFunction) {
+  if (node && node->kind == NODE_FIELD)
+    return lookupColumn(node, info);
+  if (!node || node->kind != NODE_ARRAY_SLICE)
+    return lookupArrayVar(node, info);
+  Value *varPtr = NamedValues[node->value];
+  if (!varPtr || !(info = lookupArray(varPtr)))
+    report_fatal_error(Twine("'") + node->value + "' is not an array");
+  Type *elemType = info->elemType;
+  bool borrowed;
+  Value *slice = emitSliceValue(node, getSliceType(elemType), borrowed, currentFunction);
+  Value *storage = emitSliceStorage(std::string(node->value) + ".slice", elemType, slice, borrowed, currentFunction);
+  info = lookupArray(storage);
+  return storage;
+}
+
+// Helper: Declare `Point ps[n];` (array of structs) or `soa Point ps[n];`
+// (one column per field, each an ordinary array named "ps.x").
+static Value* declareRecordArray(const std::string &name, const RecordInfo &record, Value *size, bool soa,
+                                 Function *currentFunction) {
+  if (!soa)
+    return declareArray(name, record.type, {size}, true, currentFunction);
+  if (GrowableArrays.count(name))
+    report_fatal_error(Twine("'") + name + "': push/pop/resize need an array-of-structs record array");
+  std::vector<Value*> columns;
+  for (unsigned k = 0; k < record.fieldNames.size(); k++)
+    columns.push_back(declareArray(name + "." + record.fieldNames[k], record.type->getElementType(k), {size}, true,
+                                   currentFunction));
+  // The array itself has no storage; this slot only names it.
+  Value *storage = CreateEntryBlockAlloca(currentFunction, name, record.type);
+  ArrayInfo info = *lookupArray(columns[0]);
+  info.elemType = record.type;
+  info.packed = false;
+  info.columns = columns;
+  ArrayVars[storage] = info;
+  NamedValues[name] = storage;
+  return storage;
+}
+
+// Helper: Read (val == null) or write a field: `p.x`, `ps[i].x`, or a field
+// of any record-valued expression (read only). `ps.x` on an soa array reads
+// the whole column as a slice.
+static Value* generateFieldAccess(ASTNode *node, Value *val, Function *currentFunction) {
+  ASTNode *object = node->left;
+  const ArrayInfo *info;
+  if (object->kind == NODE_IDENTIFIER) {
+    if (Value *column = lookupColumn(node, info)) {
+      if (val)
+        report_fatal_error(Twine("Assign to '") + object->value + "[i]." + node->value + "', not to a whole column");
+      Type *fieldType = info->elemType;
+      Value *slice = Builder.CreateInsertValue(UndefValue::get(getSliceType(fieldType)),
+                                               emitArrayData(column, *info), 0);
+      return Builder.CreateInsertValue(slice, emitArrayLength(column, *info), 1, "column");
+    }
+  }
+  // A field of a record in memory: a variable or an element of an array.
+  Value *recordPtr = nullptr;
+  const RecordInfo *record = nullptr;
+  if (object->kind == NODE_IDENTIFIER) {
+    AllocaInst *alloca = dyn_cast_or_null<AllocaInst>(NamedValues[object->value]);
+    if (alloca && (record = lookupRecord(alloca->getAllocatedType())))
+      recordPtr = alloca;
+  } else if (object->kind == NODE_ARRAY_ACCESS) {
+    Value *storage = NamedValues[object->value];
+    const ArrayInfo *arrayInfo = storage ? lookupArray(storage) : nullptr;
+    if (arrayInfo && (record = lookupRecord(arrayInfo->elemType))) {
+      std::vector<Value*> indices = emitArrayIndices(object->left, currentFunction);
+      checkSubscriptCount(*arrayInfo, indices);
+      unsigned k = getFieldIndex(*record, node->value);
+      if (!arrayInfo->columns.empty()) {
+        // soa: the field's column holds it at the same index.
+        Value *column = arrayInfo->columns[k];
+        const ArrayInfo &columnInfo = *lookupArray(column);
+        if (!val)
+          return emitArrayLoad(column, columnInfo, indices[0]);
+        val = emitElementCast(val, columnInfo.elemType);
+        emitArrayStore(column, columnInfo, indices[0], val);
+        return val;
+      }
+      recordPtr = emitArraySlotPtr(storage, *arrayInfo, indices[0]);
+    }
+  }
+  if (!recordPtr) {
+    if (val)
+      report_fatal_error(Twine("Cannot assign to field '") + node->value + "' of this expression");
+    Value *recordVal = generateIR(object, currentFunction);
+    if (!(record = lookupRecord(recordVal->getType())))
+      report_fatal_error(Twine("Field '") + node->value + "' of a value that is not a record");
+    return Builder.CreateExtractValue(recordVal, getFieldIndex(*record, node->value), node->value);
+  }
+  unsigned k = getFieldIndex(*record, node->value);
+  Value *fieldPtr = Builder.CreateStructGEP(record->type, recordPtr, k, std::string(node->value) + "_ptr");
+  Type *fieldType = record->type->getElementType(k);
+  if (!val)
+    return Builder.CreateLoad(fieldType, fieldPtr, node->value);
+  val = emitElementCast(val, fieldType);
+  Builder.CreateStore(val, fieldPtr);
+  return val;
+}
+
+// Helper: Define the struct type of a `type Name { ... }` declaration.
+static void defineRecord(ASTNode *node) {
+  if (Records.count(node->value))
+    report_fatal_error(Twine("Record type '") + node->value + "' is declared twice");
+  std::vector<Type*> fieldTypes;
+  RecordInfo record;
+  for (ASTNode *field : listItems(node->left)) {
+    for (const std::string &seen : record.fieldNames)
+      if (seen == field->value)
+        report_fatal_error(Twine("Record '") + node->value + "' has two fields named '" + field->value + "'");
+    fieldTypes.push_back(getTypeFromName(field->left->value));
+    record.fieldNames.push_back(field->value);
+  }
+  record.type = StructType::create(Context, fieldTypes, node->value);
+  Records[node->value] = record;
+}
+
+// Helper: The element type of an array parameter ("int[]"), or null.
+static Type* getParamArrayElementType(ASTNode *paramNode) {
+  std::string typeStr = (paramNode->left && paramNode->left->value) ? paramNode->left->value : "int";
+  if (typeStr.size() < 2 || typeStr.compare(typeStr.size() - 2, 2, "[]") != 0)
+    return nullptr;
+  return getTypeFromName(typeStr.substr(0, typeStr.size() - 2));
+}
+
+// Helper: A function returns a slice when one of its returns names an array
+// parameter, a slice variable, or a sub-slice of one. Everything else returns int.
+static void collectSliceReturns(ASTNode *node, std::map<std::string, Type*> &views, Type *&elemType) {
+  if (!node)
+    return;
+  if (node->kind == NODE_DECL_SLICE)
+    views[node->value] = getTypeFromName(node->left->value);
+  if (node->kind == NODE_RETURN && node->left && !elemType &&
+      (node->left->kind == NODE_IDENTIFIER || node->left->kind == NODE_ARRAY_SLICE) && views.count(node->left->value))
+    elemType = views[node->left->value];
+  collectSliceReturns(node->left, views, elemType);
+  collectSliceReturns(node->right, views, elemType);
+  for (int i = 0; i < node->childCount; i++)
+    collectSliceReturns(node->children[i], views, elemType);
+}
+
+static Type* getFunctionReturnType(ASTNode *funcNode) {
+  std::map<std::string, Type*> views;
+  for (ASTNode *paramNode : listItems(funcNode->left))
+    if (Type *elemType = paramNode->kind == NODE_PARAM ? getParamArrayElementType(paramNode) : nullptr)
+      views[paramNode->value] = elemType;
+  Type *elemType = nullptr;
+  collectSliceReturns(funcNode->right, views, elemType);
+  return elemType ? (Type*)getSliceType(elemType) : Type::getInt32Ty(Context);
+}
+
+// Helper: Methods on an array variable: at(i), push(x), pop() and resize(n).
+static Value* generateArrayMethod(ASTNode *node, Value *storage, const ArrayInfo &info,
+                                  Function *currentFunction) {
+  std::string methodName = node->value;
+  ArrayRef<ASTNode*> methodArgs = listItems(node->right);
+  Type *i32 = Type::getInt32Ty(Context);
+  if (info.rank > 1)
+    report_fatal_error(Twine("METHOD_CALL: '") + methodName + "' needs a one-dimensional array");
+  if (methodName == "at") {
+    if (methodArgs.size() != 1)
+      report_fatal_error("METHOD_CALL: 'at' takes exactly one index");
+    Value *indexVal = generateIR(methodArgs[0], currentFunction);
+    if (!indexVal->getType()->isIntegerTy(32))
+      indexVal = Builder.CreateIntCast(indexVal, i32, true, "indexCast");
+    indexVal = Builder.CreateSub(indexVal, ConstantInt::get(i32, 1), "at_index");
+    return emitArrayLoad(storage, info, indexVal);
+  }
+  if (methodName != "push" && methodName != "pop" && methodName != "resize")
+    report_fatal_error(Twine("METHOD_CALL: Unknown array method '") + methodName + "'");
+  if (info.kind != ArrayInfo::Vector)
+    report_fatal_error(Twine("METHOD_CALL: '") + methodName + "' needs a growable array");
+  StructType *headerType = getArrayHeaderType();
+  Value *lenPtr = Builder.CreateStructGEP(headerType, storage, 1, "array_len_ptr");
+
+  if (methodName == "push") {
+    // Inline fast path; the runtime is only called when the block is full.
+    if (methodArgs.size() != 1)
+      report_fatal_error("METHOD_CALL: 'push' takes exactly one value");
+    Value *val = emitElementCast(generateIR(methodArgs[0], currentFunction), info.elemType);
+    Value *capPtr = Builder.CreateStructGEP(headerType, storage, 2, "array_cap_ptr");
+    Value *len = Builder.CreateLoad(i32, lenPtr, "array_len");
+    Value *cap = Builder.CreateLoad(i32, capPtr, "array_cap");
+    BasicBlock *growBB = BasicBlock::Create(Context, "push.grow", currentFunction);
+    BasicBlock *storeBB = BasicBlock::Create(Context, "push.store", currentFunction);
+    Value *full = Builder.CreateICmpEQ(len, cap, "array_full");
+    Builder.CreateCondBr(full, growBB, storeBB, MDBuilder(Context).createBranchWeights(1, 64));
+    Builder.SetInsertPoint(growBB);
+    if (info.packed)
+      Builder.CreateCall(getArrayFunction("cookie_bits_grow", Type::getVoidTy(Context), {}), {storage});
+    else
+      Builder.CreateCall(getArrayFunction("cookie_array_grow", Type::getVoidTy(Context), {Type::getInt64Ty(Context)}),
+                         {storage, getElementSize(info.elemType)});
+    Builder.CreateBr(storeBB);
+    Builder.SetInsertPoint(storeBB);
+    emitArrayStore(storage, info, len, val);
+    Value *newLen = Builder.CreateAdd(len, ConstantInt::get(i32, 1), "array_len_next");
+    Builder.CreateStore(newLen, lenPtr);
+    return newLen;
+  }
+  if (methodName == "pop") {
+    if (!methodArgs.empty())
+      report_fatal_error("METHOD_CALL: 'pop' takes no arguments");
+    Value *index = Builder.CreateCall(getArrayFunction("cookie_array_pop", i32, {}), {storage}, "pop_index");
+    Value *elem = emitArrayLoad(storage, info, index);
+    // Bits past the length stay zero (see cookie_bits_init).
+    if (info.packed)
+      emitArrayStore(storage, info, index, Builder.getFalse());
+    return elem;
+  }
+  if (methodArgs.size() != 1)
+    report_fatal_error("METHOD_CALL: 'resize' takes exactly one size");
+  Value *newLen = generateIR(methodArgs[0], currentFunction);
+  if (!newLen->getType()->isIntegerTy(32))
+    newLen = Builder.CreateIntCast(newLen, i32, true, "arraysize");
+  if (info.packed)
+    Builder.CreateCall(getArrayFunction("cookie_bits_resize", Type::getVoidTy(Context), {i32}), {storage, newLen});
+  else
+    Builder.CreateCall(getArrayFunction("cookie_array_resize", Type::getVoidTy(Context), {Type::getInt64Ty(Context), i32}),
+                       {storage, getElementSize(info.elemType), newLen});
+  return newLen;
+}
+
+// Helper: count(arr), any(arr) and all(arr) on a bool array, a word at a time.
+// count adds up llvm.ctpop of each word; any and all stop at the first word
+// that decides the answer. Bits past the length are zero in every word.
+static Value* generateBoolReduction(const std::string &name, ArrayRef<ASTNode*> args, Function *currentFunction) {
+  const ArrayInfo *info = nullptr;
+  Value *storage = args.size() == 1 ? lookupArrayOperand(args[0], info, currentFunction) : nullptr;
+  if (!storage || !info->packed)
+    report_fatal_error(Twine(name) + "() takes one bool array");
+  Type *i64 = Type::getInt64Ty(Context);
+  Value *len = Builder.CreateZExt(emitArrayLength(storage, *info), i64, "bits");
+  Value *words = Builder.CreateLShr(Builder.CreateAdd(len, ConstantInt::get(i64, 63)), 6, "words");
+  BasicBlock *preBB = Builder.GetInsertBlock();
+  BasicBlock *condBB = BasicBlock::Create(Context, name + ".cond", currentFunction);
+  BasicBlock *bodyBB = BasicBlock::Create(Context, name + ".body", currentFunction);
+  BasicBlock *afterBB = BasicBlock::Create(Context, name + ".after", currentFunction);
+  // all(): every word but the last must be all ones; the last only up to len.
+  Value *lastWord = nullptr, *lastMask = nullptr;
+  if (name == "all") {
+    lastWord = Builder.CreateSub(words, ConstantInt::get(i64, 1), "last_word");
+    Value *tailBits = Builder.CreateAnd(len, ConstantInt::get(i64, 63), "tail_bits");
+    Value *tailMask = Builder.CreateSub(Builder.CreateShl(ConstantInt::get(i64, 1), tailBits), ConstantInt::get(i64, 1));
+    Value *wholeWord = Builder.CreateICmpEQ(tailBits, ConstantInt::get(i64, 0));
+    lastMask = Builder.CreateSelect(wholeWord, ConstantInt::getAllOnesValue(i64), tailMask, "last_mask");
+  }
+  Builder.CreateBr(condBB);
+
+  Builder.SetInsertPoint(condBB);
+  PHINode *w = Builder.CreatePHI(i64, 2, "word_index");
+  w->addIncoming(ConstantInt::get(i64, 0), preBB);
+  PHINode *acc = nullptr;
+  if (name == "count") {
+    acc = Builder.CreatePHI(i64, 2, "count_acc");
+    acc->addIncoming(ConstantInt::get(i64, 0), preBB);
+  }
+  Builder.CreateCondBr(Builder.CreateICmpULT(w, words), bodyBB, afterBB);
+
+  Builder.SetInsertPoint(bodyBB);
+  Value *word = Builder.CreateLoad(i64, emitArraySlotPtr(storage, *info, w), "word");
+  Value *next = Builder.CreateAdd(w, ConstantInt::get(i64, 1), "next_word");
+  w->addIncoming(next, Builder.GetInsertBlock());
+  if (name == "count") {
+    Value *sum = Builder.CreateAdd(acc, Builder.CreateUnaryIntrinsic(Intrinsic::ctpop, word), "count_sum");
+    acc->addIncoming(sum, Builder.GetInsertBlock());
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(afterBB);
+    return Builder.CreateTrunc(acc, Type::getInt32Ty(Context), "count");
+  }
+  Value *decides;
+  if (name == "any") {
+    decides = Builder.CreateICmpNE(word, ConstantInt::get(i64, 0), "word_any");
+  } else {
+    Value *expected = Builder.CreateSelect(Builder.CreateICmpEQ(w, lastWord), lastMask,
+                                           ConstantInt::getAllOnesValue(i64), "expected");
+    decides = Builder.CreateICmpNE(word, expected, "word_not_all");
+  }
+  BasicBlock *decideBB = Builder.GetInsertBlock();
+  Builder.CreateCondBr(decides, afterBB, condBB);
+  Builder.SetInsertPoint(afterBB);
+  PHINode *result = Builder.CreatePHI(Type::getInt1Ty(Context), 2, name);
+  result->addIncoming(Builder.getInt1(name == "all"), condBB);
+  result->addIncoming(Builder.getInt1(name == "any"), decideBB);
+  return result;
+}
+
+// --- Whole-array arithmetic ---
+// `c = a + b * 2;` with c an int or float array runs +, -, *, / and unary -
+// element-wise over same-length arrays, with scalar operands applied to every
+// element. The whole expression becomes one loop over explicit <8 x T>
+// vectors followed by a scalar loop for the remaining elements. Scalar
+// operands, array data pointers and lengths are computed once, before the loop.
+static const unsigned ArrayVectorWidth = 8;
+
+// One operand of an element-wise expression, prepared before the loop.
+struct ElementwiseLeaf {
+  Value *data = nullptr;    // array: pointer to its first element
+  Type *elemType = nullptr; // array: its element type
+  Value *scalar = nullptr;  // scalar: the value, converted to the computation type
+  Value *splat = nullptr;   // scalar: the value in every vector lane
+};
+
+// Helper: True if the subtree has an array operand at an arithmetic position.
+static bool isElementwise(ASTNode *node) {
+  const ArrayInfo *info;
+  switch (node->kind) {
+  case NODE_IDENTIFIER:
+    return lookupArrayVar(node, info) != nullptr;
+  case NODE_ADD: case NODE_SUB: case NODE_MUL: case NODE_DIV:
+    return isElementwise(node->left) || isElementwise(node->right);
+  case NODE_NEG:
+    return isElementwise(node->left);
+  default:
+    return false;
+  }
+}
+
+// Helper: Evaluate the scalar operands and find the arrays of an element-wise
+// expression. Array lengths are checked against `len`. Returns true if the
+// computation has to be done in float.
+static bool prepareElementwise(ASTNode *node, Value *len, std::map<ASTNode*, ElementwiseLeaf> &leaves,
+                               Function *currentFunction) {
+  if (isElementwise(node) && node->kind != NODE_IDENTIFIER) {
+    bool isFloat = prepareElementwise(node->left, len, leaves, currentFunction);
+    if (node->kind != NODE_NEG)
+      isFloat |= prepareElementwise(node->right, len, leaves, currentFunction);
+    return isFloat;
+  }
+  ElementwiseLeaf &leaf = leaves[node];
+  const ArrayInfo *info;
+  if (Value *storage = lookupArrayVar(node, info)) {
+    if (info->packed || !(info->elemType->isIntegerTy(32) || info->elemType->isFloatTy()))
+      report_fatal_error(Twine("Whole-array arithmetic needs int or float arrays, not '") + node->value + "'");
+    Value *opLen = emitArrayLength(storage, *info);
+    ConstantInt *constLen = dyn_cast<ConstantInt>(len), *constOpLen = dyn_cast<ConstantInt>(opLen);
+    if (constLen && constOpLen) {
+      if (constLen->getZExtValue() != constOpLen->getZExtValue())
+        report_fatal_error(Twine("Whole-array arithmetic: '") + node->value + "' has a different length");
+    } else {
+      Type *i32 = Type::getInt32Ty(Context);
+      Builder.CreateCall(getRuntimeFunction("cookie_array_check_length", Type::getVoidTy(Context), {i32, i32}),
+                         {len, opLen});
+    }
+    leaf.data = emitArrayData(storage, *info);
+    leaf.elemType = info->elemType;
+    return info->elemType->isFloatTy();
+  }
+  leaf.scalar = generateIR(node, currentFunction);
+  if (!leaf.scalar->getType()->isIntegerTy() && !leaf.scalar->getType()->isFloatTy())
+    report_fatal_error("Whole-array arithmetic: operands must be numbers or arrays");
+  return leaf.scalar->getType()->isFloatTy();
+}
+
+// Helper: Convert an int or float value (or vector) to the computation type.
+static Value* emitNumericCast(Value *val, Type *calcType) {
+  Type *scalarTy = val->getType()->getScalarType();
+  Type *calcScalar = calcType->getScalarType();
+  if (scalarTy == calcScalar)
+    return val;
+  if (calcScalar->isFloatTy())
+    return Builder.CreateSIToFP(val, calcType, "intToFloat");
+  if (scalarTy->isFloatTy())
+    return Builder.CreateFPToSI(val, calcType, "floatToInt");
+  return Builder.CreateIntCast(val, calcType, scalarTy->getIntegerBitWidth() > 8, "intcast");
+}
+
+// Helper: The value of an element-wise expression at `index`, either one
+// element (width 1) or `width` consecutive elements as a vector.
+static Value* emitElementwise(ASTNode *node, std::map<ASTNode*, ElementwiseLeaf> &leaves, Value *index,
+                              unsigned width, Type *calcScalar) {
+  Type *calcType = width == 1 ? calcScalar : FixedVectorType::get(calcScalar, width);
+  auto leafIt = leaves.find(node);
+  if (leafIt != leaves.end()) {
+    ElementwiseLeaf &leaf = leafIt->second;
+    if (!leaf.data)
+      return width == 1 ? leaf.scalar : leaf.splat;
+    Value *elemPtr = Builder.CreateInBoundsGEP(leaf.elemType, leaf.data, index, "elem_ptr");
+    Value *val;
+    if (width == 1) {
+      val = Builder.CreateLoad(leaf.elemType, elemPtr, "elem");
+    } else {
+      Type *vecType = FixedVectorType::get(leaf.elemType, width);
+      Value *vecPtr = Builder.CreateBitCast(elemPtr, PointerType::get(vecType, 0), "vec_ptr");
+      val = Builder.CreateAlignedLoad(vecType, vecPtr, Align(4), "vec");
+    }
+    return emitNumericCast(val, calcType);
+  }
+  Value *L = emitElementwise(node->left, leaves, index, width, calcScalar);
+  bool isFloat = calcScalar->isFloatTy();
+  if (node->kind == NODE_NEG)
+    return isFloat ? Builder.CreateFNeg(L, "fnegtmp") : Builder.CreateNeg(L, "negtmp");
+  Value *R = emitElementwise(node->right, leaves, index, width, calcScalar);
+  switch (node->kind) {
+  case NODE_ADD: return isFloat ? Builder.CreateFAdd(L, R, "faddtmp") : Builder.CreateAdd(L, R, "addtmp");
+  case NODE_SUB: return isFloat ? Builder.CreateFSub(L, R, "fsubtmp") : Builder.CreateSub(L, R, "subtmp");
+  case NODE_MUL: return isFloat ? Builder.CreateFMul(L, R, "fmultmp") : Builder.CreateMul(L, R, "multmp");
+  default:       return isFloat ? Builder.CreateFDiv(L, R, "fdivtmp") : Builder.CreateSDiv(L, R, "divtmp");
+  }
+}
+
+// Helper: Mark a loop latch so the loop vectorizer leaves the loop alone.
+static void markLoopVectorized(Instruction *latch) {
+  Metadata *flag[] = {MDString::get(Context, "llvm.loop.isvectorized"),
+                      ConstantAsMetadata::get(Builder.getInt32(1))};
+  Metadata *ops[] = {nullptr, MDNode::get(Context, flag)};
+  MDNode *loopID = MDNode::getDistinct(Context, ops);
+  loopID->replaceOperandWith(0, loopID);
+  latch->setMetadata(LLVMContext::MD_loop, loopID);
+}
+
+// Helper: One counted loop from `start` to `end` (exclusive) in steps of
+// `width`, storing the expression into the target at each step.
+static void emitElementwiseLoop(ASTNode *expr, std::map<ASTNode*, ElementwiseLeaf> &leaves, Value *targetData,
+                                Type *targetElem, Value *start, Value *end, unsigned width, Type *calcScalar,
+                                Function *currentFunction) {
+  Type *i64 = Type::getInt64Ty(Context);
+  const char *tag = width == 1 ? "elementwise.tail" : "elementwise.vec";
+  BasicBlock *preBB = Builder.GetInsertBlock();
+  BasicBlock *condBB = BasicBlock::Create(Context, Twine(tag) + ".cond", currentFunction);
+  BasicBlock *bodyBB = BasicBlock::Create(Context, Twine(tag) + ".body", currentFunction);
+  BasicBlock *afterBB = BasicBlock::Create(Context, Twine(tag) + ".after", currentFunction);
+  Builder.CreateBr(condBB);
+  Builder.SetInsertPoint(condBB);
+  PHINode *index = Builder.CreatePHI(i64, 2, "elem_index");
+  index->addIncoming(start, preBB);
+  Builder.CreateCondBr(Builder.CreateICmpULT(index, end), bodyBB, afterBB);
+
+  Builder.SetInsertPoint(bodyBB);
+  Value *val = emitElementwise(expr, leaves, index, width, calcScalar);
+  Value *elemPtr = Builder.CreateInBoundsGEP(targetElem, targetData, index, "target_ptr");
+  if (width == 1) {
+    Builder.CreateStore(emitNumericCast(val, targetElem), elemPtr);
+  } else {
+    Type *vecType = FixedVectorType::get(targetElem, width);
+    Value *vecPtr = Builder.CreateBitCast(elemPtr, PointerType::get(vecType, 0), "target_vec_ptr");
+    Builder.CreateAlignedStore(emitNumericCast(val, vecType), vecPtr, Align(4));
+  }
+  Value *next = Builder.CreateAdd(index, ConstantInt::get(i64, width), "next_index");
+  index->addIncoming(next, Builder.GetInsertBlock());
+  markLoopVectorized(Builder.CreateBr(condBB));
+  Builder.SetInsertPoint(afterBB);
+}
+
+// Helper: Assign an element-wise expression to every element of an array.
+// Each element is computed from the operands' elements at the same index, so
+// the target may also appear in the expression. An operand that is another
+// view of the target's array at a different offset (`s = a * 2;` with s a
+// slice of a) would read elements already written, so when the ranges overlap
+// the result goes into a temporary that is copied over the target.
+static Value* generateArrayAssign(Value *storage, const ArrayInfo &info, ASTNode *expr, Function *currentFunction) {
+  if (info.packed || !(info.elemType->isIntegerTy(32) || info.elemType->isFloatTy()))
+    report_fatal_error("Whole-array assignment needs an int or float array");
+  Type *i64 = Type::getInt64Ty(Context);
+  Value *len = emitArrayLength(storage, info);
+  std::map<ASTNode*, ElementwiseLeaf> leaves;
+  bool isFloat = prepareElementwise(expr, len, leaves, currentFunction);
+  Type *calcScalar = isFloat ? Type::getFloatTy(Context) : Type::getInt32Ty(Context);
+  for (auto &entry : leaves) {
+    ElementwiseLeaf &leaf = entry.second;
+    if (leaf.data)
+      continue;
+    leaf.scalar = emitNumericCast(leaf.scalar, calcScalar);
+    leaf.splat = Builder.CreateVectorSplat(ArrayVectorWidth, leaf.scalar, "splat");
+  }
+  Value *targetData = emitArrayData(storage, info);
+  Value *end = Builder.CreateZExt(len, i64, "elem_count");
+  uint64_t elemSize = TheModule->getDataLayout().getTypeAllocSize(info.elemType);
+  Value *bytes = Builder.CreateMul(end, ConstantInt::get(i64, elemSize), "elem_bytes");
+  Value *targetBegin = Builder.CreatePtrToInt(targetData, i64, "target_begin");
+  Value *targetEnd = Builder.CreateAdd(targetBegin, bytes, "target_end");
+  Value *overlap = nullptr;
+  for (auto &entry : leaves) {
+    ElementwiseLeaf &leaf = entry.second;
+    const ArrayInfo *leafInfo;
+    if (!leaf.data || lookupArrayVar(entry.first, leafInfo) == storage)
+      continue;
+    Value *begin = Builder.CreatePtrToInt(leaf.data, i64, "operand_begin");
+    Value *shifted = Builder.CreateAnd(Builder.CreateICmpNE(begin, targetBegin),
+                                       Builder.CreateAnd(Builder.CreateICmpULT(begin, targetEnd),
+                                                         Builder.CreateICmpULT(targetBegin,
+                                                                               Builder.CreateAdd(begin, bytes))),
+                                       "operand_overlaps");
+    overlap = overlap ? Builder.CreateOr(overlap, shifted, "overlaps") : shifted;
+  }
+  Value *dest = targetData;
+  if (overlap) {
+    BasicBlock *preBB = Builder.GetInsertBlock();
+    BasicBlock *tempBB = BasicBlock::Create(Context, "elementwise.temp", currentFunction);
+    BasicBlock *startBB = BasicBlock::Create(Context, "elementwise.start", currentFunction);
+    Builder.CreateCondBr(overlap, tempBB, startBB);
+    Builder.SetInsertPoint(tempBB);
+    Value *temp = Builder.CreateCall(getRuntimeFunction("cookie_array_temp", getStringType(), {i64}), {bytes}, "temp");
+    temp = Builder.CreateBitCast(temp, targetData->getType());
+    Builder.CreateBr(startBB);
+    Builder.SetInsertPoint(startBB);
+    PHINode *destPhi = Builder.CreatePHI(targetData->getType(), 2, "dest");
+    destPhi->addIncoming(targetData, preBB);
+    destPhi->addIncoming(temp, tempBB);
+    dest = destPhi;
+  }
+  Value *vecEnd = Builder.CreateAnd(end, ConstantInt::get(i64, ~(uint64_t)(ArrayVectorWidth - 1)), "vec_end");
+  emitElementwiseLoop(expr, leaves, dest, info.elemType, ConstantInt::get(i64, 0), vecEnd,
+                      ArrayVectorWidth, calcScalar, currentFunction);
+  emitElementwiseLoop(expr, leaves, dest, info.elemType, vecEnd, end, 1, calcScalar, currentFunction);
+  if (overlap) {
+    BasicBlock *copyBB = BasicBlock::Create(Context, "elementwise.copy", currentFunction);
+    BasicBlock *doneBB = BasicBlock::Create(Context, "elementwise.done", currentFunction);
+    Builder.CreateCondBr(overlap, copyBB, doneBB);
+    Builder.SetInsertPoint(copyBB);
+    Builder.CreateMemCpy(targetData, Align(4), dest, Align(4), bytes);
+    Builder.CreateCall(getRuntimeFunction("free", Type::getVoidTy(Context), {getStringType()}),
+                       {Builder.CreateBitCast(dest, getStringType())});
+    Builder.CreateBr(doneBB);
+    Builder.SetInsertPoint(doneBB);
+  }
+  return len;
+}
+
+// --- Reductions ---
+// sum(arr), min(arr), max(arr) and dot(a, b) over int or float arrays. The
+// main loop keeps ReductionAccumulators independent <8 x T> accumulators so
+// consecutive iterations do not wait on each other, and stops short of the
+// last partial block. The accumulators are then combined pairwise, and their
+// lanes by halving, into one value that a scalar loop finishes. Float sums
+// are therefore added in a tree rather than left to right.
+static const unsigned ReductionAccumulators = 4;
+
+// Helper: Combine two partial results (scalars or vectors) of a reduction.
+static Value* emitReduceStep(const std::string &name, Value *L, Value *R) {
+  bool isFloat = L->getType()->getScalarType()->isFloatTy();
+  if (name == "min")
+    return Builder.CreateBinaryIntrinsic(isFloat ? Intrinsic::minnum : Intrinsic::smin, L, R, nullptr, "min");
+  if (name == "max")
+    return Builder.CreateBinaryIntrinsic(isFloat ? Intrinsic::maxnum : Intrinsic::smax, L, R, nullptr, "max");
+  return isFloat ? Builder.CreateFAdd(L, R, "fsum") : Builder.CreateAdd(L, R, "sum");
+}
+
+// Helper: Fold the step for one element position into an accumulator; dot
+// multiplies the two arrays' values first.
+static Value* emitReduceElement(const std::string &name, Value *acc, Value *a, Value *b) {
+  if (name != "dot")
+    return emitReduceStep(name, acc, a);
+  if (a->getType()->getScalarType()->isFloatTy())
+    return Builder.CreateIntrinsic(Intrinsic::fmuladd, {a->getType()}, {a, b, acc}, nullptr, "dot");
+  return Builder.CreateAdd(acc, Builder.CreateMul(a, b), "dot");
+}
+
+// Helper: Reduce the lanes of a vector by repeatedly combining its two halves.
+static Value* emitHorizontalReduce(const std::string &name, Value *vec) {
+  unsigned lanes = cast<FixedVectorType>(vec->getType())->getNumElements();
+  while (lanes > 1) {
+    lanes /= 2;
+    SmallVector<int, 8> low, high;
+    for (unsigned i = 0; i < lanes; i++) {
+      low.push_back(i);
+      high.push_back(i + lanes);
+    }
+    vec = emitReduceStep(name, Builder.CreateShuffleVector(vec, low), Builder.CreateShuffleVector(vec, high));
+  }
+  return Builder.CreateExtractElement(vec, (uint64_t)0, "reduced");
+}
+
+static Value* generateArrayReduction(const std::string &name, ArrayRef<ASTNode*> args, Function *currentFunction) {
+  unsigned arity = name == "dot" ? 2 : 1;
+  if (args.size() != arity)
+    report_fatal_error(Twine(name) + "() takes " + (arity == 2 ? "two arrays" : "one array"));
+  Type *i32 = Type::getInt32Ty(Context), *i64 = Type::getInt64Ty(Context);
+  Value *storage[2], *data[2];
+  Type *elemTypes[2];
+  Value *len = nullptr;
+  bool isFloat = false;
+  for (unsigned k = 0; k < arity; k++) {
+    const ArrayInfo *info;
+    storage[k] = lookupArrayOperand(args[k], info, currentFunction);
+    if (!storage[k] || info->packed || !(info->elemType->isIntegerTy(32) || info->elemType->isFloatTy()))
+      report_fatal_error(Twine(name) + "() needs int or float arrays");
+    Value *opLen = emitArrayLength(storage[k], *info);
+    if (len)
+      Builder.CreateCall(getRuntimeFunction("cookie_array_check_length", Type::getVoidTy(Context), {i32, i32}),
+                         {len, opLen});
+    else
+      len = opLen;
+    data[k] = emitArrayData(storage[k], *info);
+    elemTypes[k] = info->elemType;
+    isFloat |= info->elemType->isFloatTy();
+  }
+  if (name == "min" || name == "max")
+    Builder.CreateCall(getRuntimeFunction("cookie_array_check_nonempty", Type::getVoidTy(Context),
+                                          {i32, getStringType()}),
+                       {len, getStringConstant(name)});
+  Type *calcScalar = isFloat ? Type::getFloatTy(Context) : i32;
+  Constant *identity;
+  if (name == "min")
+    identity = isFloat ? ConstantFP::getInfinity(calcScalar) : ConstantInt::get(i32, INT32_MAX);
+  else if (name == "max")
+    identity = isFloat ? ConstantFP::getInfinity(calcScalar, true) : ConstantInt::get(i32, INT32_MIN);
+  else
+    identity = Constant::getNullValue(calcScalar);
+
+  unsigned width = ArrayVectorWidth, step = ArrayVectorWidth * ReductionAccumulators;
+  Type *vecType = FixedVectorType::get(calcScalar, width);
+  Value *end = Builder.CreateZExt(len, i64, "elem_count");
+  Value *vecEnd = Builder.CreateAnd(end, ConstantInt::get(i64, ~(uint64_t)(step - 1)), "vec_end");
+  // Loads element(s) `index` of operand k, as the computation type.
+  auto loadOperand = [&](unsigned k, Value *index, bool vector) -> Value* {
+    Value *ptr = Builder.CreateInBoundsGEP(elemTypes[k], data[k], index, "elem_ptr");
+    if (!vector)
+      return emitNumericCast(Builder.CreateLoad(elemTypes[k], ptr, "elem"), calcScalar);
+    Type *loadType = FixedVectorType::get(elemTypes[k], width);
+    ptr = Builder.CreateBitCast(ptr, PointerType::get(loadType, 0), "vec_ptr");
+    return emitNumericCast(Builder.CreateAlignedLoad(loadType, ptr, Align(4), "vec"), vecType);
+  };
+
+  // Vector loop.
+  BasicBlock *preBB = Builder.GetInsertBlock();
+  BasicBlock *condBB = BasicBlock::Create(Context, name + ".vec.cond", currentFunction);
+  BasicBlock *bodyBB = BasicBlock::Create(Context, name + ".vec.body", currentFunction);
+  BasicBlock *afterBB = BasicBlock::Create(Context, name + ".vec.after", currentFunction);
+  Builder.CreateBr(condBB);
+  Builder.SetInsertPoint(condBB);
+  PHINode *index = Builder.CreatePHI(i64, 2, "elem_index");
+  index->addIncoming(ConstantInt::get(i64, 0), preBB);
+  PHINode *accs[ReductionAccumulators];
+  for (unsigned u = 0; u < ReductionAccumulators; u++) {
+    accs[u] = Builder.CreatePHI(vecType, 2, "acc");
+    accs[u]->addIncoming(ConstantVector::getSplat(ElementCount::getFixed(width), identity), preBB);
+  }
+  Builder.CreateCondBr(Builder.CreateICmpULT(index, vecEnd), bodyBB, afterBB);
+  Builder.SetInsertPoint(bodyBB);
+  Value *nextAccs[ReductionAccumulators];
+  for (unsigned u = 0; u < ReductionAccumulators; u++) {
+    Value *at = Builder.CreateAdd(index, ConstantInt::get(i64, u * width));
+    Value *a = loadOperand(0, at, true);
+    Value *b = arity == 2 ? loadOperand(1, at, true) : nullptr;
+    nextAccs[u] = emitReduceElement(name, accs[u], a, b);
+  }
+  Value *next = Builder.CreateAdd(index, ConstantInt::get(i64, step), "next_index");
+  index->addIncoming(next, Builder.GetInsertBlock());
+  for (unsigned u = 0; u < ReductionAccumulators; u++)
+    accs[u]->addIncoming(nextAccs[u], Builder.GetInsertBlock());
+  markLoopVectorized(Builder.CreateBr(condBB));
+
+  // Combine the accumulators, then the lanes.
+  Builder.SetInsertPoint(afterBB);
+  std::vector<Value*> partials(accs, accs + ReductionAccumulators);
+  while (partials.size() > 1) {
+    std::vector<Value*> combined;
+    for (size_t i = 0; i < partials.size(); i += 2)
+      combined.push_back(emitReduceStep(name, partials[i], partials[i + 1]));
+    partials.swap(combined);
+  }
+  Value *vecResult = emitHorizontalReduce(name, partials[0]);
+
+  // Scalar loop for the last partial block.
+  BasicBlock *tailPreBB = Builder.GetInsertBlock();
+  BasicBlock *tailCondBB = BasicBlock::Create(Context, name + ".tail.cond", currentFunction);
+  BasicBlock *tailBodyBB = BasicBlock::Create(Context, name + ".tail.body", currentFunction);
+  BasicBlock *tailAfterBB = BasicBlock::Create(Context, name + ".tail.after", currentFunction);
+  Builder.CreateBr(tailCondBB);
+  Builder.SetInsertPoint(tailCondBB);
+  PHINode *tailIndex = Builder.CreatePHI(i64, 2, "elem_index");
+  tailIndex->addIncoming(vecEnd, tailPreBB);
+  PHINode *result = Builder.CreatePHI(calcScalar, 2, name);
+  result->addIncoming(vecResult, tailPreBB);
+  Builder.CreateCondBr(Builder.CreateICmpULT(tailIndex, end), tailBodyBB, tailAfterBB);
+  Builder.SetInsertPoint(tailBodyBB);
+  Value *a = loadOperand(0, tailIndex, false);
+  Value *b = arity == 2 ? loadOperand(1, tailIndex, false) : nullptr;
+  Value *tailNext = emitReduceElement(name, result, a, b);
+  tailIndex->addIncoming(Builder.CreateAdd(tailIndex, ConstantInt::get(i64, 1), "next_index"), Builder.GetInsertBlock());
+  result->addIncoming(tailNext, Builder.GetInsertBlock());
+  markLoopVectorized(Builder.CreateBr(tailCondBB));
+  Builder.SetInsertPoint(tailAfterBB);
+  return result;
+}
+
+// --- Sorting ---
+// sort(arr) and sort(arr, desc) sort in place through the runtime routine for
+// the element type. The order is any bool expression; the bare words desc and
+// asc also work when no variable has that name. Returns the length.
+static Value* generateSort(ArrayRef<ASTNode*> args, Function *currentFunction) {
+  if (args.empty() || args.size() > 2)
+    report_fatal_error("sort() takes an array and an optional order");
+  const ArrayInfo *info;
+  Value *storage = lookupArrayOperand(args[0], info, currentFunction);
+  if (!storage)
+    report_fatal_error("sort() needs an array");
+  if (lookupRecord(info->elemType))
+    report_fatal_error("sort() cannot order records");
+  Type *i32 = Type::getInt32Ty(Context);
+  Value *desc = ConstantInt::get(i32, 0);
+  if (args.size() == 2) {
+    ASTNode *order = args[1];
+    if (order->kind == NODE_IDENTIFIER && !NamedValues.count(order->value) &&
+        (strcmp(order->value, "desc") == 0 || strcmp(order->value, "asc") == 0)) {
+      desc = ConstantInt::get(i32, strcmp(order->value, "desc") == 0);
+    } else {
+      desc = generateIR(order, currentFunction);
+      if (desc->getType()->isFloatTy())
+        desc = Builder.CreateFCmpONE(desc, ConstantFP::get(desc->getType(), 0.0), "desc");
+      else if (!desc->getType()->isIntegerTy())
+        report_fatal_error("sort(): the order must be a bool");
+      desc = Builder.CreateICmpNE(desc, ConstantInt::get(desc->getType(), 0), "desc");
+      desc = Builder.CreateZExt(desc, i32);
+    }
+  }
+  Function *sortFn = getSortFunction(info->elemType);
+  Value *len = emitArrayLength(storage, *info);
+  Value *data = emitArrayData(storage, *info);
+  data = Builder.CreateBitCast(data, sortFn->getFunctionType()->getParamType(0), "sort_data");
+  Builder.CreateCall(sortFn, {data, len, desc});
+  return len;
+}
+
+// --- Maps ---
+// A map variable is an entry-block slot holding the runtime's CookieMap*.
+// Int and char keys are passed to the runtime as i64, str keys as is. The
+// runtime returns a pointer to the key's 8-byte value, which is loaded and
+// stored here at the map's value type.
+struct MapInfo {
+  Type *keyType;
+  Type *valueType;
+};
+static std::map<Value*, MapInfo> MapVars;
+// Maps declared in the function being generated.
+static std::vector<Value*> FunctionOwnedMaps;
+
+static PointerType* getMapPtrType() {
+  static StructType *MapType = nullptr;
+  if (!MapType)
+    MapType = StructType::create(Context, "cookie.map");
+  return PointerType::get(MapType, 0);
+}
+
+static const MapInfo* lookupMap(Value *slot) {
+  auto it = MapVars.find(slot);
+  return it == MapVars.end() ? nullptr : &it->second;
+}
+
+// Helper: The slot of the map named by an identifier node, or null.
+static Value* lookupMapVar(ASTNode *node, const MapInfo *&info) {
+  info = nullptr;
+  if (!node || node->kind != NODE_IDENTIFIER)
+    return nullptr;
+  auto it = NamedValues.find(node->value);
+  if (it == NamedValues.end() || !(info = lookupMap(it->second)))
+    return nullptr;
+  return it->second;
+}
+
+static Value* declareMap(const std::string &name, Type *keyType, Type *valueType, Function *currentFunction) {
+  if (!keyType->isIntegerTy(32) && !keyType->isIntegerTy(8) && keyType != getStringType())
+    report_fatal_error(Twine("map '") + name + "': keys must be int, char or str");
+  PointerType *mapPtrType = getMapPtrType();
+  Type *i32 = Type::getInt32Ty(Context);
+  // Slot starts null; declaring the map again (in a loop) clears the table.
+  AllocaInst *slot = CreateEntryBlockAlloca(currentFunction, name, mapPtrType);
+  IRBuilder<> TmpB(slot->getParent(), std::next(slot->getIterator()));
+  TmpB.CreateStore(Constant::getNullValue(mapPtrType), slot);
+  FunctionOwnedMaps.push_back(slot);
+  Value *old = Builder.CreateLoad(mapPtrType, slot, "map_old");
+  Value *map = Builder.CreateCall(getRuntimeFunction("cookie_map_init", mapPtrType, {mapPtrType, i32}),
+                                  {old, ConstantInt::get(i32, keyType->isPointerTy())}, "map");
+  Builder.CreateStore(map, slot);
+  MapVars[slot] = {keyType, valueType};
+  NamedValues[name] = slot;
+  return slot;
+}
+
+// Helper: Free the maps of the function just generated before each of its returns.
+static void emitMapCleanup(Function *fn) {
+  for (BasicBlock &BB : *fn) {
+    ReturnInst *ret = dyn_cast_or_null<ReturnInst>(BB.getTerminator());
+    if (!ret)
+      continue;
+    IRBuilder<> TmpB(ret);
+    for (Value *slot : FunctionOwnedMaps)
+      TmpB.CreateCall(getRuntimeFunction("cookie_map_free", Type::getVoidTy(Context), {getMapPtrType()}),
+                      {TmpB.CreateLoad(getMapPtrType(), slot, "map")});
+  }
+  FunctionOwnedMaps.clear();
+}
+
+// Helper: Evaluate a key and convert it to what the runtime takes.
+static Value* emitMapKey(const MapInfo &info, ASTNode *keyNode, Function *currentFunction) {
+  Value *key = generateIR(keyNode, currentFunction);
+  if (info.keyType->isPointerTy()) {
+    if (key->getType() != getStringType())
+      report_fatal_error("map key must be a str");
+    return key;
+  }
+  if (!key->getType()->isIntegerTy() || key->getType()->isIntegerTy(1))
+    report_fatal_error("map key must be an int or char");
+  key = Builder.CreateIntCast(key, info.keyType, true);
+  return Builder.CreateSExt(key, Type::getInt64Ty(Context), "map_key");
+}
+
+// Helper: Call cookie_map_<op>_int or cookie_map_<op>_str with a converted key.
+static Value* emitMapCall(const char *op, Value *slot, const MapInfo &info, Value *key, Type *retType) {
+  bool strKeys = info.keyType->isPointerTy();
+  std::string name = std::string("cookie_map_") + op + (strKeys ? "_str" : "_int");
+  Type *keyArg = strKeys ? getStringType() : Type::getInt64Ty(Context);
+  Value *map = Builder.CreateLoad(getMapPtrType(), slot, "map");
+  return Builder.CreateCall(getRuntimeFunction(name.c_str(), retType, {getMapPtrType(), keyArg}), {map, key});
+}
+
+// Helper: Methods on a map variable: get(k), set(k, v), has(k) and remove(k).
+// get on a missing key reads a zero word, giving 0, 0.0, false, '\0' or "".
+static Value* generateMapMethod(ASTNode *node, Value *slot, const MapInfo &info, Function *currentFunction) {
+  std::string methodName = node->value;
+  ArrayRef<ASTNode*> args = listItems(node->right);
+  unsigned arity = methodName == "set" ? 2 : 1;
+  if (args.size() != arity)
+    report_fatal_error(Twine("map ") + methodName + "() takes " + (arity == 2 ? "a key and a value" : "a key"));
+  Type *voidPtr = getStringType();
+  Value *key = emitMapKey(info, args[0], currentFunction);
+  if (methodName == "set") {
+    Value *val = emitElementCast(generateIR(args[1], currentFunction), info.valueType);
+    Value *valuePtr = emitMapCall("put", slot, info, key, voidPtr);
+    Builder.CreateStore(val, Builder.CreateBitCast(valuePtr, PointerType::get(info.valueType, 0)));
+    return val;
+  }
+  if (methodName == "get") {
+    Value *valuePtr = emitMapCall("find", slot, info, key, voidPtr);
+    GlobalVariable *zero = TheModule->getGlobalVariable("cookie.map.zero", true);
+    if (!zero)
+      zero = new GlobalVariable(*TheModule, Type::getInt64Ty(Context), true, GlobalValue::InternalLinkage,
+                                ConstantInt::get(Type::getInt64Ty(Context), 0), "cookie.map.zero");
+    Value *missing = Builder.CreateIsNull(valuePtr, "missing");
+    valuePtr = Builder.CreateSelect(missing, Builder.CreateBitCast(zero, voidPtr), valuePtr);
+    valuePtr = Builder.CreateBitCast(valuePtr, PointerType::get(info.valueType, 0));
+    Value *val = Builder.CreateLoad(info.valueType, valuePtr, "map_value");
+    if (info.valueType == getStringType())
+      val = Builder.CreateSelect(Builder.CreateIsNull(val), getStringConstant(""), val);
+    return val;
+  }
+  if (methodName == "has")
+    return Builder.CreateIsNotNull(emitMapCall("find", slot, info, key, voidPtr), "has");
+  if (methodName == "remove") {
+    Value *removed = emitMapCall("remove", slot, info, key, Type::getInt32Ty(Context));
+    return Builder.CreateICmpNE(removed, ConstantInt::get(Type::getInt32Ty(Context), 0), "removed");
+  }
+  report_fatal_error(Twine("Unknown map method '") + methodName + "'");
+}
+
+// --- Channels ---
+// A channel variable is an entry-block slot holding the runtime's CookieChan*.
+// ChanVars records what each slot carries, keyed by the slot, and ChanParams
+// the element type of each chan<T> parameter (null for other parameters), so
+// a chan<int> parameter only accepts a chan<int>. Values cross the runtime as
+// i64: ints and chars sign-extended, bools zero-extended, floats as their bits
+// and strs as the pointer.
+static const int DefaultChanCapacity = 64;
+static std::map<Value*, Type*> ChanVars;
+static std::map<Function*, std::vector<Type*>> ChanParams;
+// Channels declared in the function being generated.
+static std::vector<Value*> FunctionOwnedChans;
+
+// The CookieChan* a channel slot holds, whatever the element type.
+static PointerType* getChanRuntimeType() {
+  static StructType *ChanType = nullptr;
+  if (!ChanType)
+    ChanType = StructType::create(Context, "cookie.chan");
+  return PointerType::get(ChanType, 0);
+}
+
+// Helper: The element type of a channel parameter ("chan<int>"), or null.
+static Type* getParamChanElementType(ASTNode *paramNode) {
+  std::string typeStr = (paramNode->left && paramNode->left->value) ? paramNode->left->value : "int";
+  if (typeStr.compare(0, 5, "chan<") != 0 || typeStr.back() != '>')
+    return nullptr;
+  return getTypeFromName(typeStr.substr(5, typeStr.size() - 6));
+}
+
+// Helper: Record the channel parameters of func, one entry per parameter.
+static void recordChanParams(Function *func, ArrayRef<ASTNode*> paramNodes) {
+  std::vector<Type*> &elemTypes = ChanParams[func];
+  for (ASTNode *paramNode : paramNodes)
+    elemTypes.push_back(getParamChanElementType(paramNode));
+}
+
+// Helper: The element type of func's parameter idx if it is a channel, or null.
+static Type* getChanParamType(Function *func, unsigned idx) {
+  auto it = ChanParams.find(func);
+  return it == ChanParams.end() || idx >= it->second.size() ? nullptr : it->second[idx];
+}
+
+static Type* lookupChan(Value *slot) {
+  auto it = ChanVars.find(slot);
+  return it == ChanVars.end() ? nullptr : it->second;
+}
+
+// Helper: The slot of the channel named by an identifier node, or null.
+static Value* lookupChanVar(ASTNode *node, Type *&elemType) {
+  elemType = nullptr;
+  if (!node || node->kind != NODE_IDENTIFIER)
+    return nullptr;
+  auto it = NamedValues.find(node->value);
+  if (it == NamedValues.end() || !(elemType = lookupChan(it->second)))
+    return nullptr;
+  return it->second;
+}
+
+static Value* declareChan(const std::string &name, Type *elemType, ASTNode *capacityNode, Function *currentFunction) {
+  Type *i32 = Type::getInt32Ty(Context);
+  Value *capacity = ConstantInt::get(i32, DefaultChanCapacity);
+  if (capacityNode) {
+    capacity = generateIR(capacityNode, currentFunction);
+    if (!capacity->getType()->isIntegerTy(32))
+      report_fatal_error(Twine("channel '") + name + "': the capacity must be an int");
+  }
+  PointerType *chanType = getChanRuntimeType();
+  // Slot starts null; declaring the channel again (in a loop) replaces it.
+  AllocaInst *slot = CreateEntryBlockAlloca(currentFunction, name, chanType);
+  IRBuilder<> TmpB(slot->getParent(), std::next(slot->getIterator()));
+  TmpB.CreateStore(Constant::getNullValue(chanType), slot);
+  FunctionOwnedChans.push_back(slot);
+  Value *old = Builder.CreateLoad(chanType, slot, "chan_old");
+  Value *chan = Builder.CreateCall(getRuntimeFunction("cookie_chan_init", chanType, {chanType, i32}),
+                                   {old, capacity}, "chan");
+  Builder.CreateStore(chan, slot);
+  ChanVars[slot] = elemType;
+  NamedValues[name] = slot;
+  return slot;
+}
+
+// Helper: Release the channels of the function just generated before each of
+// its returns. A task still using one holds its own reference.
+static void emitChanCleanup(Function *fn) {
+  for (BasicBlock &BB : *fn) {
+    ReturnInst *ret = dyn_cast_or_null<ReturnInst>(BB.getTerminator());
+    if (!ret)
+      continue;
+    IRBuilder<> TmpB(ret);
+    for (Value *slot : FunctionOwnedChans) {
+      Value *chan = TmpB.CreateLoad(getChanRuntimeType(), slot, "chan");
+      TmpB.CreateCall(getRuntimeFunction("cookie_chan_release", Type::getVoidTy(Context), {getChanRuntimeType()}),
+                      {chan});
+    }
+  }
+  FunctionOwnedChans.clear();
+}
+
+// Helper: Call cookie_chan_<op> on the channel in slot.
+static Value* emitChanCall(const char *op, Value *slot, ArrayRef<Value*> extraArgs, Type *retType) {
+  Value *chan = Builder.CreateLoad(getChanRuntimeType(), slot, "chan");
+  std::vector<Type*> argTypes = {getChanRuntimeType()};
+  std::vector<Value*> args = {chan};
+  for (Value *arg : extraArgs) {
+    argTypes.push_back(arg->getType());
+    args.push_back(arg);
+  }
+  std::string name = std::string("cookie_chan_") + op;
+  return Builder.CreateCall(getRuntimeFunction(name.c_str(), retType, argTypes), args);
+}
+
+// Helper: A scalar as an i64 word: ints and chars sign-extended, bools
+// zero-extended, floats as their bits and strs as the pointer.
+static Value* emitValueWord(Value *val) {
+  Type *i64 = Type::getInt64Ty(Context);
+  Type *type = val->getType();
+  if (type->isPointerTy())
+    return Builder.CreatePtrToInt(val, i64);
+  if (type->isFloatTy())
+    return Builder.CreateZExt(Builder.CreateBitCast(val, Type::getInt32Ty(Context)), i64);
+  if (type->isIntegerTy(1))
+    return Builder.CreateZExt(val, i64);
+  return Builder.CreateSExt(val, i64);
+}
+
+// Helper: A received i64 as a value of the element type; a null str is "".
+static Value* emitChanValue(Value *word, Type *elemType) {
+  if (elemType == getStringType()) {
+    Value *str = Builder.CreateIntToPtr(word, elemType, "chan_str");
+    return Builder.CreateSelect(Builder.CreateIsNull(str), getStringConstant(""), str);
+  }
+  if (elemType->isFloatTy())
+    return Builder.CreateBitCast(Builder.CreateTrunc(word, Type::getInt32Ty(Context)), elemType, "chan_float");
+  return Builder.CreateTrunc(word, elemType, "chan_value");
+}
+
+// Helper: recv into a fresh entry-block word. Returns the runtime's i32
+// "got a value" flag; the value itself is left in word.
+static Value* emitChanRecv(Value *slot, AllocaInst *&word, Function *currentFunction) {
+  word = CreateEntryBlockAlloca(currentFunction, "chan_word", Type::getInt64Ty(Context));
+  return emitChanCall("recv", slot, {word}, Type::getInt32Ty(Context));
+}
+
+// Helper: Methods on a channel variable: send(v), recv() and close(). recv on
+// a closed, drained channel gives 0, 0.0, false, '\0' or "".
+static Value* generateChanMethod(ASTNode *node, Value *slot, Type *elemType, Function *currentFunction) {
+  std::string methodName = node->value;
+  ArrayRef<ASTNode*> args = listItems(node->right);
+  Type *i64 = Type::getInt64Ty(Context);
+  Type *voidType = Type::getVoidTy(Context);
+  if (methodName == "send") {
+    if (args.size() != 1)
+      report_fatal_error("channel send() takes one value");
+    Value *val = generateIR(args[0], currentFunction);
+    if (val->getType()->isPointerTy() != elemType->isPointerTy())
+      report_fatal_error("channel send(): the value does not match the channel's element type");
+    val = emitElementCast(val, elemType);
+    emitChanCall("send", slot, {emitValueWord(val)}, voidType);
+    return val;
+  }
+  if (!args.empty())
+    report_fatal_error(Twine("channel ") + methodName + "() takes no arguments");
+  if (methodName == "recv") {
+    AllocaInst *word;
+    emitChanRecv(slot, word, currentFunction);
+    return emitChanValue(Builder.CreateLoad(i64, word, "chan_word"), elemType);
+  }
+  if (methodName == "close") {
+    emitChanCall("close", slot, {}, voidType);
+    return ConstantInt::get(Type::getInt32Ty(Context), 0);
+  }
+  report_fatal_error(Twine("Unknown channel method '") + methodName + "'");
+}
+
 // --- New branch for INPUT_EXPR ---
 // This branch supports input statements with expressions (such as input(arr[4]);)
 // without changing any of the old lines.
 Value *generateInputExpr(ASTNode *node, Function* currentFunction) {
   // node->left is the expression (lvalue) for input
-  if (strcmp(node->left->type, "ARRAY_ACCESS") == 0) {
+  if (node->left->kind == NODE_ARRAY_ACCESS) {
          std::string varName = node->left->value;
          Value *varPtr = NamedValues[varName];
-         if (!varPtr)
+         const ArrayInfo *info = varPtr ? lookupArray(varPtr) : nullptr;
+         if (!info)
             report_fatal_error(Twine("Error: Undeclared array '") + varName + "'");
-         Value *indexVal = generateIR(node->left->left, currentFunction);
-         indexVal = Builder.CreateSub(indexVal, ConstantInt::get(Type::getInt32Ty(Context), 1), "arrayindex");
-         std::vector<Value*> indices;
-         indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-         indices.push_back(indexVal);
-         AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-         if (!AI)
-             report_fatal_error("Array variable is not an alloca!");
-         Value *elemPtr = Builder.CreateGEP(AI->getAllocatedType(), varPtr, indices, "arrayelem");
-         Type *elemType = AI->getAllocatedType()->getArrayElementType();
+         std::vector<Value*> indices = emitArrayIndices(node->left->left, currentFunction);
+         Type *elemType = info->elemType;
+         if (lookupRecord(elemType))
+            report_fatal_error("input() reads fields, not whole records");
          Value *inputVal = nullptr;
          if (elemType->isIntegerTy(32))
             inputVal = Builder.CreateCall(getReadIntFunction(), {}, "readInt");
@@ -219,15 +2008,26 @@ Value *generateInputExpr(ASTNode *node, Function* currentFunction) {
             inputVal = Builder.CreateCall(getReadStringFunction(), {}, "readStr");
          else
             inputVal = ConstantInt::get(Type::getInt32Ty(Context), 0);
-         Builder.CreateStore(inputVal, elemPtr);
+         emitArrayStoreAt(varPtr, *info, indices, inputVal);
          return inputVal;
-  } else if (strcmp(node->left->type, "IDENTIFIER") == 0) {
+  } else if (node->left->kind == NODE_IDENTIFIER) {
          std::string varName = node->left->value;
          Value *varPtr = NamedValues[varName];
          if (!varPtr) {
              varPtr = CreateEntryBlockAlloca(currentFunction, varName, Type::getInt32Ty(Context));
              NamedValues[varName] = varPtr;
          }
+         // input(arr): fill every element with one runtime call.
+         if (const ArrayInfo *info = lookupArray(varPtr)) {
+             if (lookupRecord(info->elemType))
+                report_fatal_error("input() reads fields, not whole records");
+             Function *readArray = getReadArrayFunction(info->elemType);
+             Value *count = emitArrayLength(varPtr, *info);
+             Value *data = emitArrayData(varPtr, *info);
+             data = Builder.CreateBitCast(data, readArray->getFunctionType()->getParamType(0), "arraydata_ptr");
+             Builder.CreateCall(readArray, {data, count});
+             return count;
+         }
          AllocaInst *allocaInst = dyn_cast<AllocaInst>(varPtr);
          Type *allocatedType = allocaInst->getAllocatedType();
          Value *inputVal = nullptr;
@@ -250,28 +2050,838 @@ Value *generateInputExpr(ASTNode *node, Function* currentFunction) {
   }
 }
 
+// --- String expressions ---
+// Helper: True if the expression mentions `name` anywhere.
+static bool referencesVar(ASTNode *node, const char *name) {
+  if (!node)
+    return false;
+  if (node->value && strcmp(node->value, name) == 0)
+    return true;
+  for (int i = 0; i < node->childCount; i++)
+    if (referencesVar(node->children[i], name))
+      return true;
+  return referencesVar(node->left, name) || referencesVar(node->right, name);
+}
+
+// Helper: The operands of a left-deep `a + b + c` chain, in evaluation order.
+static void collectAddChain(ASTNode *node, std::vector<ASTNode*> &operands) {
+  std::vector<ASTNode*> rights;
+  while (node->kind == NODE_ADD) {
+    rights.push_back(node->right);
+    node = node->left;
+  }
+  operands.push_back(node);
+  operands.insert(operands.end(), rights.rbegin(), rights.rend());
+}
+
+static StructType* lookupTask(Value *slot);
+
+// Helper: Evaluate an operand whose value is only read, never kept (print,
+// concatenation, at, ...). A string variable is loaded without
+// cookie_str_share, so its builder buffer stays appendable in place.
+static Value* generateTransientRead(ASTNode *node, Function *currentFunction) {
+  if (node && node->kind == NODE_IDENTIFIER) {
+    auto it = NamedValues.find(node->value);
+    AllocaInst *AI = it != NamedValues.end() ? dyn_cast_or_null<AllocaInst>(it->second) : nullptr;
+    if (AI && AI->getAllocatedType() == getStringType() && !lookupTask(AI))
+      return Builder.CreateLoad(AI->getAllocatedType(), AI, node->value);
+  }
+  return generateIR(node, currentFunction);
+}
+
+// Helper: `L + R` on evaluated operands.
+static Value* emitAdd(Value *L, Value *R) {
+  if (L->getType() == getStringType() && R->getType() == getStringType())
+    return Builder.CreateCall(getConcatFunction(), {L, R}, "concat");
+  if (L->getType()->isFloatTy() && R->getType()->isIntegerTy())
+    R = Builder.CreateSIToFP(R, Type::getFloatTy(Context), "intToFloat");
+  else if (L->getType()->isIntegerTy() && R->getType()->isFloatTy())
+    L = Builder.CreateSIToFP(L, Type::getFloatTy(Context), "intToFloat");
+  if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
+    return Builder.CreateFAdd(L, R, "faddtmp");
+  return Builder.CreateAdd(L, R, "addtmp");
+}
+
+// Helper: Concatenate three or more strings into one allocation sized once.
+static Value* emitConcatN(ArrayRef<Value*> parts, Function *currentFunction) {
+  ArrayType *partsType = ArrayType::get(getStringType(), parts.size());
+  AllocaInst *partsArr = CreateEntryBlockAlloca(currentFunction, "concat_parts", partsType);
+  for (unsigned i = 0; i < parts.size(); i++)
+    Builder.CreateStore(parts[i], Builder.CreateConstInBoundsGEP2_32(partsType, partsArr, 0, i, "concat_part"));
+  Value *first = Builder.CreateConstInBoundsGEP2_32(partsType, partsArr, 0, 0, "concat_parts_ptr");
+  Value *count = ConstantInt::get(Type::getInt32Ty(Context), parts.size());
+  return Builder.CreateCall(getStrConcatNFunction(), {first, count}, "concat_n");
+}
+
+// Helper: Lower `name = name + a + b ...` on a string variable to in-place
+// builder appends (see cookie_str_append). Returns nullptr, having emitted
+// nothing, when the assignment is not a self-append. Appends whose operands
+// read `name` again keep the copying path, since appending in place would
+// change what those operands see.
+static Value* emitStringSelfAppend(const char *name, ASTNode *expr, Function *currentFunction) {
+  if (!expr || expr->kind != NODE_ADD)
+    return nullptr;
+  auto it = NamedValues.find(name);
+  AllocaInst *var = it != NamedValues.end() ? dyn_cast_or_null<AllocaInst>(it->second) : nullptr;
+  if (!var || var->getAllocatedType() != getStringType())
+    return nullptr;
+  std::vector<ASTNode*> operands;
+  collectAddChain(expr, operands);
+  if (operands[0]->kind != NODE_IDENTIFIER || strcmp(operands[0]->value, name) != 0)
+    return nullptr;
+  for (size_t i = 1; i < operands.size(); i++)
+    if (referencesVar(operands[i], name))
+      return nullptr;
+  std::vector<Value*> parts;
+  for (size_t i = 1; i < operands.size(); i++) {
+    Value *part = generateTransientRead(operands[i], currentFunction);
+    if (part->getType() != getStringType())
+      report_fatal_error(Twine("Type Error: only strings can be appended to string '") + name + "'");
+    parts.push_back(part);
+  }
+  Value *cur = Builder.CreateLoad(getStringType(), var, name);
+  for (Value *part : parts)
+    cur = Builder.CreateCall(getStrAppendFunction(), {cur, part}, "append");
+  Builder.CreateStore(cur, var);
+  return cur;
+}
+
+// --- Parallel loops ---
+// `parallel loop i : lo : hi { ... }` outlines its body into a function of
+// its own, "<fn>.parallel"(env, begin, end), which runs iterations
+// [begin, end). cookie_parallel_for calls it on pieces of the range from the
+// runtime's thread pool. The enclosing function's variables the body uses
+// are passed by pointer in env, an array of i8*; the variables it declares,
+// and the loop variables, are private to each piece. A `reduce` variable is
+// private too: each piece starts it at the identity of its operator and
+// folds it into the shared variable under the runtime's lock at the end.
+struct ParallelBodyScan {
+  std::set<std::string> used;      // every name the body mentions
+  std::set<std::string> declared;  // names it declares, private to each piece
+  std::set<std::string> written;   // names it assigns or resizes as a whole
+  bool hasInput = false;
+  bool hasReturn = false;
+  bool hasYield = false;
+};
+
+static void scanParallelBody(ASTNode *node, ParallelBodyScan &scan) {
+  if (!node)
+    return;
+  if (node->value)
+    scan.used.insert(node->value);
+  switch (node->kind) {
+  case NODE_ASSIGN_INT: case NODE_ASSIGN_FLOAT: case NODE_ASSIGN_BOOL: case NODE_ASSIGN_CHAR:
+  case NODE_ASSIGN_STRING: case NODE_VAR_DECL:
+  case NODE_DECL_INT: case NODE_DECL_FLOAT: case NODE_DECL_BOOL: case NODE_DECL_CHAR: case NODE_DECL_STRING:
+  case NODE_DECL_ARRAY: case NODE_DECL_ARRAY_FLOAT: case NODE_DECL_ARRAY_BOOL: case NODE_DECL_ARRAY_CHAR:
+  case NODE_DECL_ARRAY_STRING: case NODE_DECL_ARRAY_INIT: case NODE_DECL_ARRAY_INIT_FLOAT:
+  case NODE_DECL_ARRAY_INIT_BOOL: case NODE_DECL_ARRAY_INIT_CHAR: case NODE_DECL_ARRAY_INIT_STRING:
+  case NODE_DECL_MAP: case NODE_DECL_CHAN: case NODE_DECL_SLICE: case NODE_DECL_RECORD: case NODE_DECL_RECORD_ARRAY:
+  case NODE_DECL_RECORD_SOA: case NODE_FOR_LOOP: case NODE_ARRAY_ITERATOR:
+    if (node->value)
+      scan.declared.insert(node->value);
+    break;
+  case NODE_REASSIGN:
+    scan.written.insert(node->value);
+    break;
+  case NODE_FIELD_ASSIGN:
+    if (node->left && node->left->kind == NODE_IDENTIFIER)
+      scan.written.insert(node->left->value);
+    break;
+  case NODE_METHOD_CALL:
+    if (node->left && node->left->kind == NODE_IDENTIFIER &&
+        (strcmp(node->value, "push") == 0 || strcmp(node->value, "pop") == 0 ||
+         strcmp(node->value, "resize") == 0 || strcmp(node->value, "set") == 0 ||
+         strcmp(node->value, "remove") == 0))
+      scan.written.insert(node->left->value);
+    break;
+  case NODE_INPUT: case NODE_INPUT_EXPR:
+    scan.hasInput = true;
+    break;
+  case NODE_RETURN:
+    scan.hasReturn = true;
+    break;
+  case NODE_YIELD:
+    scan.hasYield = true;
+    break;
+  default:
+    break;
+  }
+  scanParallelBody(node->left, scan);
+  scanParallelBody(node->right, scan);
+  for (int i = 0; i < node->childCount; i++)
+    scanParallelBody(node->children[i], scan);
+}
+
+// Helper: Add a variable's storage, and that of the arrays it is made of
+// (soa columns, the extents of a multi-dimensional vector), to the values a
+// parallel body receives. Globals are visible to the body as they are.
+static void collectCapture(Value *storage, std::vector<Value*> &captured) {
+  if (!storage || isa<GlobalValue>(storage) || is_contained(captured, storage))
+    return;
+  captured.push_back(storage);
+  if (const ArrayInfo *info = lookupArray(storage)) {
+    collectCapture(info->dimsSlot, captured);
+    for (Value *column : info->columns)
+      collectCapture(column, captured);
+  }
+}
+
+// Helper: The identity of a reduce operator: where a piece's accumulator starts.
+static Constant* getReductionIdentity(const std::string &op, Type *type) {
+  if (type->isFloatTy()) {
+    if (op == "sum")
+      return ConstantFP::get(type, 0.0);
+    return ConstantFP::getInfinity(type, op == "max");
+  }
+  if (op == "min")
+    return ConstantInt::get(type, INT32_MAX);
+  if (op == "max")
+    return ConstantInt::get(type, INT32_MIN, true);
+  return ConstantInt::get(type, 0);
+}
+
+static Value* generateParallelLoop(ASTNode *node, Function *currentFunction) {
+  ASTNode *loopNode = node->left;
+  ASTNode *rangeNode = loopNode->left;
+  std::string loopVarName = loopNode->value;
+  Type *i32 = Type::getInt32Ty(Context);
+  PointerType *envType = PointerType::get(getStringType(), 0);
+
+  ParallelBodyScan scan;
+  scanParallelBody(loopNode->right, scan);
+  if (scan.hasInput)
+    report_fatal_error("input cannot be used inside a parallel loop");
+  if (scan.hasReturn)
+    report_fatal_error("return cannot be used inside a parallel loop");
+  if (scan.hasYield)
+    report_fatal_error("yield cannot be used inside a parallel loop");
+
+  // The range, evaluated once before any piece runs. A range ending in an
+  // array (or a column, or a slice) runs over its indices.
+  Value *first = rangeNode->left ? generateIR(rangeNode->left, currentFunction) : ConstantInt::get(i32, 1);
+  const ArrayInfo *endArray;
+  Value *last;
+  if (Value *arrPtr = lookupArrayOperand(rangeNode->right, endArray, currentFunction))
+    last = emitArrayLength(arrPtr, *endArray);
+  else
+    last = generateIR(rangeNode->right, currentFunction);
+  if (!first->getType()->isIntegerTy(32) || !last->getType()->isIntegerTy(32))
+    report_fatal_error("The range of a parallel loop must be int");
+
+  std::map<std::string, std::string> reductions;  // variable -> operator
+  for (ASTNode *clause : listItems(node->right)) {
+    std::string op = clause->value, var = clause->left->value;
+    if (op != "sum" && op != "min" && op != "max")
+      report_fatal_error(Twine("Unknown reduction '") + op + "'; use sum, min or max");
+    AllocaInst *shared = dyn_cast_or_null<AllocaInst>(NamedValues[var]);
+    Type *varType = shared ? shared->getAllocatedType() : nullptr;
+    if (!varType || !(varType->isIntegerTy(32) || varType->isFloatTy()))
+      report_fatal_error(Twine("reduce ") + op + "(" + var + "): '" + var +
+                         "' must be an int or float declared before the loop");
+    if (scan.declared.count(var) || var == loopVarName)
+      report_fatal_error(Twine("reduce ") + op + "(" + var + "): '" + var + "' is declared inside the loop");
+    if (!reductions.emplace(var, op).second)
+      report_fatal_error(Twine("'") + var + "' is listed in reduce twice");
+  }
+
+  // The enclosing function's variables the body shares.
+  std::vector<std::string> sharedNames;
+  std::vector<Value*> captured;
+  for (const std::string &name : scan.used) {
+    auto it = NamedValues.find(name);
+    if (it == NamedValues.end() || !it->second || name == loopVarName || scan.declared.count(name))
+      continue;
+    if (scan.written.count(name) && !reductions.count(name)) {
+      if (lookupArray(it->second) || lookupMap(it->second))
+        report_fatal_error(Twine("A parallel loop assigns or resizes '") + name +
+                           "' as a whole, which all iterations share; assign its elements instead");
+      report_fatal_error(Twine("A parallel loop assigns '") + name +
+                         "', which all iterations share; declare it inside the loop or list it in reduce");
+    }
+    if (lookupTask(it->second))
+      report_fatal_error(Twine("A parallel loop uses the task handle '") + name +
+                         "', which all iterations share; await it outside the loop");
+    sharedNames.push_back(name);
+    collectCapture(it->second, captured);
+  }
+  ArrayType *envArrayType = ArrayType::get(getStringType(), std::max<size_t>(captured.size(), 1));
+  AllocaInst *env = CreateEntryBlockAlloca(currentFunction, "parallel.env", envArrayType);
+  for (unsigned k = 0; k < captured.size(); k++)
+    Builder.CreateStore(Builder.CreateBitCast(captured[k], getStringType()),
+                        Builder.CreateConstInBoundsGEP2_32(envArrayType, env, 0, k));
+
+  Type *i64 = Type::getInt64Ty(Context);
+  FunctionType *bodyType = FunctionType::get(Type::getVoidTy(Context), {envType, i64, i64}, false);
+  Function *bodyFn = Function::Create(bodyType, Function::InternalLinkage, currentFunction->getName() + ".parallel",
+                                      TheModule);
+  Argument *envArg = bodyFn->getArg(0), *beginArg = bodyFn->getArg(1), *endArg = bodyFn->getArg(2);
+  envArg->setName("env");
+  beginArg->setName("begin");
+  endArg->setName("end");
+
+  // Generate the body with the state of the enclosing function set aside.
+  IRBuilderBase::InsertPoint savedIP = Builder.saveIP();
+  std::map<std::string, Value*> oldNamedValues = NamedValues;
+  std::vector<Value*> oldOwnedArrays, oldOwnedMaps, oldOwnedChans;
+  std::vector<BasicBlock*> oldSwitchMerges;
+  std::swap(oldOwnedArrays, FunctionOwnedArrays);
+  std::swap(oldOwnedMaps, FunctionOwnedMaps);
+  std::swap(oldOwnedChans, FunctionOwnedChans);
+  std::swap(oldSwitchMerges, SwitchMergeStack);
+
+  // Arrays and maps are used in place. The body cannot assign a shared
+  // scalar, so scalars (and records, and channel handles) are copied into
+  // locals of its own once.
+  Builder.SetInsertPoint(BasicBlock::Create(Context, "entry", bodyFn));
+  std::map<Value*, Value*> remap, sharedPtrs;
+  for (unsigned k = 0; k < captured.size(); k++) {
+    Value *storage = captured[k];
+    Value *slot = Builder.CreateConstInBoundsGEP1_32(getStringType(), envArg, k);
+    Value *ptr = Builder.CreateLoad(getStringType(), slot, storage->getName() + ".shared");
+    ptr = Builder.CreateBitCast(ptr, storage->getType(), storage->getName() + ".shared");
+    sharedPtrs[storage] = ptr;
+    AllocaInst *scalar = dyn_cast<AllocaInst>(storage);
+    if (!scalar || lookupArray(storage) || lookupMap(storage)) {
+      remap[storage] = ptr;
+      continue;
+    }
+    AllocaInst *local = CreateEntryBlockAlloca(bodyFn, std::string(storage->getName()), scalar->getAllocatedType());
+    Builder.CreateStore(Builder.CreateLoad(scalar->getAllocatedType(), ptr, storage->getName()), local);
+    remap[storage] = local;
+  }
+  for (Value *storage : captured) {
+    if (const ArrayInfo *info = lookupArray(storage)) {
+      ArrayInfo copy = *info;
+      if (copy.dimsSlot)
+        copy.dimsSlot = remap[copy.dimsSlot];
+      for (Value *&column : copy.columns)
+        column = remap[column];
+      ArrayVars[remap[storage]] = copy;
+    } else if (const MapInfo *info = lookupMap(storage)) {
+      MapInfo copy = *info;
+      MapVars[remap[storage]] = copy;
+    } else if (Type *elemType = lookupChan(storage)) {
+      ChanVars[remap[storage]] = elemType;
+    }
+  }
+  NamedValues.clear();
+  for (const std::string &name : sharedNames) {
+    Value *storage = oldNamedValues[name];
+    NamedValues[name] = remap.count(storage) ? remap[storage] : storage;
+  }
+  std::map<std::string, AllocaInst*> partials;
+  for (auto &reduction : reductions) {
+    Type *varType = cast<AllocaInst>(oldNamedValues[reduction.first])->getAllocatedType();
+    AllocaInst *partial = CreateEntryBlockAlloca(bodyFn, reduction.first + ".partial", varType);
+    Builder.CreateStore(getReductionIdentity(reduction.second, varType), partial);
+    partials[reduction.first] = partial;
+    NamedValues[reduction.first] = partial;
+  }
+
+  // The range is counted in i64, since a range ending at INT32_MAX has end
+  // INT32_MAX + 1. The int loop variable steps alongside; its increment after
+  // the last iteration, which may overflow, is never read.
+  AllocaInst *index = CreateEntryBlockAlloca(bodyFn, "parallel.index", i64);
+  AllocaInst *loopVar = CreateEntryBlockAlloca(bodyFn, loopVarName, i32);
+  NamedValues[loopVarName] = loopVar;
+  Builder.CreateStore(beginArg, index);
+  Builder.CreateStore(Builder.CreateTrunc(beginArg, i32), loopVar);
+  BasicBlock *condBB = BasicBlock::Create(Context, "parallel.cond", bodyFn);
+  BasicBlock *loopBB = BasicBlock::Create(Context, "parallel.body", bodyFn);
+  BasicBlock *afterBB = BasicBlock::Create(Context, "parallel.end", bodyFn);
+  Builder.CreateBr(condBB);
+  Builder.SetInsertPoint(condBB);
+  Value *cur = Builder.CreateLoad(i64, index, "parallel.index");
+  Builder.CreateCondBr(Builder.CreateICmpSLT(cur, endArg, "parallelcond"), loopBB, afterBB);
+  Builder.SetInsertPoint(loopBB);
+  ParallelBodyDepth++;
+  generateIR(loopNode->right, bodyFn);
+  ParallelBodyDepth--;
+  cur = Builder.CreateLoad(i64, index, "parallel.index");
+  Builder.CreateStore(Builder.CreateNSWAdd(cur, ConstantInt::get(i64, 1), "parallelinc"), index);
+  Value *var = Builder.CreateLoad(i32, loopVar, loopVarName);
+  Builder.CreateStore(Builder.CreateNSWAdd(var, ConstantInt::get(i32, 1), "parallelinc"), loopVar);
+  Builder.CreateBr(condBB);
+
+  Builder.SetInsertPoint(afterBB);
+  if (!partials.empty()) {
+    Builder.CreateCall(getRuntimeFunction("cookie_parallel_lock", Type::getVoidTy(Context), {}));
+    for (auto &reduction : reductions) {
+      Value *shared = sharedPtrs[oldNamedValues[reduction.first]];
+      Type *varType = partials[reduction.first]->getAllocatedType();
+      Value *total = Builder.CreateLoad(varType, shared, reduction.first);
+      Value *partial = Builder.CreateLoad(varType, partials[reduction.first], reduction.first + ".partial");
+      Builder.CreateStore(emitReduceStep(reduction.second, total, partial), shared);
+    }
+    Builder.CreateCall(getRuntimeFunction("cookie_parallel_unlock", Type::getVoidTy(Context), {}));
+  }
+  Builder.CreateRetVoid();
+  emitArrayCleanup(bodyFn);
+  emitMapCleanup(bodyFn);
+  emitChanCleanup(bodyFn);
+
+  NamedValues = oldNamedValues;
+  std::swap(oldOwnedArrays, FunctionOwnedArrays);
+  std::swap(oldOwnedMaps, FunctionOwnedMaps);
+  std::swap(oldOwnedChans, FunctionOwnedChans);
+  std::swap(oldSwitchMerges, SwitchMergeStack);
+  Builder.restoreIP(savedIP);
+
+  Function *parallelFor = getRuntimeFunction("cookie_parallel_for", Type::getVoidTy(Context),
+                                             {PointerType::get(bodyType, 0), envType, i32, i32});
+  Value *envPtr = Builder.CreateConstInBoundsGEP2_32(envArrayType, env, 0, 0, "env");
+  Builder.CreateCall(parallelFor, {bodyFn, envPtr, first, last});
+  return ConstantInt::get(i32, 0);
+}
+
+// --- Generators ---
+// A function whose body contains `yield (x);` is a generator, consumed by
+// `loop v : gen(args) { ... }`. It is built as an LLVM switched-resume
+// coroutine: calling it allocates the frame and stops at an initial suspend,
+// each resume runs to the next yield, which stores the value in the
+// coroutine's promise (an i32) and suspends, and falling off the end (or
+// `return`) parks it at the final suspend. The consuming loop resumes it,
+// stops once llvm.coro.done says it finished, reads the promise otherwise,
+// and destroys it after the loop. CoroSplit turns this into resume/destroy
+// functions; once the ramp is inlined into the loop, CoroElide puts the frame
+// on the consumer's stack, so a generator costs no allocation at -O2.
+struct GeneratorState {
+  Value *id;
+  Value *handle;
+  AllocaInst *promise;
+  BasicBlock *finalBB;
+  BasicBlock *cleanupBB;
+  BasicBlock *suspendBB;
+};
+static std::set<Function*> Generators;
+// The generator being generated, if any.
+static GeneratorState *CurrentGenerator = nullptr;
+// Handles of the generator loops around the statement being generated; a
+// return from inside them destroys them first.
+static std::vector<Value*> GeneratorLoopHandles;
+
+static bool containsYield(ASTNode *node) {
+  if (!node)
+    return false;
+  if (node->kind == NODE_YIELD)
+    return true;
+  if (containsYield(node->left) || containsYield(node->right))
+    return true;
+  for (int i = 0; i < node->childCount; i++)
+    if (containsYield(node->children[i]))
+      return true;
+  return false;
+}
+
+// Helper: coro.suspend, then go on at resumeBB, to the cleanup when the
+// generator is destroyed while suspended here, or back to the consumer.
+static void emitGeneratorSuspend(bool final, BasicBlock *resumeBB) {
+  GeneratorState &gen = *CurrentGenerator;
+  Value *state = Builder.CreateIntrinsic(Intrinsic::coro_suspend, {},
+                                         {ConstantTokenNone::get(Context), Builder.getInt1(final)}, nullptr,
+                                         "gen.state");
+  SwitchInst *sw = Builder.CreateSwitch(state, gen.suspendBB, 2);
+  sw->addCase(Builder.getInt8(0), resumeBB);
+  sw->addCase(Builder.getInt8(1), gen.cleanupBB);
+}
+
+// Helper: Destroy the generators of the loops being left by a return.
+static void emitGeneratorLoopExits() {
+  for (auto it = GeneratorLoopHandles.rbegin(); it != GeneratorLoopHandles.rend(); ++it)
+    Builder.CreateIntrinsic(Intrinsic::coro_destroy, {}, {*it});
+}
+
+static Value* generateYield(ASTNode *node, Function *currentFunction) {
+  if (!CurrentGenerator)
+    report_fatal_error("yield can only be used in a function");
+  Value *val = generateIR(node->left, currentFunction);
+  if (!val->getType()->isIntegerTy() || val->getType()->isIntegerTy(1))
+    report_fatal_error(Twine("'") + currentFunction->getName() + "' yields a value that is not an int or char");
+  val = Builder.CreateIntCast(val, Type::getInt32Ty(Context), true);
+  Builder.CreateStore(val, CurrentGenerator->promise);
+  BasicBlock *resumeBB = BasicBlock::Create(Context, "gen.resume", currentFunction);
+  emitGeneratorSuspend(false, resumeBB);
+  Builder.SetInsertPoint(resumeBB);
+  return val;
+}
+
+// `return (x);` in a generator ends the sequence; x is evaluated and dropped.
+static Value* generateGeneratorReturn(ASTNode *node, Function *currentFunction) {
+  Value *val = generateIR(node->left, currentFunction);
+  emitGeneratorLoopExits();
+  Builder.CreateBr(CurrentGenerator->finalBB);
+  Builder.SetInsertPoint(BasicBlock::Create(Context, "after.return", currentFunction));
+  return val;
+}
+
+static Value* generateGenerator(ASTNode *node) {
+  std::string funcName = node->value;
+  std::vector<Type*> paramTypes;
+  std::vector<std::string> paramNames;
+  extractParams(node->left, paramTypes, paramNames);
+  Type *handleType = getStringType();
+  Type *i32 = Type::getInt32Ty(Context);
+  FunctionType *funcType = FunctionType::get(handleType, paramTypes, false);
+  Function *func = Function::Create(funcType, Function::ExternalLinkage, funcName, TheModule);
+  Generators.insert(func);
+  // Marks the function for CoroSplit.
+#if LLVM_VERSION_MAJOR >= 15
+  func->addFnAttr(Attribute::PresplitCoroutine);
+#else
+  func->addFnAttr("coroutine.presplit", "0");
+#endif
+  unsigned idx = 0;
+  for (auto &arg : func->args())
+    arg.setName(paramNames[idx++]);
+
+  std::map<std::string, Value*> oldNamedValues = NamedValues;
+  NamedValues.clear();
+  GrowableArrays.clear();
+  collectGrowableArrays(node->right, GrowableArrays);
+  std::vector<Value*> oldLoopHandles;
+  std::swap(oldLoopHandles, GeneratorLoopHandles);
+
+  // Ramp: allocate the frame unless CoroElide has found a place for it.
+  BasicBlock *entryBB = BasicBlock::Create(Context, "entry", func);
+  BasicBlock *allocBB = BasicBlock::Create(Context, "gen.alloc", func);
+  BasicBlock *beginBB = BasicBlock::Create(Context, "gen.begin", func);
+  Builder.SetInsertPoint(entryBB);
+  GeneratorState gen;
+  gen.promise = CreateEntryBlockAlloca(func, "gen.promise", i32);
+  Value *nullPtr = Constant::getNullValue(handleType);
+  gen.id = Builder.CreateIntrinsic(Intrinsic::coro_id, {},
+                                   {Builder.getInt32(0), Builder.CreateBitCast(gen.promise, handleType), nullPtr,
+                                    nullPtr},
+                                   nullptr, "gen.id");
+  Value *needAlloc = Builder.CreateIntrinsic(Intrinsic::coro_alloc, {}, {gen.id}, nullptr, "gen.need_alloc");
+  Builder.CreateCondBr(needAlloc, allocBB, beginBB);
+  Builder.SetInsertPoint(allocBB);
+  Type *i64 = Type::getInt64Ty(Context);
+  Value *size = Builder.CreateIntrinsic(Intrinsic::coro_size, {i64}, {}, nullptr, "gen.size");
+  Value *mem = Builder.CreateCall(getRuntimeFunction("malloc", handleType, {i64}), {size}, "gen.mem");
+  Builder.CreateBr(beginBB);
+  Builder.SetInsertPoint(beginBB);
+  PHINode *frameMem = Builder.CreatePHI(handleType, 2, "gen.frame_mem");
+  frameMem->addIncoming(nullPtr, entryBB);
+  frameMem->addIncoming(mem, allocBB);
+  gen.handle = Builder.CreateIntrinsic(Intrinsic::coro_begin, {}, {gen.id, frameMem}, nullptr, "gen.handle");
+  gen.finalBB = BasicBlock::Create(Context, "gen.final", func);
+  gen.cleanupBB = BasicBlock::Create(Context, "gen.cleanup", func);
+  gen.suspendBB = BasicBlock::Create(Context, "gen.suspend", func);
+  CurrentGenerator = &gen;
+
+  // Parameters are stored after coro.begin, into allocas the frame keeps.
+  std::vector<ASTNode*> paramNodes;
+  for (ASTNode *paramNode : listItems(node->left))
+    if (paramNode->kind == NODE_PARAM)
+      paramNodes.push_back(paramNode);
+  recordChanParams(func, paramNodes);
+  for (auto &arg : func->args()) {
+    if (Type *elemType = getParamArrayElementType(paramNodes[arg.getArgNo()])) {
+      declareSlice(std::string(arg.getName()), elemType, &arg, true, func);
+      continue;
+    }
+    AllocaInst *alloca = CreateEntryBlockAlloca(func, std::string(arg.getName()), arg.getType());
+    Builder.CreateStore(&arg, alloca);
+    if (Type *elemType = getChanParamType(func, arg.getArgNo()))
+      ChanVars[alloca] = elemType;
+    NamedValues[std::string(arg.getName())] = alloca;
+  }
+  BasicBlock *bodyBB = BasicBlock::Create(Context, "gen.body", func);
+  emitGeneratorSuspend(false, bodyBB);
+  Builder.SetInsertPoint(bodyBB);
+  generateIR(node->right, func);
+  if (!Builder.GetInsertBlock()->getTerminator())
+    Builder.CreateBr(gen.finalBB);
+
+  // Resuming past the final suspend is undefined; only destroy leaves it.
+  Builder.SetInsertPoint(gen.finalBB);
+  BasicBlock *pastEndBB = BasicBlock::Create(Context, "gen.past_end", func);
+  emitGeneratorSuspend(true, pastEndBB);
+  Builder.SetInsertPoint(pastEndBB);
+  Builder.CreateUnreachable();
+
+  // The cleanup frees what the body declared. The cleanup helpers work
+  // before a function's returns, so the cleanup block ends in a placeholder
+  // return (the only one so far) while they run.
+  Builder.SetInsertPoint(gen.cleanupBB);
+  ReturnInst *placeholder = Builder.CreateRet(nullPtr);
+  emitArrayCleanup(func);
+  emitMapCleanup(func);
+  emitChanCleanup(func);
+  Builder.SetInsertPoint(placeholder);
+  Value *frame = Builder.CreateIntrinsic(Intrinsic::coro_free, {}, {gen.id, gen.handle}, nullptr, "gen.frame");
+  BasicBlock *freeBB = BasicBlock::Create(Context, "gen.free", func);
+  Builder.CreateCondBr(Builder.CreateIsNotNull(frame), freeBB, gen.suspendBB);
+  placeholder->eraseFromParent();
+  Builder.SetInsertPoint(freeBB);
+  Builder.CreateCall(getRuntimeFunction("free", Type::getVoidTy(Context), {handleType}), {frame});
+  Builder.CreateBr(gen.suspendBB);
+
+  Builder.SetInsertPoint(gen.suspendBB);
+  Builder.CreateIntrinsic(Intrinsic::coro_end, {}, {gen.handle, Builder.getFalse()});
+  Builder.CreateRet(gen.handle);
+
+  CurrentGenerator = nullptr;
+  std::swap(oldLoopHandles, GeneratorLoopHandles);
+  NamedValues = oldNamedValues;
+  return ConstantInt::get(i32, 0);
+}
+
+// `loop v : gen(args) { body }`
+static Value* generateGeneratorLoop(const std::string &loopVarName, ASTNode *callNode, ASTNode *body,
+                                    Function *currentFunction) {
+  Function *gen = TheModule->getFunction(callNode->value);
+  Type *i32 = Type::getInt32Ty(Context);
+  std::vector<Value*> args;
+  extractArgs(callNode->left, gen, args, currentFunction);
+  Value *handle = Builder.CreateCall(gen, args, "gen");
+  Value *loopVar = NamedValues[loopVarName];
+  if (!loopVar) {
+    loopVar = CreateEntryBlockAlloca(currentFunction, loopVarName, i32);
+    NamedValues[loopVarName] = loopVar;
+  }
+  BasicBlock *condBB = BasicBlock::Create(Context, "gen_loop.cond", currentFunction);
+  BasicBlock *bodyBB = BasicBlock::Create(Context, "gen_loop.body", currentFunction);
+  BasicBlock *afterBB = BasicBlock::Create(Context, "gen_loop.after", currentFunction);
+  Builder.CreateBr(condBB);
+  Builder.SetInsertPoint(condBB);
+  Builder.CreateIntrinsic(Intrinsic::coro_resume, {}, {handle});
+  Value *done = Builder.CreateIntrinsic(Intrinsic::coro_done, {}, {handle}, nullptr, "gen.done");
+  Builder.CreateCondBr(done, afterBB, bodyBB);
+
+  Builder.SetInsertPoint(bodyBB);
+  Value *promise = Builder.CreateIntrinsic(Intrinsic::coro_promise, {},
+                                           {handle, Builder.getInt32(4), Builder.getFalse()}, nullptr,
+                                           "gen.promise");
+  Value *val = Builder.CreateLoad(i32, Builder.CreateBitCast(promise, PointerType::get(i32, 0)), "gen.value");
+  Builder.CreateStore(val, loopVar);
+  GeneratorLoopHandles.push_back(handle);
+  LoopDepth++;
+  generateIR(body, currentFunction);
+  LoopDepth--;
+  GeneratorLoopHandles.pop_back();
+  Builder.CreateBr(condBB);
+
+  Builder.SetInsertPoint(afterBB);
+  Builder.CreateIntrinsic(Intrinsic::coro_destroy, {}, {handle});
+  return ConstantInt::get(i32, 0);
+}
+
+// --- Memoized functions ---
+// `memo fun f(...)` generates the body as the internal function "f.body" and
+// f as a wrapper around it. The wrapper packs the arguments into i64 words,
+// returns the result cookie_memo_find has for them, and otherwise calls
+// f.body and hands the result to cookie_memo_store. f exists before the body
+// is generated, so the body's recursive calls go through the cache too. The
+// runtime creates the cache on the first call and keeps it in "f.memo".
+static Value* generateMemoFunction(ASTNode *node) {
+  ASTNode *def = node->left;
+  std::string funcName = def->value;
+  if (containsYield(def->right))
+    report_fatal_error(Twine("'") + funcName + "' is a generator and cannot be memo");
+  int limit = node->value ? atoi(node->value) : 0;
+  if (node->value && limit <= 0)
+    report_fatal_error(Twine("memo fun '") + funcName + "': the cache size must be positive");
+  std::vector<Type*> paramTypes;
+  std::vector<std::string> paramNames;
+  extractParams(def->left, paramTypes, paramNames);
+  for (unsigned k = 0; k < paramTypes.size(); k++) {
+    Type *type = paramTypes[k];
+    if (!type->isIntegerTy(32) && !type->isFloatTy() && !type->isIntegerTy(1) && !type->isIntegerTy(8))
+      report_fatal_error(Twine("memo fun '") + funcName + "': parameter '" + paramNames[k] +
+                         "' must be an int, float, bool or char");
+  }
+  Type *retType = getFunctionReturnType(def);
+  if (!retType->isIntegerTy(32))
+    report_fatal_error(Twine("memo fun '") + funcName + "' must return an int");
+  Function *func = Function::Create(FunctionType::get(retType, paramTypes, false), Function::ExternalLinkage,
+                                    funcName, TheModule);
+  unsigned idx = 0;
+  for (auto &arg : func->args())
+    arg.setName(paramNames[idx++]);
+
+  std::string bodyName = funcName + ".body";
+  generateIR(createASTNode(NODE_FUNC_DEF, internString(bodyName.c_str()), def->left, def->right), nullptr);
+  Function *body = TheModule->getFunction(bodyName);
+  body->setLinkage(Function::InternalLinkage);
+
+  Type *i32 = Type::getInt32Ty(Context);
+  Type *i64 = Type::getInt64Ty(Context);
+  Type *cacheType = getStringType();
+  GlobalVariable *cache = new GlobalVariable(*TheModule, cacheType, false, GlobalValue::InternalLinkage,
+                                             Constant::getNullValue(cacheType), funcName + ".memo");
+  BasicBlock *entryBB = BasicBlock::Create(Context, "entry", func);
+  BasicBlock *hitBB = BasicBlock::Create(Context, "memo.hit", func);
+  BasicBlock *missBB = BasicBlock::Create(Context, "memo.miss", func);
+  Builder.SetInsertPoint(entryBB);
+  ArrayType *keyType = ArrayType::get(i64, std::max<size_t>(paramTypes.size(), 1));
+  AllocaInst *key = Builder.CreateAlloca(keyType, nullptr, "memo.key");
+  AllocaInst *result = Builder.CreateAlloca(i32, nullptr, "memo.result");
+  std::vector<Value*> args;
+  for (auto &arg : func->args()) {
+    Builder.CreateStore(emitValueWord(&arg), Builder.CreateConstInBoundsGEP2_32(keyType, key, 0, arg.getArgNo()));
+    args.push_back(&arg);
+  }
+  Value *keyPtr = Builder.CreateConstInBoundsGEP2_32(keyType, key, 0, 0, "memo.key_ptr");
+  PointerType *cachePtrType = PointerType::get(cacheType, 0);
+  Function *findFn = getRuntimeFunction("cookie_memo_find", i32,
+                                        {cachePtrType, getStringType(), i32, i32, keyPtr->getType(),
+                                         PointerType::get(i32, 0)});
+  Value *hit = Builder.CreateCall(findFn, {cache, getStringConstant(funcName),
+                                           ConstantInt::get(i32, paramTypes.size()), ConstantInt::get(i32, limit),
+                                           keyPtr, result}, "memo.found");
+  Builder.CreateCondBr(Builder.CreateICmpNE(hit, ConstantInt::get(i32, 0)), hitBB, missBB);
+  Builder.SetInsertPoint(hitBB);
+  Builder.CreateRet(Builder.CreateLoad(i32, result, "memo.cached"));
+  Builder.SetInsertPoint(missBB);
+  Value *value = Builder.CreateCall(body, args, "memo.value");
+  Builder.CreateCall(getRuntimeFunction("cookie_memo_store", Type::getVoidTy(Context),
+                                        {cachePtrType, keyPtr->getType(), i32}),
+                     {cache, keyPtr, value});
+  Builder.CreateRet(value);
+  return ConstantInt::get(i32, 0);
+}
+
+// --- Tasks ---
+// `spawn f(a, b)` evaluates the arguments, stores them in a frame of type
+// "task.f" = {params..., result} that cookie_task_new allocates, and hands the
+// frame with the thunk "f.task" to cookie_task_spawn (or, when f takes a
+// channel, cookie_task_spawn_thread). The thunk calls f with the frame's
+// arguments and stores the result in its last field. The handle is the frame
+// pointer; TaskVars records the frame type of each handle variable, keyed by
+// its storage, so await(h) knows the result type: it waits in
+// cookie_task_await, loads the result, frees the frame and clears the handle.
+// A handle variable is only ever read by await, so no copy of it can reach
+// the freed frame.
+static std::map<Function*, StructType*> TaskFrames;
+static std::map<Value*, StructType*> TaskVars;
+
+static StructType* lookupTask(Value *slot) {
+  auto it = TaskVars.find(slot);
+  return it == TaskVars.end() ? nullptr : it->second;
+}
+
+static StructType* getTaskFrameType(Function *callee) {
+  StructType *&frameType = TaskFrames[callee];
+  if (!frameType) {
+    std::vector<Type*> fields(callee->getFunctionType()->param_begin(), callee->getFunctionType()->param_end());
+    fields.push_back(callee->getReturnType());
+    frameType = StructType::create(Context, fields, ("task." + callee->getName()).str());
+  }
+  return frameType;
+}
+
+static Function* getTaskThunk(Function *callee, StructType *frameType) {
+  std::string name = (callee->getName() + ".task").str();
+  if (Function *thunk = TheModule->getFunction(name))
+    return thunk;
+  FunctionType *thunkType = FunctionType::get(Type::getVoidTy(Context), {getStringType()}, false);
+  Function *thunk = Function::Create(thunkType, Function::InternalLinkage, name, TheModule);
+  IRBuilder<> TmpB(BasicBlock::Create(Context, "entry", thunk));
+  Value *frame = TmpB.CreateBitCast(thunk->getArg(0), PointerType::get(frameType, 0), "frame");
+  std::vector<Value*> args;
+  for (unsigned k = 0; k < callee->arg_size(); k++)
+    args.push_back(TmpB.CreateLoad(frameType->getElementType(k), TmpB.CreateStructGEP(frameType, frame, k)));
+  Value *result = TmpB.CreateCall(callee, args, "result");
+  TmpB.CreateStore(result, TmpB.CreateStructGEP(frameType, frame, callee->arg_size()));
+  // Drop the references generateSpawn took on the task's channels.
+  for (unsigned k = 0; k < callee->arg_size(); k++) {
+    if (getChanParamType(callee, k))
+      TmpB.CreateCall(getRuntimeFunction("cookie_chan_release", Type::getVoidTy(Context), {getChanRuntimeType()}),
+                      {args[k]});
+  }
+  TmpB.CreateRetVoid();
+  return thunk;
+}
+
+static Value* generateSpawn(ASTNode *node, Function *currentFunction) {
+  Function *callee = TheModule->getFunction(node->value);
+  if (!callee || callee->isDeclaration())
+    report_fatal_error(Twine("spawn needs a function defined in the program; '") + node->value + "' is not one");
+  if (Generators.count(callee))
+    report_fatal_error(Twine("'") + node->value + "' is a generator and cannot be spawned");
+  std::vector<Value*> args;
+  extractArgs(node->left, callee, args, currentFunction);
+  StructType *frameType = getTaskFrameType(callee);
+  Function *thunk = getTaskThunk(callee, frameType);
+  Type *i64 = Type::getInt64Ty(Context);
+  Value *frameSize = ConstantInt::get(i64, TheModule->getDataLayout().getTypeAllocSize(frameType));
+  Value *raw = Builder.CreateCall(getRuntimeFunction("cookie_task_new", getStringType(), {i64}), {frameSize}, "task");
+  Value *frame = Builder.CreateBitCast(raw, PointerType::get(frameType, 0), "task_frame");
+  for (unsigned k = 0; k < args.size(); k++)
+    Builder.CreateStore(args[k], Builder.CreateStructGEP(frameType, frame, k));
+  // A function that takes a channel may block on its caller, so it runs on a
+  // thread of its own rather than in the pool (see cookie_task_spawn_thread).
+  // The task keeps each channel alive until it returns, even if the scope
+  // that declared it ends first.
+  bool usesChannel = false;
+  for (unsigned k = 0; k < callee->arg_size(); k++) {
+    if (!getChanParamType(callee, k))
+      continue;
+    usesChannel = true;
+    Builder.CreateCall(getRuntimeFunction("cookie_chan_retain", Type::getVoidTy(Context), {getChanRuntimeType()}),
+                       {args[k]});
+  }
+  Builder.CreateCall(getRuntimeFunction(usesChannel ? "cookie_task_spawn_thread" : "cookie_task_spawn",
+                                        Type::getVoidTy(Context), {getStringType(), thunk->getType()}),
+                     {raw, thunk});
+  return frame;
+}
+
+static Value* generateAwait(ArrayRef<ASTNode*> args, Function *currentFunction) {
+  if (args.size() != 1)
+    report_fatal_error("await() takes one task handle");
+  StructType *frameType = nullptr;
+  Value *slot = nullptr;
+  Value *frame = nullptr;
+  if (args[0]->kind == NODE_IDENTIFIER) {
+    slot = NamedValues[args[0]->value];
+    frameType = slot ? lookupTask(slot) : nullptr;
+    if (frameType)
+      frame = Builder.CreateLoad(cast<AllocaInst>(slot)->getAllocatedType(), slot, args[0]->value);
+  } else if (args[0]->kind == NODE_SPAWN) {
+    frame = generateSpawn(args[0], currentFunction);
+    frameType = TaskFrames[TheModule->getFunction(args[0]->value)];
+  }
+  if (!frameType)
+    report_fatal_error("await() needs a task handle from spawn");
+  Value *raw = Builder.CreateBitCast(frame, getStringType(), "task");
+  Builder.CreateCall(getRuntimeFunction("cookie_task_await", Type::getVoidTy(Context), {getStringType()}), {raw});
+  unsigned last = frameType->getNumElements() - 1;
+  Value *result = Builder.CreateLoad(frameType->getElementType(last),
+                                     Builder.CreateStructGEP(frameType, frame, last), "task_result");
+  Builder.CreateCall(getRuntimeFunction("cookie_task_free", Type::getVoidTy(Context), {getStringType()}), {raw});
+  // A second await on the same variable is reported instead of reading freed memory.
+  if (slot)
+    Builder.CreateStore(Constant::getNullValue(frame->getType()), slot);
+  return result;
+}
+
 // --- Helper Passes for IR Generation ---
-// Generate IR for all function definitions.
+// Generate IR for all record types, then all function definitions.
 void generateFunctions(ASTNode* node) {
-  if (!node) return;
-  if (strcmp(node->type, "GLOBAL_LIST") == 0) {
-    generateFunctions(node->left);
-    generateFunctions(node->right);
-  } else if (strcmp(node->type, "FUNC_DEF") == 0) {
-    generateIR(node, nullptr);
+  for (ASTNode *decl : listItems(node)) {
+    if (decl->kind == NODE_RECORD_DEF)
+      defineRecord(decl);
+  }
+  for (ASTNode *decl : listItems(node)) {
+    if (decl->kind == NODE_FUNC_DEF || decl->kind == NODE_MEMO)
+      generateIR(decl, nullptr);
   }
 }
 
 // Generate IR for all non-function (global) statements into main().
 void generateGlobalStatements(ASTNode* node, Function* mainFunc) {
-  if (!node) return;
-  if (strcmp(node->type, "GLOBAL_LIST") == 0) {
-    generateGlobalStatements(node->left, mainFunc);
-    generateGlobalStatements(node->right, mainFunc);
-  } else if (strcmp(node->type, "FUNC_DEF") == 0) {
-    return;
-  } else {
-    generateIR(node, mainFunc);
+  GrowableArrays.clear();
+  for (ASTNode *decl : listItems(node)) {
+    if (decl->kind != NODE_FUNC_DEF && decl->kind != NODE_MEMO)
+      collectGrowableArrays(decl, GrowableArrays);
+  }
+  for (ASTNode *decl : listItems(node)) {
+    if (decl->kind != NODE_FUNC_DEF && decl->kind != NODE_MEMO && decl->kind != NODE_RECORD_DEF)
+      generateIR(decl, mainFunc);
   }
 }
 
@@ -279,17 +2889,18 @@ void generateGlobalStatements(ASTNode* node, Function* mainFunc) {
 Value *generateIR(ASTNode *node, Function* currentFunction) {
   if (!node) return nullptr;
   
+  switch (node->kind) {
   // --- Literals ---
-  if (strcmp(node->type, "NUMBER") == 0)
+  case NODE_NUMBER:
     return ConstantInt::get(Type::getInt32Ty(Context), atoi(node->value));
   
-  if (strcmp(node->type, "FLOAT") == 0)
+  case NODE_FLOAT:
     return ConstantFP::get(Type::getFloatTy(Context), strtof(node->value, nullptr));
   
-  if (strcmp(node->type, "BOOLEAN") == 0)
+  case NODE_BOOLEAN:
     return ConstantInt::get(Type::getInt1Ty(Context), (strcmp(node->value, "true") == 0) ? 1 : 0);
   
-  if (strcmp(node->type, "CHAR") == 0) {
+  case NODE_CHAR: {
     if (strlen(node->value) < 3) {
       std::cerr << "Invalid char literal: " << node->value << "\n";
       return ConstantInt::get(Type::getInt8Ty(Context), 0);
@@ -297,20 +2908,20 @@ Value *generateIR(ASTNode *node, Function* currentFunction) {
     return ConstantInt::get(Type::getInt8Ty(Context), node->value[1]);
   }
   
-  if (strcmp(node->type, "STRING") == 0) {
+  case NODE_STRING: {
     std::string strLiteral(node->value);
     if (!strLiteral.empty() && strLiteral.front() == '"' && strLiteral.back() == '"')
       strLiteral = strLiteral.substr(1, strLiteral.size() - 2);
-    return Builder.CreateGlobalStringPtr(strLiteral, "strlit");
+    return getStringConstant(strLiteral);
   }
   
   // --- Handle DEFAULT node ---
-  if (strcmp(node->type, "DEFAULT") == 0) {
+  case NODE_DEFAULT: {
     return generateIR(node->left, currentFunction);
   }
   
   // --- BREAK Statement ---
-  if (strcmp(node->type, "BREAK") == 0) {
+  case NODE_BREAK: {
     if (SwitchMergeStack.empty())
       report_fatal_error("Break statement not within switch-case");
     BasicBlock *mergeBB = SwitchMergeStack.back();
@@ -319,31 +2930,48 @@ Value *generateIR(ASTNode *node, Function* currentFunction) {
   }
   
   // --- FOR_LOOP --- (merged version)
-  if (strcmp(node->type, "FOR_LOOP") == 0) {
+  case NODE_FOR_LOOP: {
     Value *startVal, *endVal;
     ASTNode *rangeNode = node->left;
+    if (node->value && !rangeNode->left && rangeNode->right && rangeNode->right->kind == NODE_CALL) {
+      Function *callee = TheModule->getFunction(rangeNode->right->value);
+      if (callee && Generators.count(callee))
+        return generateGeneratorLoop(node->value, rangeNode->right, node->right, currentFunction);
+    }
+    if (node->value && rangeNode->right && rangeNode->right->kind == NODE_ARRAY_ACCESS) {
+      Value *varPtr = NamedValues[rangeNode->right->value];
+      const ArrayInfo *info = varPtr ? lookupArray(varPtr) : nullptr;
+      if (info && info->rank > 1)
+        return generateRowLoop(node->value, varPtr, *info, rangeNode->right->left, node->right, currentFunction);
+    }
+    // `loop x : arr[lo:hi]` and `loop x : ps.x` (an soa column) read the
+    // elements in place.
+    if (node->value && !rangeNode->left && rangeNode->right &&
+        (rangeNode->right->kind == NODE_ARRAY_SLICE || rangeNode->right->kind == NODE_FIELD)) {
+      const ArrayInfo *info;
+      if (Value *elems = lookupArrayOperand(rangeNode->right, info, currentFunction))
+        return emitElementLoop(node->value, elems, *info, ConstantInt::get(Type::getInt32Ty(Context), 0),
+                               emitArrayLength(elems, *info), node->right, currentFunction);
+    }
     if (node->value != NULL) {
       Value *existing = NamedValues[node->value];
       if (existing)
         startVal = Builder.CreateLoad(Type::getInt32Ty(Context), existing, node->value);
       else
         startVal = ConstantInt::get(Type::getInt32Ty(Context), 1);
-      endVal = generateIR(rangeNode->right, currentFunction);
     } else {
       startVal = generateIR(rangeNode->left, currentFunction);
-      endVal = generateIR(rangeNode->right, currentFunction);
     }
+    // A range ending in an array runs to its length.
+    const ArrayInfo *endArray;
+    if (Value *arrPtr = lookupArrayVar(rangeNode->right, endArray))
+      endVal = emitArrayLength(arrPtr, *endArray);
+    else
+      endVal = generateIR(rangeNode->right, currentFunction);
     if (!startVal->getType()->isIntegerTy(32))
       startVal = Builder.CreateIntCast(startVal, Type::getInt32Ty(Context), true, "start_cast");
-    if (!endVal->getType()->isIntegerTy(32)) {
-      if (endVal->getType()->isArrayTy()) {
-        ArrayType *arrTy = dyn_cast<ArrayType>(endVal->getType());
-        unsigned len = arrTy->getNumElements();
-        endVal = ConstantInt::get(Type::getInt32Ty(Context), len);
-      } else {
-        endVal = Builder.CreateIntCast(endVal, Type::getInt32Ty(Context), true, "end_cast");
-      }
-    }
+    if (!endVal->getType()->isIntegerTy(32))
+      endVal = Builder.CreateIntCast(endVal, Type::getInt32Ty(Context), true, "end_cast");
     
     AllocaInst *forVar = nullptr;
     if (node->value != NULL) {
@@ -367,85 +2995,171 @@ Value *generateIR(ASTNode *node, Function* currentFunction) {
     BasicBlock *loopBB = BasicBlock::Create(Context, "for.body", currentFunction);
     BasicBlock *afterBB = BasicBlock::Create(Context, "for.end", currentFunction);
     
-    Builder.CreateBr(condBB);
-    Builder.SetInsertPoint(condBB);
-    Value *currVal = Builder.CreateLoad(Type::getInt32Ty(Context), forVar, (node->value ? node->value : "for_iter"));
-    Value *cond = Builder.CreateICmpSLE(currVal, endVal, "forcond");
-    Builder.CreateCondBr(cond, loopBB, afterBB);
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(condBB);
+    Value *currVal = Builder.CreateLoad(Type::getInt32Ty(Context), forVar, (node->value ? node->value : "for_iter"));
+    Value *cond = Builder.CreateICmpSLE(currVal, endVal, "forcond");
+    Builder.CreateCondBr(cond, loopBB, afterBB);
+    
+    Builder.SetInsertPoint(loopBB);
+    LoopDepth++;
+    generateIR(node->right, currentFunction);
+    LoopDepth--;
+    currVal = Builder.CreateLoad(Type::getInt32Ty(Context), forVar, (node->value ? node->value : "for_iter"));
+    // nsw: the counter never wraps past the end, which lets LLVM compute the
+    // trip count of a loop with a run-time bound and vectorize it.
+    Value *nextVal = Builder.CreateNSWAdd(currVal, ConstantInt::get(Type::getInt32Ty(Context), 1), "forinc");
+    Builder.CreateStore(nextVal, forVar);
+    Builder.CreateBr(condBB);
+    
+    Builder.SetInsertPoint(afterBB);
+    return ConstantInt::get(Type::getInt32Ty(Context), 0);
+  }
+  
+// --- ARRAY_ITERATOR --- (Updated to support both arrays and strings)
+case NODE_ARRAY_ITERATOR: {
+  std::string loopVarName = node->value;
+  std::string varName = node->left->value;
+  Value *varPtr = NamedValues[varName];
+  if (!varPtr)
+    report_fatal_error(Twine("Error: Undefined variable '") + varName + "'");
+
+  // Channels: the loop variable takes each value received, until the channel
+  // is closed and drained.
+  Type *chanElemType;
+  if (Value *chanSlot = lookupChanVar(node->left, chanElemType)) {
+    BasicBlock *condBB = BasicBlock::Create(Context, "chan_iter.cond", currentFunction);
+    BasicBlock *bodyBB = BasicBlock::Create(Context, "chan_iter.body", currentFunction);
+    BasicBlock *afterBB = BasicBlock::Create(Context, "chan_iter.after", currentFunction);
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(condBB);
+    AllocaInst *word;
+    Value *got = emitChanRecv(chanSlot, word, currentFunction);
+    Builder.CreateCondBr(Builder.CreateICmpNE(got, ConstantInt::get(got->getType(), 0)), bodyBB, afterBB);
+
+    Builder.SetInsertPoint(bodyBB);
+    Value *val = emitChanValue(Builder.CreateLoad(Type::getInt64Ty(Context), word, "chan_word"), chanElemType);
+    Value *loopVarAlloca = NamedValues[loopVarName];
+    if (!loopVarAlloca) {
+      loopVarAlloca = CreateEntryBlockAlloca(currentFunction, loopVarName, chanElemType);
+      NamedValues[loopVarName] = loopVarAlloca;
+    }
+    Builder.CreateStore(val, loopVarAlloca);
+    LoopDepth++;
+    generateIR(node->right, currentFunction);
+    LoopDepth--;
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(afterBB);
+    return ConstantInt::get(Type::getInt32Ty(Context), 0);
+  }
+
+  // Maps: the loop variable takes each key, in table order.
+  if (const MapInfo *info = lookupMap(varPtr)) {
+    Type *i32 = Type::getInt32Ty(Context);
+    PointerType *mapPtrType = getMapPtrType();
+    Function *nextFn = getRuntimeFunction("cookie_map_next", i32, {mapPtrType, i32});
+    Value *map = Builder.CreateLoad(mapPtrType, varPtr, "map");
+    AllocaInst *posAlloca = CreateEntryBlockAlloca(currentFunction, "map_iter_pos", i32);
+    Builder.CreateStore(Builder.CreateCall(nextFn, {map, ConstantInt::get(i32, 0)}, "map_pos"), posAlloca);
+
+    BasicBlock *condBB = BasicBlock::Create(Context, "map_iter.cond", currentFunction);
+    BasicBlock *bodyBB = BasicBlock::Create(Context, "map_iter.body", currentFunction);
+    BasicBlock *afterBB = BasicBlock::Create(Context, "map_iter.after", currentFunction);
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(condBB);
+    Value *pos = Builder.CreateLoad(i32, posAlloca, "map_pos");
+    Builder.CreateCondBr(Builder.CreateICmpSGE(pos, ConstantInt::get(i32, 0)), bodyBB, afterBB);
+
+    Builder.SetInsertPoint(bodyBB);
+    Value *keyPtr = Builder.CreateCall(getRuntimeFunction("cookie_map_key", getStringType(), {mapPtrType, i32}),
+                                       {map, pos}, "key_ptr");
+    Value *key;
+    if (info->keyType->isPointerTy()) {
+      key = Builder.CreateLoad(getStringType(), Builder.CreateBitCast(keyPtr, PointerType::get(getStringType(), 0)), "key");
+    } else {
+      Type *i64 = Type::getInt64Ty(Context);
+      key = Builder.CreateLoad(i64, Builder.CreateBitCast(keyPtr, PointerType::get(i64, 0)), "key");
+      key = Builder.CreateTrunc(key, info->keyType);
+    }
+    Value *loopVarAlloca = NamedValues[loopVarName];
+    if (!loopVarAlloca) {
+      loopVarAlloca = CreateEntryBlockAlloca(currentFunction, loopVarName, info->keyType);
+      NamedValues[loopVarName] = loopVarAlloca;
+    }
+    Builder.CreateStore(key, loopVarAlloca);
+    LoopDepth++;
+    generateIR(node->right, currentFunction);
+    LoopDepth--;
+
+    pos = Builder.CreateLoad(i32, posAlloca, "map_pos");
+    Value *next = Builder.CreateCall(nextFn, {map, Builder.CreateAdd(pos, ConstantInt::get(i32, 1))}, "next_pos");
+    Builder.CreateStore(next, posAlloca);
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(afterBB);
+    return ConstantInt::get(i32, 0);
+  }
+
+  // Arrays: the length is read once before the loop. A vector's data is
+  // reloaded for each element, so the body may push onto it.
+  if (const ArrayInfo *info = lookupArray(varPtr)) {
+    Function *curFunc = currentFunction;
+    Value *arraySize = emitArrayLength(varPtr, *info);
+    AllocaInst *indexAlloca = CreateEntryBlockAlloca(curFunc, "array_iter_index", Type::getInt32Ty(Context));
+    // Start at 1 since language indexing is 1-based.
+    Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Context), 1), indexAlloca);
+    
+    BasicBlock *condBB = BasicBlock::Create(Context, "array_iter.cond", curFunc);
+    BasicBlock *bodyBB = BasicBlock::Create(Context, "array_iter.body", curFunc);
+    BasicBlock *afterBB = BasicBlock::Create(Context, "array_iter.after", curFunc);
+    
+    Builder.CreateBr(condBB);
+    Builder.SetInsertPoint(condBB);
+    Value *curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
+    // For arrays, compare with arraySize (1-based indexing: loop from 1 to arraySize)
+    Value *cond = Builder.CreateICmpSLE(curIndex, arraySize, "array_iter_cond");
+    Builder.CreateCondBr(cond, bodyBB, afterBB);
+    
+    Builder.SetInsertPoint(bodyBB);
+    // Adjust index: subtract 1 to convert 1-based index to LLVM's 0-based index.
+    Value *adjustedIndex = Builder.CreateSub(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "adjusted_index");
+    Value *elemVal = emitArrayLoad(varPtr, *info, adjustedIndex);
+    
+    Value *loopVarAlloca = NamedValues[loopVarName];
+    if (!loopVarAlloca) {
+      loopVarAlloca = CreateEntryBlockAlloca(curFunc, loopVarName, elemVal->getType());
+      NamedValues[loopVarName] = loopVarAlloca;
+    }
+    Builder.CreateStore(elemVal, loopVarAlloca);
     
-    Builder.SetInsertPoint(loopBB);
-    generateIR(node->right, currentFunction);
-    currVal = Builder.CreateLoad(Type::getInt32Ty(Context), forVar, (node->value ? node->value : "for_iter"));
-    Value *nextVal = Builder.CreateAdd(currVal, ConstantInt::get(Type::getInt32Ty(Context), 1), "forinc");
-    Builder.CreateStore(nextVal, forVar);
+    // Generate the loop body (e.g. print(c);)
+    LoopDepth++;
+    generateIR(node->right, curFunc);
+    LoopDepth--;
+    
+    curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
+    Value *nextIndex = Builder.CreateAdd(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "next_index");
+    Builder.CreateStore(nextIndex, indexAlloca);
     Builder.CreateBr(condBB);
     
     Builder.SetInsertPoint(afterBB);
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
-  
-// --- ARRAY_ITERATOR --- (Updated to support both arrays and strings)
-if (strcmp(node->type, "ARRAY_ITERATOR") == 0) {
-  std::string loopVarName = node->value;
-  std::string varName = node->left->value;
-  Value *varPtr = NamedValues[varName];
-  if (!varPtr)
-    report_fatal_error(Twine("Error: Undefined variable '") + varName + "'");
-
   // Check if varPtr is an alloca (most declarations use alloca)
-  if (AllocaInst *AI = dyn_cast<AllocaInst>(varPtr)) {
+  else if (AllocaInst *AI = dyn_cast<AllocaInst>(varPtr)) {
     Type *allocatedType = AI->getAllocatedType();
-    // If it's an array type, use the existing fixed-size array iteration.
-    if (allocatedType->isArrayTy()) {
-      ArrayType *arrType = dyn_cast<ArrayType>(allocatedType);
-      unsigned arraySize = arrType->getNumElements();
-      Function *curFunc = currentFunction;
-      AllocaInst *indexAlloca = CreateEntryBlockAlloca(curFunc, "array_iter_index", Type::getInt32Ty(Context));
-      // Start at 1 since language indexing is 1-based.
-      Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Context), 1), indexAlloca);
-      
-      BasicBlock *condBB = BasicBlock::Create(Context, "array_iter.cond", curFunc);
-      BasicBlock *bodyBB = BasicBlock::Create(Context, "array_iter.body", curFunc);
-      BasicBlock *afterBB = BasicBlock::Create(Context, "array_iter.after", curFunc);
-      
-      Builder.CreateBr(condBB);
-      Builder.SetInsertPoint(condBB);
-      Value *curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
-      // For arrays, compare with arraySize (1-based indexing: loop from 1 to arraySize)
-      Value *cond = Builder.CreateICmpSLE(curIndex, ConstantInt::get(Type::getInt32Ty(Context), arraySize), "array_iter_cond");
-      Builder.CreateCondBr(cond, bodyBB, afterBB);
-      
-      Builder.SetInsertPoint(bodyBB);
-      std::vector<Value*> indices;
-      // Adjust index: subtract 1 to convert 1-based index to LLVM's 0-based index.
-      Value *adjustedIndex = Builder.CreateSub(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "adjusted_index");
-      indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-      indices.push_back(adjustedIndex);
-      Value *elemPtr = Builder.CreateGEP(arrType, AI, indices, "array_elem_ptr");
-      Value *elemVal = Builder.CreateLoad(arrType->getArrayElementType(), elemPtr, "array_elem");
-      
-      Value *loopVarAlloca = NamedValues[loopVarName];
-      if (!loopVarAlloca) {
-        loopVarAlloca = CreateEntryBlockAlloca(curFunc, loopVarName, elemVal->getType());
-        NamedValues[loopVarName] = loopVarAlloca;
-      }
-      Builder.CreateStore(elemVal, loopVarAlloca);
-      
-      // Generate the loop body (e.g. print(c);)
-      generateIR(node->right, curFunc);
-      
-      curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
-      Value *nextIndex = Builder.CreateAdd(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "next_index");
-      Builder.CreateStore(nextIndex, indexAlloca);
-      Builder.CreateBr(condBB);
-      
-      Builder.SetInsertPoint(afterBB);
-      return ConstantInt::get(Type::getInt32Ty(Context), 0);
+    // `loop i : n` with an int n parses as an iteration; it is a range loop to n.
+    if (allocatedType->isIntegerTy(32)) {
+      ASTNode *range = createASTNode(NODE_RANGE, NULL, NULL, node->left);
+      return generateIR(createASTNode(NODE_FOR_LOOP, node->value, range, node->right), currentFunction);
     }
-    // Otherwise, if the alloca holds a pointer, assume it's a string.
+    // If the alloca holds a pointer, assume it's a string.
     else if (allocatedType->isPointerTy()) {
       // Load the string pointer stored in the alloca.
       Value *strPtr = Builder.CreateLoad(allocatedType, varPtr, "str_val");
+      // The body may append to the variable; sharing makes that copy instead of
+      // reallocating the buffer being iterated.
+      strPtr = Builder.CreateCall(getStrShareFunction(), {strPtr}, "str_shared");
+      Value *strLen = Builder.CreateCall(getStrLenFunction(), {strPtr}, "str_len");
       Function *curFunc = currentFunction;
       AllocaInst *indexAlloca = CreateEntryBlockAlloca(curFunc, "string_iter_index", Type::getInt32Ty(Context));
       // Start at 1 (language is 1-based).
@@ -458,22 +3172,24 @@ if (strcmp(node->type, "ARRAY_ITERATOR") == 0) {
       Builder.CreateBr(condBB);
       Builder.SetInsertPoint(condBB);
       Value *curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
+      // The length comes from the string header, read once before the loop.
+      Value *cond = Builder.CreateICmpSLE(curIndex, strLen, "string_iter_cond");
+      Builder.CreateCondBr(cond, bodyBB, afterBB);
+      
+      Builder.SetInsertPoint(bodyBB);
       // Adjust for 1-based indexing.
       Value *adjustedIndex = Builder.CreateSub(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "adjusted_index");
       Value *charPtr = Builder.CreateGEP(Type::getInt8Ty(Context), strPtr, adjustedIndex, "char_ptr");
       Value *charVal = Builder.CreateLoad(Type::getInt8Ty(Context), charPtr, "char_val");
-      // Continue loop while the character is not null.
-      Value *cond = Builder.CreateICmpNE(charVal, ConstantInt::get(Type::getInt8Ty(Context), 0), "string_iter_cond");
-      Builder.CreateCondBr(cond, bodyBB, afterBB);
-      
-      Builder.SetInsertPoint(bodyBB);
       Value *loopVarAlloca = NamedValues[loopVarName];
       if (!loopVarAlloca) {
         loopVarAlloca = CreateEntryBlockAlloca(curFunc, loopVarName, Type::getInt8Ty(Context));
         NamedValues[loopVarName] = loopVarAlloca;
       }
       Builder.CreateStore(charVal, loopVarAlloca);
+      LoopDepth++;
       generateIR(node->right, curFunc);
+      LoopDepth--;
       
       curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
       Value *nextIndex = Builder.CreateAdd(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "next_index");
@@ -490,6 +3206,7 @@ if (strcmp(node->type, "ARRAY_ITERATOR") == 0) {
   // If varPtr is not an alloca but directly a pointer (e.g., a global string pointer)
   else if (varPtr->getType()->isPointerTy()) {
     Value *strPtr = varPtr;
+    Value *strLen = Builder.CreateCall(getStrLenFunction(), {strPtr}, "str_len");
     Function *curFunc = currentFunction;
     AllocaInst *indexAlloca = CreateEntryBlockAlloca(curFunc, "string_iter_index", Type::getInt32Ty(Context));
     Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Context), 1), indexAlloca);
@@ -501,20 +3218,22 @@ if (strcmp(node->type, "ARRAY_ITERATOR") == 0) {
     Builder.CreateBr(condBB);
     Builder.SetInsertPoint(condBB);
     Value *curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
-    Value *adjustedIndex = Builder.CreateSub(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "adjusted_index");
-    Value *charPtr = Builder.CreateGEP(Type::getInt8Ty(Context), strPtr, adjustedIndex, "char_ptr");
-    Value *charVal = Builder.CreateLoad(Type::getInt8Ty(Context), charPtr, "char_val");
-    Value *cond = Builder.CreateICmpNE(charVal, ConstantInt::get(Type::getInt8Ty(Context), 0), "string_iter_cond");
+    Value *cond = Builder.CreateICmpSLE(curIndex, strLen, "string_iter_cond");
     Builder.CreateCondBr(cond, bodyBB, afterBB);
     
     Builder.SetInsertPoint(bodyBB);
+    Value *adjustedIndex = Builder.CreateSub(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "adjusted_index");
+    Value *charPtr = Builder.CreateGEP(Type::getInt8Ty(Context), strPtr, adjustedIndex, "char_ptr");
+    Value *charVal = Builder.CreateLoad(Type::getInt8Ty(Context), charPtr, "char_val");
     Value *loopVarAlloca = NamedValues[node->value];
     if (!loopVarAlloca) {
       loopVarAlloca = CreateEntryBlockAlloca(curFunc, node->value, Type::getInt8Ty(Context));
       NamedValues[node->value] = loopVarAlloca;
     }
     Builder.CreateStore(charVal, loopVarAlloca);
+    LoopDepth++;
     generateIR(node->right, curFunc);
+    LoopDepth--;
     
     curIndex = Builder.CreateLoad(Type::getInt32Ty(Context), indexAlloca, "cur_index");
     Value *nextIndex = Builder.CreateAdd(curIndex, ConstantInt::get(Type::getInt32Ty(Context), 1), "next_index");
@@ -531,16 +3250,19 @@ if (strcmp(node->type, "ARRAY_ITERATOR") == 0) {
 
   
   // --- New branch for INPUT_EXPR ---
-  if (strcmp(node->type, "INPUT_EXPR") == 0) {
+  case NODE_INPUT_EXPR: {
     return generateInputExpr(node, currentFunction);
   }
   
 // --- ARRAY_ACCESS --- (Modified to support both arrays and strings)
-if (strcmp(node->type, "ARRAY_ACCESS") == 0) {
+case NODE_ARRAY_ACCESS: {
   std::string varName = node->value;
   Value *varPtr = NamedValues[varName];
   if (!varPtr)
        report_fatal_error(Twine("Error: Unknown variable '") + varName + "'");
+  // Arrays index their elements directly.
+  if (const ArrayInfo *info = lookupArray(varPtr))
+    return emitArrayLoadAt(varPtr, *info, emitArrayIndices(node->left, currentFunction));
   Value *indexVal = generateIR(node->left, currentFunction);
   // Adjust for 1-based indexing: subtract 1 from index
   indexVal = Builder.CreateSub(indexVal, ConstantInt::get(Type::getInt32Ty(Context), 1), "index_adj");
@@ -548,16 +3270,8 @@ if (strcmp(node->type, "ARRAY_ACCESS") == 0) {
   // If variable is an alloca, check its allocated type:
   if (AllocaInst *AI = dyn_cast<AllocaInst>(varPtr)) {
     Type* allocatedType = AI->getAllocatedType();
-    // If it's truly an array, use two indices.
-    if (allocatedType->isArrayTy()) {
-      std::vector<Value*> indices;
-      indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-      indices.push_back(indexVal);
-      Value *elemPtr = Builder.CreateGEP(allocatedType, varPtr, indices, "arrayelem");
-      return Builder.CreateLoad(allocatedType->getArrayElementType(), elemPtr, "load_array_elem");
-    }
-    // Otherwise, assume the alloca holds a pointer (e.g. a string)
-    else if (allocatedType->isPointerTy()) {
+    // Assume the alloca holds a pointer (e.g. a string)
+    if (allocatedType->isPointerTy()) {
       // Load the pointer stored in the alloca
       Value *ptrVal = Builder.CreateLoad(allocatedType, varPtr, "ptr_val");
       Value *charPtr = Builder.CreateGEP(Type::getInt8Ty(Context), ptrVal, indexVal, "gep_char");
@@ -577,15 +3291,37 @@ if (strcmp(node->type, "ARRAY_ACCESS") == 0) {
   }
 }
   
+// --- ARRAY_ASSIGN ---
+case NODE_ARRAY_ASSIGN: {
+  std::string varName = node->value;
+  Value *varPtr = NamedValues[varName];
+  const ArrayInfo *info = varPtr ? lookupArray(varPtr) : nullptr;
+  if (!info)
+    report_fatal_error(Twine("Error: Unknown array '") + varName + "'");
+  std::vector<Value*> indices = emitArrayIndices(node->left, currentFunction);
+  Value *val = emitElementCast(generateIR(node->right, currentFunction), info->elemType);
+  // The element address is taken after the value, which may have grown the array.
+  emitArrayStoreAt(varPtr, *info, indices, val);
+  return val;
+}
+  
     // --- Identifier lookup ---
-    if (strcmp(node->type, "IDENTIFIER") == 0) {
+    case NODE_IDENTIFIER: {
       Value* varPtr = NamedValues[node->value];
       if (!varPtr) {
         report_fatal_error(Twine("Error: Unknown variable '") + node->value + "'");
       }
-      // If the variable is stored in an alloca, load it.
-      if (AllocaInst *alloca = dyn_cast<AllocaInst>(varPtr))
-        return Builder.CreateLoad(alloca->getAllocatedType(), varPtr, node->value);
+      // A copy of a task handle would outlive the frame await() frees.
+      if (lookupTask(varPtr))
+        report_fatal_error(Twine("'") + node->value + "' is a task handle; it can only be passed to await()");
+      // If the variable is stored in an alloca, load it. A string read here
+      // may be kept elsewhere, so its builder buffer stops being appendable.
+      if (AllocaInst *alloca = dyn_cast<AllocaInst>(varPtr)) {
+        Value *val = Builder.CreateLoad(alloca->getAllocatedType(), varPtr, node->value);
+        if (val->getType() == getStringType())
+          val = Builder.CreateCall(getStrShareFunction(), {val}, "shared");
+        return val;
+      }
       else {
         PointerType *ptrType = dyn_cast<PointerType>(varPtr->getType());
         if (!ptrType || ptrType->getNumContainedTypes() < 1)
@@ -600,8 +3336,8 @@ if (strcmp(node->type, "ARRAY_ACCESS") == 0) {
 // - If it's already a 32-bit int, it returns it.
 // - If it's an 8-bit int (char), it zero‑extends it to a 32-bit int.
 // - If it's a string (i8*), it calls string_to_int.
-if (strcmp(node->type, "CAST_INT") == 0) {
-  Value *exprVal = generateIR(node->left, currentFunction);
+case NODE_CAST_INT: {
+  Value *exprVal = generateTransientRead(node->left, currentFunction);
   if (exprVal->getType()->isFloatTy())
     return Builder.CreateFPToSI(exprVal, Type::getInt32Ty(Context), "fp_to_int");
   else if (exprVal->getType()->isIntegerTy(32))
@@ -623,7 +3359,7 @@ if (strcmp(node->type, "CAST_INT") == 0) {
 // If the expression is already a string (i8*), returns it.
 // If it is a 32-bit integer, calls int_to_string.
 // If it is an 8-bit integer (char), calls char_to_string.
-if (strcmp(node->type, "CAST_STRING") == 0) {
+case NODE_CAST_STRING: {
   Value *exprVal = generateIR(node->left, currentFunction);
   // Already a string? (Assuming string type is represented as i8*)
   if (exprVal->getType()->isPointerTy() &&
@@ -638,7 +3374,8 @@ if (strcmp(node->type, "CAST_STRING") == 0) {
   // If it's an 8-bit int, assume it's a char.
   else if (exprVal->getType()->isIntegerTy(8)) {
     Function *toStr = getCharToStrFunction();
-    return Builder.CreateCall(toStr, {exprVal}, "char_to_str");
+    Value *charArg = Builder.CreateZExt(exprVal, Type::getInt32Ty(Context), "chararg");
+    return Builder.CreateCall(toStr, {charArg}, "char_to_str");
   }
   else {
     report_fatal_error("Conversion Error: Expression cannot be converted to string");
@@ -648,7 +3385,7 @@ if (strcmp(node->type, "CAST_STRING") == 0) {
 
 // --- Type Conversion: CAST_FLOAT ---
 // Converts an expression to a float
-if (strcmp(node->type, "CAST_FLOAT") == 0) {
+case NODE_CAST_FLOAT: {
   Value *exprVal = generateIR(node->left, currentFunction);
   if (exprVal->getType()->isIntegerTy(32))
     return Builder.CreateSIToFP(exprVal, Type::getFloatTy(Context), "int_to_fp");
@@ -663,7 +3400,7 @@ if (strcmp(node->type, "CAST_FLOAT") == 0) {
 // Converts an expression to char.
 // If the expression is a 32-bit int, it truncates it to 8 bits.
 // If it's already a char (8-bit int), it returns the value.
-if (strcmp(node->type, "CAST_CHAR") == 0) {
+case NODE_CAST_CHAR: {
   Value *exprVal = generateIR(node->left, currentFunction);
   if (exprVal->getType()->isIntegerTy(8))
     return exprVal;
@@ -675,7 +3412,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
 }
   
   // --- Unary minus ---
-  if (strcmp(node->type, "NEG") == 0) {
+  case NODE_NEG: {
     Value *val = generateIR(node->left, currentFunction);
     if (val->getType()->isFloatTy())
       return Builder.CreateFNeg(val, "fnegtmp");
@@ -684,25 +3421,27 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Binary Arithmetic Operations ---
-  if (strcmp(node->type, "ADD") == 0) {
-    Value *L = generateIR(node->left, currentFunction);
-    Value *R = generateIR(node->right, currentFunction);
-    if (L->getType() == PointerType::get(Type::getInt8Ty(Context), 0) &&
-        R->getType() == PointerType::get(Type::getInt8Ty(Context), 0)) {
-      Function *concatFunc = getConcatFunction();
-      return Builder.CreateCall(concatFunc, {L, R}, "concat");
-    }
-    if (L->getType()->isFloatTy() && R->getType()->isIntegerTy())
-      R = Builder.CreateSIToFP(R, Type::getFloatTy(Context), "intToFloat");
-    else if (L->getType()->isIntegerTy() && R->getType()->isFloatTy())
-      L = Builder.CreateSIToFP(L, Type::getFloatTy(Context), "intToFloat");
-      
-    if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
-      return Builder.CreateFAdd(L, R, "faddtmp");
-    return Builder.CreateAdd(L, R, "addtmp");
+  case NODE_ADD: {
+    // A left-deep chain is evaluated left to right; when every operand is a
+    // string and there are three or more, they are concatenated in one go.
+    std::vector<ASTNode*> operands;
+    collectAddChain(node, operands);
+    std::vector<Value*> vals;
+    bool allStrings = true;
+    for (ASTNode *operand : operands) {
+      Value *val = generateTransientRead(operand, currentFunction);
+      allStrings = allStrings && val->getType() == getStringType();
+      vals.push_back(val);
+    }
+    if (allStrings && vals.size() > 2)
+      return emitConcatN(vals, currentFunction);
+    Value *result = vals[0];
+    for (size_t i = 1; i < vals.size(); i++)
+      result = emitAdd(result, vals[i]);
+    return result;
   }
   
-  if (strcmp(node->type, "SUB") == 0) {
+  case NODE_SUB: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -710,7 +3449,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return Builder.CreateSub(L, R, "subtmp");
   }
   
-  if (strcmp(node->type, "MUL") == 0) {
+  case NODE_MUL: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -718,7 +3457,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return Builder.CreateMul(L, R, "multmp");
   }
   
-  if (strcmp(node->type, "DIV") == 0) {
+  case NODE_DIV: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -727,7 +3466,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Relational Operators ---
-  if (strcmp(node->type, "LT") == 0) {
+  case NODE_LT: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -736,7 +3475,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
       return Builder.CreateICmpSLT(L, R, "cmptmp");
   }
   
-  if (strcmp(node->type, "GT") == 0) {
+  case NODE_GT: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -745,7 +3484,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
       return Builder.CreateICmpSGT(L, R, "cmptmp");
   }
   
-  if (strcmp(node->type, "LE") == 0) {
+  case NODE_LE: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -754,7 +3493,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
       return Builder.CreateICmpSLE(L, R, "cmptmp");
   }
   
-  if (strcmp(node->type, "GE") == 0) {
+  case NODE_GE: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -763,7 +3502,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
       return Builder.CreateICmpSGE(L, R, "cmptmp");
   }
   
-  if (strcmp(node->type, "EQ") == 0) {
+  case NODE_EQ: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -773,20 +3512,20 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Logical Operators ---
-  if (strcmp(node->type, "AND") == 0) {
+  case NODE_AND: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     return Builder.CreateAnd(L, R, "andtmp");
   }
   
-  if (strcmp(node->type, "OR") == 0) {
+  case NODE_OR: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     return Builder.CreateOr(L, R, "ortmp");
   }
   
   // --- Not Equals ---
-  if (strcmp(node->type, "NE") == 0) {
+  case NODE_NE: {
     Value *L = generateIR(node->left, currentFunction);
     Value *R = generateIR(node->right, currentFunction);
     if (L->getType()->isFloatTy() && R->getType()->isFloatTy())
@@ -796,7 +3535,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Unary NOT ---
-  if (strcmp(node->type, "NOT") == 0) {
+  case NODE_NOT: {
     Value *val = generateIR(node->left, currentFunction);
     if (val->getType()->isIntegerTy() && val->getType()->getIntegerBitWidth() == 1)
       return Builder.CreateNot(val, "nottmp");
@@ -804,38 +3543,31 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Assignments ---
-  if (strcmp(node->type, "ASSIGN_INT") == 0 ||
-      strcmp(node->type, "ASSIGN_FLOAT") == 0 ||
-      strcmp(node->type, "ASSIGN_BOOL") == 0 ||
-      strcmp(node->type, "ASSIGN_CHAR") == 0 ||
-      strcmp(node->type, "ASSIGN_STRING") == 0) {
+  case NODE_ASSIGN_INT: case NODE_ASSIGN_FLOAT: case NODE_ASSIGN_BOOL: case NODE_ASSIGN_CHAR: case NODE_ASSIGN_STRING: {
     std::string varName = node->value;
+    if (node->kind == NODE_ASSIGN_STRING)
+      if (Value *appended = emitStringSelfAppend(node->value, node->left, currentFunction))
+        return appended;
     Value *exprVal = generateIR(node->left, currentFunction);
     Value *varPtr = NamedValues[varName];
     if (!varPtr) {
-      if (strcmp(node->type, "ASSIGN_INT") == 0)
+      if (node->kind == NODE_ASSIGN_INT)
         varPtr = CreateEntryBlockAlloca(currentFunction, varName, Type::getInt32Ty(Context));
-      else if (strcmp(node->type, "ASSIGN_FLOAT") == 0)
+      else if (node->kind == NODE_ASSIGN_FLOAT)
         varPtr = CreateEntryBlockAlloca(currentFunction, varName, Type::getFloatTy(Context));
-      else if (strcmp(node->type, "ASSIGN_BOOL") == 0)
+      else if (node->kind == NODE_ASSIGN_BOOL)
         varPtr = CreateEntryBlockAlloca(currentFunction, varName, Type::getInt1Ty(Context));
-      else if (strcmp(node->type, "ASSIGN_CHAR") == 0)
+      else if (node->kind == NODE_ASSIGN_CHAR)
         varPtr = CreateEntryBlockAlloca(currentFunction, varName, Type::getInt8Ty(Context));
-      else if (strcmp(node->type, "ASSIGN_STRING") == 0)
+      else if (node->kind == NODE_ASSIGN_STRING)
         varPtr = CreateEntryBlockAlloca(currentFunction, varName, PointerType::get(Type::getInt8Ty(Context), 0));
       NamedValues[varName] = varPtr;
     }
-    if (strcmp(node->type, "ASSIGN_FLOAT") == 0) {
+    if (node->kind == NODE_ASSIGN_FLOAT) {
       if (exprVal->getType()->isIntegerTy())
         exprVal = Builder.CreateSIToFP(exprVal, Type::getFloatTy(Context), "intToFloat");
     }
-      if (strcmp(node->type, "ASSIGN_STRING") == 0) {
-      Value *exprVal = generateIR(node->left, currentFunction);
-      Value *varPtr = NamedValues[node->value];
-      if (!varPtr) {
-        varPtr = CreateEntryBlockAlloca(currentFunction, node->value, PointerType::get(Type::getInt8Ty(Context), 0));
-        NamedValues[node->value] = varPtr;
-      }
+      if (node->kind == NODE_ASSIGN_STRING) {
       // exprVal should be an i8* (from a STRING_LITERAL)
       Value *strVal = Builder.CreateBitCast(exprVal, PointerType::get(Type::getInt8Ty(Context), 0), "strcast");
       Builder.CreateStore(strVal, varPtr);
@@ -846,12 +3578,18 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return exprVal;
   }
   
-  if (strcmp(node->type, "REASSIGN") == 0) {
+  case NODE_REASSIGN: {
     std::string varName = node->value;
     Value *varPtr = NamedValues[varName];
     if (!varPtr) {
       report_fatal_error(Twine("Error: Undeclared variable '") + varName + "'");
     }
+    if (lookupTask(varPtr))
+      report_fatal_error(Twine("'") + varName + "' is a task handle and cannot be assigned to");
+    if (Value *appended = emitStringSelfAppend(node->value, node->left, currentFunction))
+      return appended;
+    if (const ArrayInfo *info = lookupArray(varPtr))
+      return generateArrayAssign(varPtr, *info, node->left, currentFunction);
     Value *exprVal = generateIR(node->left, currentFunction);
     if (AllocaInst *AI = dyn_cast<AllocaInst>(varPtr)) {
       if (AI->getAllocatedType()->isFloatTy() && exprVal->getType()->isIntegerTy())
@@ -865,73 +3603,21 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- PRINT ---
-  if (strcmp(node->type, "PRINT") == 0) {
-    Value *exprVal = generateIR(node->left, currentFunction);
-    Type *exprType = exprVal->getType();
-    GlobalVariable *fmtStrVar = nullptr;
-    if (exprType->isIntegerTy(1)) {
-      GlobalVariable *trueStr = TheModule->getNamedGlobal(".str_true");
-      if (!trueStr) {
-        Constant *tstr = ConstantDataArray::getString(Context, "true", true);
-        trueStr = new GlobalVariable(*TheModule, tstr->getType(), true,
-                                   GlobalValue::PrivateLinkage, tstr, ".str_true");
-      }
-      GlobalVariable *falseStr = TheModule->getNamedGlobal(".str_false");
-      if (!falseStr) {
-        Constant *fstr = ConstantDataArray::getString(Context, "false", true);
-        falseStr = new GlobalVariable(*TheModule, fstr->getType(), true,
-                                    GlobalValue::PrivateLinkage, fstr, ".str_false");
-      }
-      Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-      std::vector<Constant*> indices = {zero, zero};
-      Constant *trueStrPtr = ConstantExpr::getGetElementPtr(trueStr->getValueType(), trueStr, indices);
-      Constant *falseStrPtr = ConstantExpr::getGetElementPtr(falseStr->getValueType(), falseStr, indices);
-      Value *boolStr = Builder.CreateSelect(exprVal, trueStrPtr, falseStrPtr, "boolstr");
-      GlobalVariable *fmtStrVarBool = TheModule->getNamedGlobal(".str_bool");
-      if (!fmtStrVarBool) {
-        Constant *formatStr = ConstantDataArray::getString(Context, "%s\n", true);
-        fmtStrVarBool = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                           GlobalValue::PrivateLinkage, formatStr, ".str_bool");
-      }
-      fmtStrVar = fmtStrVarBool;
-      exprVal = boolStr;
-    } else if (exprType->isFloatTy()) {
-      fmtStrVar = getFormatStringFloat();
-      exprVal = Builder.CreateFPExt(exprVal, Type::getDoubleTy(Context), "toDouble");
-    } else if (exprType->isIntegerTy(8)) {
-      fmtStrVar = getFormatStringChar();
-    } else if (exprType->isPointerTy()) {
-      if (exprType == PointerType::get(Type::getInt8Ty(Context), 0))
-        fmtStrVar = getFormatStringStr();
-      else
-        fmtStrVar = getFormatStringInt();
-    } else {
-      fmtStrVar = getFormatStringInt();
-    }
-    Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-    std::vector<Constant*> indices = {zero, zero};
-    Constant *fmtStrPtr = ConstantExpr::getGetElementPtr(fmtStrVar->getValueType(), fmtStrVar, indices);
-    Builder.CreateCall(getPrintfFunction(), {fmtStrPtr, exprVal});
+  case NODE_PRINT: {
+    Value *exprVal = generateTransientRead(node->left, currentFunction);
+    emitWriteValue(exprVal);
+    Builder.CreateCall(getWriteNewlineFunction());
     return exprVal;
   }
 
-    // --- PRINT_NEWLINE ---
-    if (strcmp(node->type, "PRINT_NEWLINE") == 0) {
-      Constant *newlineStr = ConstantDataArray::getString(Context, "\n", true);
-      GlobalVariable *nlVar = TheModule->getNamedGlobal(".str_newline");
-      if (!nlVar) {
-        nlVar = new GlobalVariable(*TheModule, newlineStr->getType(), true,
-        GlobalValue::PrivateLinkage, newlineStr, ".str_newline");
-      }
-      Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-      std::vector<Constant*> indices = {zero, zero};
-      Constant *nlPtr = ConstantExpr::getGetElementPtr(nlVar->getValueType(), nlVar, indices);
-      Builder.CreateCall(getPrintfFunction(), {nlPtr});
-      return ConstantInt::get(Type::getInt32Ty(Context), 0);
-    }
+  // --- PRINT_NEWLINE ---
+  case NODE_PRINT_NEWLINE: {
+    Builder.CreateCall(getWriteNewlineFunction());
+    return ConstantInt::get(Type::getInt32Ty(Context), 0);
+  }
   
   // --- INPUT ---
-  if (strcmp(node->type, "INPUT") == 0) {
+  case NODE_INPUT: {
     std::string varName = node->value;
     Value *varPtr = NamedValues[varName];
     if (!varPtr) {
@@ -953,21 +3639,19 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
                  allocatedType == PointerType::get(Type::getInt8Ty(Context), 0)) {
         inputVal = Builder.CreateCall(getReadStringFunction(), {}, "readStr");
       } else {
-        GlobalVariable *fmtStrVar = getFormatStringStr();
-        Constant *errMsg = Builder.CreateGlobalStringPtr("Input Is not of the expected type\n", "errMsg");
-        Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-        std::vector<Constant*> indices = {zero, zero};
-        Constant *fmtStrPtr = ConstantExpr::getGetElementPtr(fmtStrVar->getValueType(), fmtStrVar, indices);
-        Builder.CreateCall(getPrintfFunction(), {fmtStrPtr, errMsg});
+        Constant *errMsg = getStringConstant("Input Is not of the expected type");
+        emitWriteValue(errMsg);
+        Builder.CreateCall(getWriteNewlineFunction());
         inputVal = ConstantInt::get(Type::getInt32Ty(Context), 0);
       }
       Builder.CreateStore(inputVal, varPtr);
       return inputVal;
     }
+    return nullptr;
   }
   
   // --- LOOP ---
-  if (strcmp(node->type, "LOOP") == 0) {
+  case NODE_LOOP: {
     Value *loopCountVal = generateIR(node->left, currentFunction);
     if (!loopCountVal) {
       std::cerr << "Error: Invalid loop count expression\n";
@@ -987,7 +3671,9 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Value *cond = Builder.CreateICmpSLT(currVal, loopCountVal, "loopcond");
     Builder.CreateCondBr(cond, loopBodyBB, afterLoopBB);
     Builder.SetInsertPoint(loopBodyBB);
+    LoopDepth++;
     generateIR(node->right, currentFunction);
+    LoopDepth--;
     Value *nextVal = Builder.CreateAdd(currVal, ConstantInt::get(Type::getInt32Ty(Context), 1), "inc");
     Builder.CreateStore(nextVal, loopVar);
     Builder.CreateBr(loopCondBB);
@@ -996,7 +3682,10 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- LOOP_UNTIL ---
-  if (strcmp(node->type, "LOOP_UNTIL") == 0) {
+  case NODE_PARALLEL_LOOP:
+    return generateParallelLoop(node, currentFunction);
+
+  case NODE_LOOP_UNTIL: {
     BasicBlock *condBB = BasicBlock::Create(Context, "until.cond", currentFunction);
     BasicBlock *loopBB = BasicBlock::Create(Context, "until.body", currentFunction);
     BasicBlock *afterBB = BasicBlock::Create(Context, "until.after", currentFunction);
@@ -1008,13 +3697,15 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Value *notCond = Builder.CreateNot(condVal, "untilnot");
     Builder.CreateCondBr(notCond, loopBB, afterBB);
     Builder.SetInsertPoint(loopBB);
+    LoopDepth++;
     generateIR(node->right, currentFunction);
+    LoopDepth--;
     Builder.CreateBr(condBB);
     Builder.SetInsertPoint(afterBB);
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   // --- SWITCH-CASE ---
-  if (strcmp(node->type, "SWITCH") == 0) {
+  case NODE_SWITCH: {
     Value *switchVal = generateIR(node->left, currentFunction);
     if (!switchVal->getType()->isIntegerTy(32))
       switchVal = Builder.CreateIntCast(switchVal, Type::getInt32Ty(Context), true, "switchcond");
@@ -1032,19 +3723,9 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Builder.SetInsertPoint(curBB);
     SwitchInst *switchInst = Builder.CreateSwitch(switchVal, defaultBB, 0);
     
-    std::vector<ASTNode*> caseNodes;
-    std::function<void(ASTNode*)> collectCases = [&](ASTNode *n) {
-         if (!n) return;
-         if (strcmp(n->type, "CASE") == 0)
-             caseNodes.push_back(n);
-         else if (strcmp(n->type, "CASE_LIST") == 0) {
-             collectCases(n->left);
-             collectCases(n->right);
-         }
-    };
-    collectCases(caseList);
-    
-    for (ASTNode *caseNode : caseNodes) {
+    for (ASTNode *caseNode : listItems(caseList)) {
+         if (caseNode->kind != NODE_CASE)
+             continue;
          Value *caseLiteral = generateIR(caseNode->left, currentFunction);
          ConstantInt *caseConst = dyn_cast<ConstantInt>(caseLiteral);
          if (!caseConst) {
@@ -1072,15 +3753,14 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- STATEMENT_LIST ---
-  if (strcmp(node->type, "STATEMENT_LIST") == 0) {
-    if (node->left)
-      generateIR(node->left, currentFunction);
-    if (node->right)
-      return generateIR(node->right, currentFunction);
-    return nullptr;
+  case NODE_STATEMENT_LIST: {
+    Value *last = nullptr;
+    for (ASTNode *stmt : listItems(node))
+      last = generateIR(stmt, currentFunction);
+    return last;
   }
   // --- VAR_DECL ---
-  if (strcmp(node->type, "VAR_DECL") == 0) {
+  case NODE_VAR_DECL: {
     std::string varName = node->value;
     if (NamedValues.find(varName) != NamedValues.end()) {
       std::cerr << "Variable " << varName << " already declared!" << std::endl;
@@ -1095,291 +3775,107 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Value *varPtr = CreateEntryBlockAlloca(currentFunction, varName, varType);
     NamedValues[varName] = varPtr;
     Builder.CreateStore(exprVal, varPtr);
+    if (node->left->kind == NODE_SPAWN)
+      TaskVars[varPtr] = TaskFrames[TheModule->getFunction(node->left->value)];
+    Type *chanElemType;
+    if (lookupChanVar(node->left, chanElemType))
+      ChanVars[varPtr] = chanElemType;
     return exprVal;
   }
-  // --- Array Declarations for INT ---
-  if (strcmp(node->type, "DECL_ARRAY") == 0) {
-    std::string varName = node->value;
-    Value *sizeVal = generateIR(node->left, currentFunction);
-    if (!sizeVal)
-      report_fatal_error("Invalid array size expression");
-    if (!sizeVal->getType()->isIntegerTy(32))
-      sizeVal = Builder.CreateIntCast(sizeVal, Type::getInt32Ty(Context), true, "arraysize");
-    if (ConstantInt *CI = dyn_cast<ConstantInt>(sizeVal)) {
-      unsigned arraySize = CI->getZExtValue();
-      ArrayType *arrType = ArrayType::get(Type::getInt32Ty(Context), arraySize);
-      AllocaInst *varPtr = Builder.CreateAlloca(arrType, nullptr, varName);
-      NamedValues[varName] = varPtr;
-      return varPtr;
-    } else {
-      report_fatal_error("Only constant array sizes are supported in DECL_ARRAY");
+  // --- Array Declarations ---
+  // A constant size gives a fixed array; any other size, or an array the
+  // function pushes onto, gets a runtime-allocated vector. A multi-dimensional
+  // array has an INDEX_LIST of extents.
+  case NODE_DECL_ARRAY: case NODE_DECL_ARRAY_FLOAT: case NODE_DECL_ARRAY_BOOL:
+  case NODE_DECL_ARRAY_CHAR: case NODE_DECL_ARRAY_STRING: {
+    ArrayRef<ASTNode*> sizeNodes = node->left->kind == NODE_INDEX_LIST ? listItems(node->left)
+                                                                       : ArrayRef<ASTNode*>(node->left);
+    std::vector<Value*> dims;
+    for (ASTNode *sizeNode : sizeNodes) {
+      Value *sizeVal = generateIR(sizeNode, currentFunction);
+      if (!sizeVal)
+        report_fatal_error("Invalid array size expression");
+      dims.push_back(sizeVal);
     }
+    return declareArray(node->value, getArrayElementType(node->kind), dims, true, currentFunction);
   }
-  if (strcmp(node->type, "DECL_ARRAY_INIT") == 0) {
-    std::string varName = node->value;
-    int count = 0;
-    std::function<void(ASTNode*)> countElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             countElements(n->left);
-             countElements(n->right);
-         } else {
-             count++;
-         }
-    };
-    countElements(node->left);
-    Value *countVal = ConstantInt::get(Type::getInt32Ty(Context), count);
-    AllocaInst *varPtr = Builder.CreateAlloca(ArrayType::get(Type::getInt32Ty(Context), count), nullptr, varName);
-    NamedValues[varName] = varPtr;
-    int index = 0;
-    std::function<void(ASTNode*)> storeElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             storeElements(n->left);
-             storeElements(n->right);
-         } else {
-             Value *elemVal = generateIR(n, currentFunction);
-             std::vector<Value*> indices;
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), index));
-             AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-             if (!AI)
-               report_fatal_error("Array variable is not an alloca!");
-             Value *elemPtr = Builder.CreateGEP(AI->getAllocatedType(), varPtr, indices, "arrayelem");
-             Builder.CreateStore(elemVal, elemPtr);
-             index++;
-         }
-    };
-    storeElements(node->left);
-    return varPtr;
-  }
-  
-  // --- Array Declarations for FLOAT ---
-  if (strcmp(node->type, "DECL_ARRAY_INIT_FLOAT") == 0) {
-    std::string varName = node->value;
-    int count = 0;
-    std::function<void(ASTNode*)> countElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             countElements(n->left);
-             countElements(n->right);
-         } else {
-             count++;
-         }
-    };
-    countElements(node->left);
-    Value *countVal = ConstantInt::get(Type::getInt32Ty(Context), count);
-    AllocaInst *varPtr = Builder.CreateAlloca(ArrayType::get(Type::getFloatTy(Context), count), nullptr, varName);
-    NamedValues[varName] = varPtr;
+  case NODE_DECL_ARRAY_INIT: case NODE_DECL_ARRAY_INIT_FLOAT: case NODE_DECL_ARRAY_INIT_BOOL:
+  case NODE_DECL_ARRAY_INIT_CHAR: case NODE_DECL_ARRAY_INIT_STRING: {
+    Type *elemType = getArrayElementType(node->kind);
+    ArrayRef<ASTNode*> elements = listItems(node->left);
+    Value *countVal = ConstantInt::get(Type::getInt32Ty(Context), elements.size());
+    Value *varPtr = declareArray(node->value, elemType, countVal, false, currentFunction);
+    const ArrayInfo &info = ArrayVars[varPtr];
     int index = 0;
-    std::function<void(ASTNode*)> storeElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             storeElements(n->left);
-             storeElements(n->right);
-         } else {
-             Value *elemVal = generateIR(n, currentFunction);
-             if (elemVal->getType()->isIntegerTy())
-                elemVal = Builder.CreateSIToFP(elemVal, Type::getFloatTy(Context), "intToFloat");
-             std::vector<Value*> indices;
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), index));
-             AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-             if (!AI)
-               report_fatal_error("Array variable is not an alloca!");
-             Value *elemPtr = Builder.CreateGEP(AI->getAllocatedType(), varPtr, indices, "arrayelem");
-             Builder.CreateStore(elemVal, elemPtr);
-             index++;
-         }
-    };
-    storeElements(node->left);
-    return varPtr;
-  }
-  
-  // --- Array Declarations for BOOL ---
-  if (strcmp(node->type, "DECL_ARRAY_BOOL") == 0) {
-    std::string varName = node->value;
-    Value *sizeVal = generateIR(node->left, currentFunction);
-    if (!sizeVal)
-      report_fatal_error("Invalid array size expression");
-    if (!sizeVal->getType()->isIntegerTy(32))
-      sizeVal = Builder.CreateIntCast(sizeVal, Type::getInt32Ty(Context), true, "arraysize");
-    if (ConstantInt *CI = dyn_cast<ConstantInt>(sizeVal)) {
-      unsigned arraySize = CI->getZExtValue();
-      ArrayType *arrType = ArrayType::get(Type::getInt1Ty(Context), arraySize);
-      AllocaInst *varPtr = Builder.CreateAlloca(arrType, nullptr, varName);
-      NamedValues[varName] = varPtr;
-      return varPtr;
-    } else {
-      report_fatal_error("Only constant array sizes are supported in DECL_ARRAY_BOOL");
+    for (ASTNode *n : elements) {
+      Value *elemVal = emitElementCast(generateIR(n, currentFunction), elemType);
+      emitArrayStore(varPtr, info, ConstantInt::get(Type::getInt32Ty(Context), index), elemVal);
+      index++;
     }
-  }
-  
-  if (strcmp(node->type, "DECL_ARRAY_INIT_BOOL") == 0) {
-    std::string varName = node->value;
-    int count = 0;
-    std::function<void(ASTNode*)> countElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             countElements(n->left);
-             countElements(n->right);
-         } else {
-             count++;
-         }
-    };
-    countElements(node->left);
-    Value *countVal = ConstantInt::get(Type::getInt32Ty(Context), count);
-    AllocaInst *varPtr = Builder.CreateAlloca(ArrayType::get(Type::getInt1Ty(Context), count), nullptr, varName);
-    NamedValues[varName] = varPtr;
-    int index = 0;
-    std::function<void(ASTNode*)> storeElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             storeElements(n->left);
-             storeElements(n->right);
-         } else {
-             Value *elemVal = generateIR(n, currentFunction);
-             if (!elemVal->getType()->isIntegerTy(1))
-                elemVal = Builder.CreateICmpNE(elemVal, ConstantInt::get(elemVal->getType(), 0), "boolcast");
-             std::vector<Value*> indices;
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), index));
-             AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-             if (!AI)
-               report_fatal_error("Array variable is not an alloca!");
-             Value *elemPtr = Builder.CreateGEP(AI->getAllocatedType(), varPtr, indices, "arrayelem");
-             Builder.CreateStore(elemVal, elemPtr);
-             index++;
-         }
-    };
-    storeElements(node->left);
     return varPtr;
   }
-  
-  // --- Array Declarations for CHAR ---
-  if (strcmp(node->type, "DECL_ARRAY_CHAR") == 0) {
-    std::string varName = node->value;
-    Value *sizeVal = generateIR(node->left, currentFunction);
-    if (!sizeVal)
-      report_fatal_error("Invalid array size expression");
-    if (!sizeVal->getType()->isIntegerTy(32))
-      sizeVal = Builder.CreateIntCast(sizeVal, Type::getInt32Ty(Context), true, "arraysize");
-    if (ConstantInt *CI = dyn_cast<ConstantInt>(sizeVal)) {
-      unsigned arraySize = CI->getZExtValue();
-      ArrayType *arrType = ArrayType::get(Type::getInt8Ty(Context), arraySize);
-      AllocaInst *varPtr = Builder.CreateAlloca(arrType, nullptr, varName);
-      NamedValues[varName] = varPtr;
-      return varPtr;
-    } else {
-      report_fatal_error("Only constant array sizes are supported in DECL_ARRAY_CHAR");
-    }
+  // --- Records ---
+  case NODE_RECORD_DEF:
+    defineRecord(node);
+    return ConstantInt::get(Type::getInt32Ty(Context), 0);
+
+  case NODE_DECL_RECORD: {
+    Type *type = getTypeFromName(node->left->value);
+    if (!lookupRecord(type))
+      report_fatal_error(Twine("'") + node->left->value + "' is not a record type");
+    AllocaInst *alloca = CreateEntryBlockAlloca(currentFunction, node->value, type);
+    Builder.CreateStore(Constant::getNullValue(type), alloca);
+    NamedValues[node->value] = alloca;
+    return alloca;
   }
-  
-  if (strcmp(node->type, "DECL_ARRAY_INIT_CHAR") == 0) {
-    std::string varName = node->value;
-    int count = 0;
-    std::function<void(ASTNode*)> countElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             countElements(n->left);
-             countElements(n->right);
-         } else {
-             count++;
-         }
-    };
-    countElements(node->left);
-    Value *countVal = ConstantInt::get(Type::getInt32Ty(Context), count);
-    AllocaInst *varPtr = Builder.CreateAlloca(ArrayType::get(Type::getInt8Ty(Context), count), nullptr, varName);
-    NamedValues[varName] = varPtr;
-    int index = 0;
-    std::function<void(ASTNode*)> storeElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             storeElements(n->left);
-             storeElements(n->right);
-         } else {
-             Value *elemVal = generateIR(n, currentFunction);
-             std::vector<Value*> indices;
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), index));
-             AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-             if (!AI)
-               report_fatal_error("Array variable is not an alloca!");
-             Value *elemPtr = Builder.CreateGEP(AI->getAllocatedType(), varPtr, indices, "arrayelem");
-             Builder.CreateStore(elemVal, elemPtr);
-             index++;
-         }
-    };
-    storeElements(node->left);
-    return varPtr;
+
+  case NODE_DECL_RECORD_ARRAY:
+  case NODE_DECL_RECORD_SOA: {
+    const RecordInfo *record = lookupRecord(getTypeFromName(node->left->value));
+    if (!record)
+      report_fatal_error(Twine("'") + node->left->value + "' is not a record type");
+    return declareRecordArray(node->value, *record, generateIR(node->right, currentFunction),
+                              node->kind == NODE_DECL_RECORD_SOA, currentFunction);
   }
-  
-  // --- Array Declarations for STRING ---
-  if (strcmp(node->type, "DECL_ARRAY_STRING") == 0) {
-    std::string varName = node->value;
-    Value *sizeVal = generateIR(node->left, currentFunction);
-    if (!sizeVal)
-      report_fatal_error("Invalid array size expression");
-    if (!sizeVal->getType()->isIntegerTy(32))
-      sizeVal = Builder.CreateIntCast(sizeVal, Type::getInt32Ty(Context), true, "arraysize");
-    if (ConstantInt *CI = dyn_cast<ConstantInt>(sizeVal)) {
-      unsigned arraySize = CI->getZExtValue();
-      ArrayType *arrType = ArrayType::get(PointerType::get(Type::getInt8Ty(Context), 0), arraySize);
-      AllocaInst *varPtr = Builder.CreateAlloca(arrType, nullptr, varName);
-      NamedValues[varName] = varPtr;
-      return varPtr;
-    } else {
-      report_fatal_error("Only constant array sizes are supported in DECL_ARRAY_STRING");
-    }
+
+  case NODE_FIELD:
+    return generateFieldAccess(node, nullptr, currentFunction);
+
+  case NODE_FIELD_ASSIGN:
+    return generateFieldAccess(node, generateIR(node->right, currentFunction), currentFunction);
+
+  // --- Slice of an array: arr[lo:hi] ---
+  case NODE_ARRAY_SLICE: {
+    Value *varPtr = NamedValues[node->value];
+    const ArrayInfo *info = varPtr ? lookupArray(varPtr) : nullptr;
+    if (!info)
+      report_fatal_error(Twine("'") + node->value + "' is not an array");
+    bool borrowed;
+    return emitSliceValue(node, getSliceType(info->elemType), borrowed, currentFunction);
   }
-  
-  if (strcmp(node->type, "DECL_ARRAY_INIT_STRING") == 0) {
-    std::string varName = node->value;
-    int count = 0;
-    std::function<void(ASTNode*)> countElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             countElements(n->left);
-             countElements(n->right);
-         } else {
-             count++;
-         }
-    };
-    countElements(node->left);
-    Value *countVal = ConstantInt::get(Type::getInt32Ty(Context), count);
-    AllocaInst *varPtr = Builder.CreateAlloca(ArrayType::get(PointerType::get(Type::getInt8Ty(Context), 0), count), nullptr, varName);
-    NamedValues[varName] = varPtr;
-    int index = 0;
-    std::function<void(ASTNode*)> storeElements = [&](ASTNode* n) {
-         if (!n) return;
-         if (strcmp(n->type, "ARRAY_ELEM_LIST") == 0) {
-             storeElements(n->left);
-             storeElements(n->right);
-         } else {
-             Value *elemVal = generateIR(n, currentFunction);
-             std::vector<Value*> indices;
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), 0));
-             indices.push_back(ConstantInt::get(Type::getInt32Ty(Context), index));
-             AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-             if (!AI)
-               report_fatal_error("Array variable is not an alloca!");
-             Value *elemPtr = Builder.CreateGEP(AI->getAllocatedType(), varPtr, indices, "arrayelem");
-             Builder.CreateStore(elemVal, elemPtr);
-             index++;
-         }
-    };
-    storeElements(node->left);
-    return varPtr;
+  // --- Slice Declaration ---
+  case NODE_DECL_SLICE: {
+    Type *elemType = getTypeFromName(node->left->value);
+    bool borrowed;
+    Value *slice = emitSliceValue(node->right, getSliceType(elemType), borrowed, currentFunction);
+    return declareSlice(node->value, elemType, slice, borrowed, currentFunction);
   }
+  // --- Map Declaration ---
+  case NODE_DECL_MAP:
+    return declareMap(node->value, getTypeFromName(node->left->value), getTypeFromName(node->right->value),
+                      currentFunction);
+
+  case NODE_DECL_CHAN:
+    return declareChan(node->value, getTypeFromName(node->left->value), node->right, currentFunction);
   
   // --- TYPE operator ---
-  if (strcmp(node->type, "TYPE") == 0) {
+  case NODE_TYPE: {
     Type *targetType = nullptr;
-    if (strcmp(node->left->type, "IDENTIFIER") == 0) {
+    if (node->left->kind == NODE_IDENTIFIER) {
       Value *varPtr = NamedValues[node->left->value];
       if (!varPtr) {
         std::cerr << "Unknown variable in type(): " << node->left->value << std::endl;
-        return Builder.CreateGlobalStringPtr("unknown", "type_unknown");
+        return getStringConstant("unknown");
       }
       if (AllocaInst *alloca = dyn_cast<AllocaInst>(varPtr))
         targetType = alloca->getAllocatedType();
@@ -1390,7 +3886,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
       targetType = temp->getType();
     }
       
-    const char *typeName = "unknown";
+    StringRef typeName = "unknown";
     if (targetType->isIntegerTy(32))
       typeName = "int";
     else if (targetType->isFloatTy())
@@ -1402,13 +3898,15 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     else if (targetType->isPointerTy() &&
              targetType == PointerType::get(Type::getInt8Ty(Context), 0))
       typeName = "string";
+    else if (const RecordInfo *record = lookupRecord(targetType))
+      typeName = record->type->getName();
       
-    Value *typeStr = Builder.CreateGlobalStringPtr(typeName, "typeStr");
+    Value *typeStr = getStringConstant(typeName);
     return typeStr;
   }
 
   // --- Specific Declarations ---
-  if (strcmp(node->type, "DECL_INT") == 0) {
+  case NODE_DECL_INT: {
     std::string varName = node->value;
     if (NamedValues.find(varName) != NamedValues.end()) {
       std::cerr << "Variable " << varName << " already declared!" << std::endl;
@@ -1419,7 +3917,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Builder.CreateStore(ConstantInt::get(Type::getInt32Ty(Context), 0), varPtr);
     return varPtr;
   }
-  if (strcmp(node->type, "DECL_FLOAT") == 0) {
+  case NODE_DECL_FLOAT: {
     std::string varName = node->value;
     if (NamedValues.find(varName) != NamedValues.end()) {
       std::cerr << "Variable " << varName << " already declared!" << std::endl;
@@ -1430,7 +3928,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Builder.CreateStore(ConstantFP::get(Type::getFloatTy(Context), 0.0), varPtr);
     return varPtr;
   }
-  if (strcmp(node->type, "DECL_BOOL") == 0) {
+  case NODE_DECL_BOOL: {
     std::string varName = node->value;
     if (NamedValues.find(varName) != NamedValues.end()) {
       std::cerr << "Variable " << varName << " already declared!" << std::endl;
@@ -1441,7 +3939,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Builder.CreateStore(ConstantInt::get(Type::getInt1Ty(Context), 0), varPtr);
     return varPtr;
   }
-  if (strcmp(node->type, "DECL_CHAR") == 0) {
+  case NODE_DECL_CHAR: {
     std::string varName = node->value;
     if (NamedValues.find(varName) != NamedValues.end()) {
       std::cerr << "Variable " << varName << " already declared!" << std::endl;
@@ -1452,7 +3950,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     Builder.CreateStore(ConstantInt::get(Type::getInt8Ty(Context), 0), varPtr);
     return varPtr;
   }
-  if (strcmp(node->type, "DECL_STRING") == 0) {
+  case NODE_DECL_STRING: {
     std::string varName = node->value;
     if (NamedValues.find(varName) != NamedValues.end()) {
       std::cerr << "Variable " << varName << " already declared!" << std::endl;
@@ -1465,7 +3963,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Conditional Constructs ---
-  if (strcmp(node->type, "IF") == 0) {
+  case NODE_IF: {
     Value *condVal = generateIR(node->left, currentFunction);
     if (!condVal) {
       std::cerr << "Error: Invalid condition in if statement\n";
@@ -1483,7 +3981,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   
-  if (strcmp(node->type, "IF_ELSE") == 0) {
+  case NODE_IF_ELSE: {
     Value *condVal = generateIR(node->left, currentFunction);
     if (!condVal) {
       std::cerr << "Error: Invalid condition in if-else statement\n";
@@ -1505,7 +4003,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   
-  if (strcmp(node->type, "IF_CHAIN") == 0) {
+  case NODE_IF_CHAIN: {
     Value *condVal = generateIR(node->left->left, currentFunction);
     if (!condVal) {
       std::cerr << "Error: Invalid condition in if-chain\n";
@@ -1527,7 +4025,7 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   
-  if (strcmp(node->type, "ELSE_IF") == 0) {
+  case NODE_ELSE_IF: {
     Value *condVal = generateIR(node->left, currentFunction);
     if (!condVal) {
       std::cerr << "Error: Invalid condition in else-if statement\n";
@@ -1550,12 +4048,12 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   
-  if (strcmp(node->type, "ELSE") == 0) {
+  case NODE_ELSE: {
     generateIR(node->left, currentFunction);
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   
-  if (strcmp(node->type, "IF_ELSE_BODY") == 0) {
+  case NODE_IF_ELSE_BODY: {
     if (node->left)
       generateIR(node->left, currentFunction);
     if (node->right)
@@ -1564,12 +4062,14 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
   }
   
   // --- Function Definition ---
-  if (strcmp(node->type, "FUNC_DEF") == 0) {
+  case NODE_FUNC_DEF: {
+    if (containsYield(node->right))
+      return generateGenerator(node);
     std::string funcName = node->value;
     std::vector<Type*> paramTypes;
     std::vector<std::string> paramNames;
     extractParams(node->left, paramTypes, paramNames);
-    FunctionType *funcType = FunctionType::get(Type::getInt32Ty(Context), paramTypes, false);
+    FunctionType *funcType = FunctionType::get(getFunctionReturnType(node), paramTypes, false);
     Function *func = Function::Create(funcType, Function::ExternalLinkage, funcName, TheModule);
     unsigned idx = 0;
     for (auto &arg : func->args()) {
@@ -1578,162 +4078,146 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     BasicBlock *BB = BasicBlock::Create(Context, "entry", func);
     std::map<std::string, Value*> oldNamedValues = NamedValues;
     NamedValues.clear();
+    GrowableArrays.clear();
+    collectGrowableArrays(node->right, GrowableArrays);
     Builder.SetInsertPoint(BB);
+    std::vector<ASTNode*> paramNodes;
+    for (ASTNode *paramNode : listItems(node->left))
+      if (paramNode->kind == NODE_PARAM)
+        paramNodes.push_back(paramNode);
+    recordChanParams(func, paramNodes);
     for (auto &arg : func->args()) {
+      // Array parameters are slices into the caller's arrays.
+      if (Type *elemType = getParamArrayElementType(paramNodes[arg.getArgNo()])) {
+        declareSlice(std::string(arg.getName()), elemType, &arg, true, func);
+        continue;
+      }
       AllocaInst *alloca = CreateEntryBlockAlloca(func, std::string(arg.getName()), arg.getType());
       Builder.CreateStore(&arg, alloca);
+      if (Type *elemType = getChanParamType(func, arg.getArgNo()))
+        ChanVars[alloca] = elemType;
       NamedValues[std::string(arg.getName())] = alloca;
     }
     generateIR(node->right, func);
-    if (!BB->getTerminator())
-      Builder.CreateRet(ConstantInt::get(Type::getInt32Ty(Context), 0));
+    if (!Builder.GetInsertBlock()->getTerminator())
+      Builder.CreateRet(Constant::getNullValue(func->getReturnType()));
+    emitArrayCleanup(func);
+    emitMapCleanup(func);
+    emitChanCleanup(func);
     NamedValues = oldNamedValues;
     return ConstantInt::get(Type::getInt32Ty(Context), 0);
   }
   
+  case NODE_MEMO:
+    return generateMemoFunction(node);
+
   // --- Return Statement ---
-  if (strcmp(node->type, "RETURN") == 0) {
-    Value *retVal = generateIR(node->left, currentFunction);
+  case NODE_RETURN: {
+    if (CurrentGenerator)
+      return generateGeneratorReturn(node, currentFunction);
+    Value *retVal;
+    if (StructType *sliceType = asSliceType(currentFunction->getReturnType())) {
+      bool borrowed;
+      retVal = emitSliceValue(node->left, sliceType, borrowed, currentFunction);
+      if (!borrowed)
+        report_fatal_error(Twine("'") + currentFunction->getName() +
+                           "' returns a local array; only slices of array parameters can be returned");
+    } else {
+      const ArrayInfo *info;
+      if (node->left->kind == NODE_ARRAY_SLICE || lookupArrayVar(node->left, info))
+        report_fatal_error(Twine("'") + currentFunction->getName() +
+                           "' returns a local array; only slices of array parameters can be returned");
+      retVal = generateIR(node->left, currentFunction);
+    }
+    emitGeneratorLoopExits();
     Builder.CreateRet(retVal);
+    // Anything after the return is unreachable; give it a block of its own.
+    Builder.SetInsertPoint(BasicBlock::Create(Context, "after.return", currentFunction));
     return retVal;
   }
   
   // --- Function Call ---
-  if (strcmp(node->type, "CALL") == 0) {
+  case NODE_CALL: {
     Function *callee = TheModule->getFunction(node->value);
+    // Builtins, unless the program defines a function with the same name.
+    if (!callee && (strcmp(node->value, "count") == 0 || strcmp(node->value, "any") == 0 ||
+                    strcmp(node->value, "all") == 0))
+      return generateBoolReduction(node->value, listItems(node->left), currentFunction);
+    if (!callee && (strcmp(node->value, "sum") == 0 || strcmp(node->value, "min") == 0 ||
+                    strcmp(node->value, "max") == 0 || strcmp(node->value, "dot") == 0))
+      return generateArrayReduction(node->value, listItems(node->left), currentFunction);
+    if (!callee && strcmp(node->value, "sort") == 0)
+      return generateSort(listItems(node->left), currentFunction);
+    if (!callee && strcmp(node->value, "await") == 0)
+      return generateAwait(listItems(node->left), currentFunction);
     if (!callee) {
       report_fatal_error("Unknown function referenced");
     }
+    if (Generators.count(callee))
+      report_fatal_error(Twine("'") + node->value + "' is a generator; use it as `loop x : " + node->value +
+                         "(...)`");
     std::vector<Value*> argsV;
-    extractArgs(node->left, argsV, currentFunction);
+    extractArgs(node->left, callee, argsV, currentFunction);
     return Builder.CreateCall(callee, argsV, "calltmp");
   }
 
+  case NODE_SPAWN:
+    return generateSpawn(node, currentFunction);
+
+  case NODE_YIELD:
+    return generateYield(node, currentFunction);
+
   // --- INLINE ---
-  if (strcmp(node->type, "INLINE") == 0) {
-    Value *exprVal = generateIR(node->left, currentFunction);
-    Type *exprType = exprVal->getType();
-    GlobalVariable *fmtStrVar = nullptr;
-    if (exprType->isIntegerTy(1)) {
-      GlobalVariable *trueStr = TheModule->getNamedGlobal(".str_true");
-      if (!trueStr) {
-        Constant *tstr = ConstantDataArray::getString(Context, "true", true);
-        trueStr = new GlobalVariable(*TheModule, tstr->getType(), true,
-                                   GlobalValue::PrivateLinkage, tstr, ".str_true");
-      }
-      GlobalVariable *falseStr = TheModule->getNamedGlobal(".str_false");
-      if (!falseStr) {
-        Constant *fstr = ConstantDataArray::getString(Context, "false", true);
-        falseStr = new GlobalVariable(*TheModule, fstr->getType(), true,
-                                    GlobalValue::PrivateLinkage, fstr, ".str_false");
-      }
-      Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-      std::vector<Constant*> indices = {zero, zero};
-      Constant *trueStrPtr = ConstantExpr::getGetElementPtr(trueStr->getValueType(), trueStr, indices);
-      Constant *falseStrPtr = ConstantExpr::getGetElementPtr(falseStr->getValueType(), falseStr, indices);
-      Value *boolStr = Builder.CreateSelect(exprVal, trueStrPtr, falseStrPtr, "boolstr");
-      GlobalVariable *fmtStrVarBool = TheModule->getNamedGlobal(".str_bool");
-      if (!fmtStrVarBool) {
-        Constant *formatStr = ConstantDataArray::getString(Context, "%s", true);
-        fmtStrVarBool = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                           GlobalValue::PrivateLinkage, formatStr, ".str_bool");
-      }
-      fmtStrVar = fmtStrVarBool;
-      exprVal = boolStr;
-    } else if (exprType->isFloatTy()) {
-      // For floats, use inline format without newline.
-      Constant *formatStr = ConstantDataArray::getString(Context, "%.1f", true);
-      GlobalVariable *fmt = TheModule->getNamedGlobal(".str_inline_float");
-      if (!fmt) {
-        fmt = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                 GlobalValue::PrivateLinkage, formatStr, ".str_inline_float");
-      }
-      fmtStrVar = fmt;
-      exprVal = Builder.CreateFPExt(exprVal, Type::getDoubleTy(Context), "toDouble");
-    } else if (exprType->isIntegerTy(8)) {
-      Constant *formatStr = ConstantDataArray::getString(Context, "%c", true);
-      GlobalVariable *fmt = TheModule->getNamedGlobal(".str_inline_char");
-      if (!fmt) {
-        fmt = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                 GlobalValue::PrivateLinkage, formatStr, ".str_inline_char");
-      }
-      fmtStrVar = fmt;
-    } else if (exprType->isPointerTy()) {
-      if (exprType == PointerType::get(Type::getInt8Ty(Context), 0)) {
-        Constant *formatStr = ConstantDataArray::getString(Context, "%s", true);
-        GlobalVariable *fmt = TheModule->getNamedGlobal(".str_inline_string");
-        if (!fmt) {
-          fmt = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                 GlobalValue::PrivateLinkage, formatStr, ".str_inline_string");
-        }
-        fmtStrVar = fmt;
-      } else {
-        Constant *formatStr = ConstantDataArray::getString(Context, "%d", true);
-        GlobalVariable *fmt = TheModule->getNamedGlobal(".str_inline_int");
-        if (!fmt) {
-          fmt = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                 GlobalValue::PrivateLinkage, formatStr, ".str_inline_int");
-        }
-        fmtStrVar = fmt;
-      }
-    } else {
-      Constant *formatStr = ConstantDataArray::getString(Context, "%d", true);
-      GlobalVariable *fmt = TheModule->getNamedGlobal(".str_inline_int");
-      if (!fmt) {
-        fmt = new GlobalVariable(*TheModule, formatStr->getType(), true,
-                                 GlobalValue::PrivateLinkage, formatStr, ".str_inline_int");
-      }
-      fmtStrVar = fmt;
-    }
-    Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-    std::vector<Constant*> indices = {zero, zero};
-    Constant *fmtStrPtr = ConstantExpr::getGetElementPtr(fmtStrVar->getValueType(), fmtStrVar, indices);
-    Builder.CreateCall(getPrintfFunction(), {fmtStrPtr, exprVal});
+  case NODE_INLINE: {
+    Value *exprVal = generateTransientRead(node->left, currentFunction);
+    emitWriteValue(exprVal);
     return exprVal;
   }
 
-    // --- PRINT_NEWLINE ---
-    if (strcmp(node->type, "PRINT_NEWLINE") == 0) {
-      Constant *newlineStr = ConstantDataArray::getString(Context, "\n", true);
-      GlobalVariable *nlVar = TheModule->getNamedGlobal(".str_newline");
-      if (!nlVar) {
-        nlVar = new GlobalVariable(*TheModule, newlineStr->getType(), true,
-        GlobalValue::PrivateLinkage, newlineStr, ".str_newline");
-      }
-      Constant *zero = ConstantInt::get(Type::getInt32Ty(Context), 0);
-      std::vector<Constant*> indices = {zero, zero};
-      Constant *nlPtr = ConstantExpr::getGetElementPtr(nlVar->getValueType(), nlVar, indices);
-      Builder.CreateCall(getPrintfFunction(), {nlPtr});
-      return ConstantInt::get(Type::getInt32Ty(Context), 0);
-    }
-
       // --- SIZE operator ---
-  if (strcmp(node->type, "SIZE") == 0) {
-    if (node->left && strcmp(node->left->type, "IDENTIFIER") == 0) {
+  case NODE_SIZE: {
+    if (node->left && node->left->kind == NODE_IDENTIFIER) {
       std::string arrName = node->left->value;
       Value *varPtr = NamedValues[arrName];
       if (!varPtr)
          report_fatal_error(Twine("Error: Unknown variable '") + arrName + "'");
+      if (const ArrayInfo *info = lookupArray(varPtr))
+         return info->rank > 1 ? emitArrayDim(varPtr, *info, 0) : emitArrayLength(varPtr, *info);
+      if (lookupMap(varPtr))
+         return Builder.CreateCall(getRuntimeFunction("cookie_map_size", Type::getInt32Ty(Context), {getMapPtrType()}),
+                                   {Builder.CreateLoad(getMapPtrType(), varPtr, "map")}, "map_size");
       AllocaInst *AI = dyn_cast<AllocaInst>(varPtr);
-      if (!AI)
-         report_fatal_error("SIZE: Variable is not an alloca!");
-      Type *allocType = AI->getAllocatedType();
-      ArrayType *arrType = dyn_cast<ArrayType>(allocType);
-      if (!arrType)
-         report_fatal_error("SIZE: Variable is not an array type!");
-      unsigned arraySize = arrType->getNumElements();
-      return ConstantInt::get(Type::getInt32Ty(Context), arraySize);
+      if (!AI || AI->getAllocatedType() != getStringType())
+         report_fatal_error("SIZE: Variable is not an array or string!");
+      Value *str = Builder.CreateLoad(getStringType(), AI, "str_val");
+      return Builder.CreateCall(getStrLenFunction(), {str}, "str_len");
+    } else if (node->left && node->left->kind == NODE_ARRAY_ACCESS && node->left->left->kind != NODE_INDEX_LIST) {
+      // size(m[i]): the length of a row of a multi-dimensional array.
+      Value *varPtr = NamedValues[node->left->value];
+      const ArrayInfo *info = varPtr ? lookupArray(varPtr) : nullptr;
+      if (!info || info->rank < 2)
+        report_fatal_error("SIZE: Argument must be an array identifier");
+      return emitArrayDim(varPtr, *info, 1);
     } else {
       report_fatal_error("SIZE: Argument must be an array identifier");
     }
   }
 
-  // --- METHOD_CALL for "at" ---
-  if (strcmp(node->type, "METHOD_CALL") == 0) {
+  // --- METHOD_CALL: "at" on strings; at/push/pop/resize on arrays; map and channel methods ---
+  case NODE_METHOD_CALL: {
     std::string methodName = node->value;
+    const ArrayInfo *info;
+    if (Value *arrPtr = lookupArrayVar(node->left, info))
+      return generateArrayMethod(node, arrPtr, *info, currentFunction);
+    const MapInfo *mapInfo;
+    if (Value *mapSlot = lookupMapVar(node->left, mapInfo))
+      return generateMapMethod(node, mapSlot, *mapInfo, currentFunction);
+    Type *chanElemType;
+    if (Value *chanSlot = lookupChanVar(node->left, chanElemType))
+      return generateChanMethod(node, chanSlot, chanElemType, currentFunction);
     if (methodName == "at") {
        // Generate IR for the object (e.g., the string)
-       Value* obj = generateIR(node->left, currentFunction);
+       Value* obj = generateTransientRead(node->left, currentFunction);
        // If the object is stored in an alloca, load its value.
        if (AllocaInst *AI = dyn_cast<AllocaInst>(obj)) {
            obj = Builder.CreateLoad(AI->getAllocatedType(), obj, "load_obj");
@@ -1749,9 +4233,17 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
        }
        
        // Generate IR for the argument (the index)
-       Value* indexVal = generateIR(node->right, currentFunction);
+       ArrayRef<ASTNode*> methodArgs = listItems(node->right);
+       if (methodArgs.size() != 1)
+           report_fatal_error("METHOD_CALL: 'at' takes exactly one index");
+       Value* indexVal = generateIR(methodArgs[0], currentFunction);
        if (!indexVal->getType()->isIntegerTy(32))
            indexVal = Builder.CreateIntCast(indexVal, Type::getInt32Ty(Context), true, "indexCast");
+       // Strings: bounds-checked access against the header length.
+       if (obj->getType() == getStringType()) {
+           Value *ch = Builder.CreateCall(getStrAtFunction(), {obj, indexVal}, "at_char");
+           return Builder.CreateTrunc(ch, Type::getInt8Ty(Context), "at_char8");
+       }
        // Adjust for 1-based indexing: subtract 1
        indexVal = Builder.CreateSub(indexVal, ConstantInt::get(Type::getInt32Ty(Context), 1), "at_index");
        
@@ -1769,44 +4261,355 @@ if (strcmp(node->type, "CAST_CHAR") == 0) {
     }
 }
 
+  default:
+    break;
+  }
   return nullptr;
 }
 
-void extractParams(ASTNode* paramNode, std::vector<Type*>& types, std::vector<std::string>& names) {
-  if (!paramNode) return;
-  if (strcmp(paramNode->type, "PARAM") == 0) {
+void extractParams(ASTNode* paramList, std::vector<Type*>& types, std::vector<std::string>& names) {
+  for (ASTNode *paramNode : listItems(paramList)) {
+    if (paramNode->kind != NODE_PARAM)
+      continue;
     std::string typeStr = (paramNode->left && paramNode->left->value) ? paramNode->left->value : "int";
-    if (typeStr == "int") types.push_back(Type::getInt32Ty(Context));
-    else if (typeStr == "float") types.push_back(Type::getFloatTy(Context));
-    else if (typeStr == "bool") types.push_back(Type::getInt1Ty(Context));
-    else if (typeStr == "char") types.push_back(Type::getInt8Ty(Context));
-    else if (typeStr == "string") types.push_back(PointerType::get(Type::getInt8Ty(Context), 0));
-    else types.push_back(Type::getInt32Ty(Context));
+    if (Type *elemType = getParamArrayElementType(paramNode))
+      types.push_back(getSliceType(elemType));
+    else
+      types.push_back(getTypeFromName(typeStr));
     names.push_back(paramNode->value);
-  } else if (strcmp(paramNode->type, "PARAM_LIST") == 0) {
-    extractParams(paramNode->left, types, names);
-    extractParams(paramNode->right, types, names);
   }
 }
 
-void extractArgs(ASTNode* argNode, std::vector<Value*>& args, Function* currentFunction) {
-  if (!argNode) return;
-  if (strcmp(argNode->type, "ARG_LIST") == 0) {
-    extractArgs(argNode->left, args, currentFunction);
-    extractArgs(argNode->right, args, currentFunction);
-  } else {
-    Value *argVal = generateIR(argNode, currentFunction);
+void extractArgs(ASTNode* argList, Function* callee, std::vector<Value*>& args, Function* currentFunction) {
+  FunctionType *calleeType = callee->getFunctionType();
+  for (ASTNode *argNode : listItems(argList)) {
+    unsigned idx = args.size();
+    StructType *sliceType = idx < calleeType->getNumParams() ? asSliceType(calleeType->getParamType(idx)) : nullptr;
+    bool borrowed;
+    Value *argVal = sliceType ? emitSliceValue(argNode, sliceType, borrowed, currentFunction)
+                              : generateIR(argNode, currentFunction);
+    Type *paramElemType = getChanParamType(callee, idx);
+    Type *argElemType;
+    lookupChanVar(argNode, argElemType);
+    if (paramElemType != argElemType) {
+      if (paramElemType)
+        report_fatal_error(Twine("argument ") + Twine(idx + 1) + " of '" + callee->getName() +
+                           "' must be a channel of the parameter's element type");
+      report_fatal_error(Twine("argument ") + Twine(idx + 1) + " of '" + callee->getName() +
+                         "' is a channel, but the parameter is not");
+    }
     args.push_back(argVal);
   }
 }
 
+// --- Phase timing ---
+// Wall-clock timing for the phases reported by `cookie run`.
+typedef std::chrono::steady_clock PhaseClock;
+
+static double elapsedMs(PhaseClock::time_point start) {
+  return std::chrono::duration<double, std::milli>(PhaseClock::now() - start).count();
+}
+
+// --- Optimization ---
+// Command-line settings for the optimizer.
+struct OptimizerOptions {
+  unsigned level = 0;        // -O0 .. -O3
+  bool printPasses = false;  // -print-passes: list every pass as it runs
+  bool timePasses = false;   // -time-passes: per-pass timing report on stderr
+};
+
+// CPU and feature selection for the TargetMachine (-mcpu / -mattr).
+struct CPUSelection {
+  std::string cpu;       // "" = generic, "native" = the host CPU and all its features
+  std::string features;  // comma-separated LLVM feature list, e.g. "+avx2,-avx512f"
+};
+
+// Creates a TargetMachine for the host triple so the optimizer sees real
+// vector widths and costs (without one, LLVM assumes a target with no vector
+// registers) and so object files can be emitted.
+static TargetMachine *createTargetMachine(const CPUSelection &sel) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+  std::string triple = sys::getDefaultTargetTriple();
+  std::string error;
+  const Target *target = TargetRegistry::lookupTarget(triple, error);
+  if (!target) {
+    std::cerr << "Error: " << error << "\n";
+    return nullptr;
+  }
+
+  std::string cpu = sel.cpu.empty() ? "generic" : sel.cpu;
+  std::string features;
+  if (cpu == "native") {
+    cpu = sys::getHostCPUName().str();
+#if LLVM_VERSION_MAJOR >= 19
+    StringMap<bool> hostFeatures = sys::getHostCPUFeatures();
+#else
+    StringMap<bool> hostFeatures;
+    sys::getHostCPUFeatures(hostFeatures);
+#endif
+    for (auto &feature : hostFeatures) {
+      if (!features.empty())
+        features += ",";
+      features += (feature.second ? "+" : "-") + feature.first().str();
+    }
+  }
+  if (!sel.features.empty()) {
+    if (!features.empty())
+      features += ",";
+    features += sel.features;
+  }
+  return target->createTargetMachine(triple, cpu, features, TargetOptions(), Reloc::PIC_);
+}
+
+// Runs the new-PassManager default pipeline for the requested level over TheModule.
+static void optimizeModule(const OptimizerOptions &opts, TargetMachine *TM) {
+  PassInstrumentationCallbacks PIC;
+  if (opts.printPasses) {
+    PIC.registerBeforeNonSkippedPassCallback([](StringRef passID, Any) {
+      errs() << "Running pass: " << passID << "\n";
+    });
+  }
+  TimePassesHandler timePasses(opts.timePasses);
+  timePasses.registerCallbacks(PIC);
+
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB(TM, PipelineTuningOptions(), {}, &PIC);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  static const OptimizationLevel levels[] = {
+    OptimizationLevel::O0, OptimizationLevel::O1, OptimizationLevel::O2, OptimizationLevel::O3
+  };
+  OptimizationLevel level = levels[opts.level];
+  ModulePassManager MPM = (opts.level == 0) ? PB.buildO0DefaultPipeline(level)
+                                            : PB.buildPerModuleDefaultPipeline(level);
+  MPM.run(*TheModule, MAM);
+}
+
+// --- Native code emission ---
+// Writes TheModule as a native object file for the TargetMachine's CPU.
+static bool emitObjectFile(TargetMachine *TM, const std::string &path) {
+  std::error_code EC;
+  raw_fd_ostream out(path, EC, sys::fs::OF_None);
+  if (EC) {
+    std::cerr << "Error: cannot write '" << path << "': " << EC.message() << "\n";
+    return false;
+  }
+  legacy::PassManager PM;
+#if LLVM_VERSION_MAJOR >= 18
+  CodeGenFileType fileType = CodeGenFileType::ObjectFile;
+#else
+  CodeGenFileType fileType = CGFT_ObjectFile;
+#endif
+  if (TM->addPassesToEmitFile(PM, out, nullptr, fileType)) {
+    std::cerr << "Error: the target cannot emit object files\n";
+    return false;
+  }
+  PM.run(*TheModule);
+  out.flush();
+  return true;
+}
+
+// Links an object file with the runtime into a standalone executable using
+// the system C compiler driver.
+static bool linkExecutable(const std::string &objectPath, const std::string &runtimePath,
+                           const std::string &outputPath) {
+  auto cc = sys::findProgramByName("cc");
+  if (!cc) {
+    std::cerr << "Error: no 'cc' found in PATH to link the executable\n";
+    return false;
+  }
+  if (!sys::fs::exists(runtimePath)) {
+    std::cerr << "Error: runtime object '" << runtimePath << "' not found (use -runtime=<path>)\n";
+    return false;
+  }
+  std::vector<StringRef> args = {*cc, objectPath, runtimePath, "-o", outputPath, "-lm", "-lpthread"};
+  std::string error;
+  int rc = sys::ExecuteAndWait(*cc, args, {}, {}, 0, 0, &error);
+  if (rc != 0) {
+    std::cerr << "Error: linking failed" << (error.empty() ? "" : ": " + error) << "\n";
+    return false;
+  }
+  return true;
+}
+
+// --- JIT execution ---
+// Compiles the verified module in-process with ORC LLJIT and calls its main().
+// Runtime helpers (read_int, cookie_str_concat, ...) are linked into this binary,
+// so they are resolved from the host process instead of a libruntime.so.
+// Prints one line of the phase timing report.
+static void printPhase(const char *phase, double ms) {
+  fprintf(stderr, "[cookie] %-8s %10.3f ms\n", phase, ms);
+}
+
+// Compile phases already reported by -time-passes are not printed again.
+static int runJIT(double parseMs, double irGenMs, double optMs, bool compileReported) {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  PhaseClock::time_point jitStart = PhaseClock::now();
+  auto JIT = orc::LLJITBuilder().create();
+  if (!JIT) {
+    std::cerr << "Error: " << toString(JIT.takeError()) << "\n";
+    return 1;
+  }
+  orc::JITDylib &MainJD = (*JIT)->getMainJITDylib();
+  auto HostSymbols = orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      (*JIT)->getDataLayout().getGlobalPrefix());
+  if (!HostSymbols) {
+    std::cerr << "Error: " << toString(HostSymbols.takeError()) << "\n";
+    return 1;
+  }
+  MainJD.addGenerator(std::move(*HostSymbols));
+
+  TheModule->setDataLayout((*JIT)->getDataLayout());
+  orc::ThreadSafeModule TSM{std::unique_ptr<Module>(TheModule),
+                            orc::ThreadSafeContext(std::unique_ptr<LLVMContext>(&Context))};
+  TheModule = nullptr;
+  if (Error Err = (*JIT)->addIRModule(std::move(TSM))) {
+    std::cerr << "Error: " << toString(std::move(Err)) << "\n";
+    return 1;
+  }
+  auto MainSym = (*JIT)->lookup("main");
+  if (!MainSym) {
+    std::cerr << "Error: " << toString(MainSym.takeError()) << "\n";
+    return 1;
+  }
+#if LLVM_VERSION_MAJOR >= 15
+  int (*MainFn)() = MainSym->toPtr<int (*)()>();
+#else
+  int (*MainFn)() = (int (*)())MainSym->getAddress();
+#endif
+  double jitMs = elapsedMs(jitStart);
+
+  PhaseClock::time_point execStart = PhaseClock::now();
+  int exitCode = MainFn();
+  cookie_flush();
+  double execMs = elapsedMs(execStart);
+
+  if (!compileReported) {
+    printPhase("parse", parseMs);
+    printPhase("ir-gen", irGenMs);
+    printPhase("optimize", optMs);
+  }
+  printPhase("jit", jitMs);
+  printPhase("execute", execMs);
+  return exitCode;
+}
+
 // --- Main ---
 // Generate IR for function definitions then generate global statements in main().
-int main() {
+//   cookie [options] [file.cook]       print LLVM IR for the program (stdin if no file)
+//   cookie -c [-o out.o] file.cook     write a native object file
+//   cookie -o program file.cook        write a native executable linked with runtime.o
+//   cookie run [options] file.cook     JIT-compile and execute the program in-process
+// Options:
+//   -O0 | -O1 | -O2 | -O3   optimization level (default -O0, -O means -O2)
+//   -print-passes           list each optimization pass as it runs
+//   -time-passes            report time spent in each compiler phase and optimization pass
+//   --mem-stats             report AST arena usage and string-interner hit rate
+//   -stack-array-limit=<n>  largest fixed array kept on the stack, in bytes (default 1 MiB)
+//   -huge-pages             use transparent huge pages for arrays placed off the stack
+//   -mcpu=<cpu|native>      target CPU (default generic; native under `run`)
+//   -mattr=<+f1,-f2,...>    enable or disable target features
+//   -runtime=<path>         runtime object to link (default: runtime.o next to cookie)
+int main(int argc, char **argv) {
+  bool runMode = false;
+  bool objectOnly = false;
+  const char *inputPath = nullptr;
+  std::string outputPath;
+  std::string runtimePath;
+  OptimizerOptions optOpts;
+  CPUSelection cpuSel;
+  bool memStats = false;
+  int argi = 1;
+  if (argi < argc && strcmp(argv[argi], "run") == 0) {
+    runMode = true;
+    cpuSel.cpu = "native";
+    argi++;
+  }
+  bool badArgs = false;
+  for (; argi < argc; argi++) {
+    const char *arg = argv[argi];
+    if (strcmp(arg, "-O") == 0)
+      optOpts.level = 2;
+    else if (arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3' && arg[3] == '\0')
+      optOpts.level = arg[2] - '0';
+    else if (strcmp(arg, "-print-passes") == 0)
+      optOpts.printPasses = true;
+    else if (strcmp(arg, "-time-passes") == 0)
+      optOpts.timePasses = true;
+    else if (strcmp(arg, "--mem-stats") == 0 || strcmp(arg, "-mem-stats") == 0)
+      memStats = true;
+    else if (strncmp(arg, "-stack-array-limit=", 19) == 0)
+      StackArrayLimit = strtoull(arg + 19, nullptr, 10);
+    else if (strcmp(arg, "-huge-pages") == 0)
+      HugePages = true;
+    else if (strcmp(arg, "-c") == 0)
+      objectOnly = true;
+    else if (strcmp(arg, "-o") == 0 && argi + 1 < argc)
+      outputPath = argv[++argi];
+    else if (strncmp(arg, "-mcpu=", 6) == 0)
+      cpuSel.cpu = arg + 6;
+    else if (strncmp(arg, "-mattr=", 7) == 0)
+      cpuSel.features = arg + 7;
+    else if (strncmp(arg, "-runtime=", 9) == 0)
+      runtimePath = arg + 9;
+    else if (arg[0] != '-' && !inputPath)
+      inputPath = arg;
+    else {
+      std::cerr << "Error: unknown argument '" << arg << "'\n";
+      badArgs = true;
+    }
+  }
+  if (badArgs || (runMode && !inputPath) || (runMode && (objectOnly || !outputPath.empty()))) {
+    std::cerr << "Usage: " << argv[0] << " [options] [file.cook]\n"
+              << "       " << argv[0] << " -c [-o out.o] [options] file.cook\n"
+              << "       " << argv[0] << " -o program [options] file.cook\n"
+              << "       " << argv[0] << " run [options] file.cook\n"
+              << "Options: -O0..-O3 -print-passes -time-passes --mem-stats -stack-array-limit=<bytes> -huge-pages\n"
+              << "         -mcpu=<cpu|native> -mattr=<features> -runtime=<path>\n";
+    return 1;
+  }
+  if (objectOnly && outputPath.empty()) {
+    outputPath = inputPath ? sys::path::stem(inputPath).str() + ".o" : "output.o";
+  }
+  if (runtimePath.empty()) {
+    SmallString<256> exeDir(sys::fs::getMainExecutable(argv[0], (void *)&elapsedMs));
+    sys::path::remove_filename(exeDir);
+    sys::path::append(exeDir, "runtime.o");
+    runtimePath = std::string(exeDir.str());
+  }
+  if (inputPath) {
+    yyin = fopen(inputPath, "r");
+    if (!yyin) {
+      std::cerr << "Error: cannot open '" << inputPath << "'\n";
+      return 1;
+    }
+  }
+
+  // IR generation sizes and aligns types (packed bool words, array byte
+  // counts) from the module's DataLayout, so the target's must be set first.
+  std::unique_ptr<TargetMachine> TM(createTargetMachine(cpuSel));
+  if (TM) {
+    TheModule->setTargetTriple(TM->getTargetTriple().str());
+    TheModule->setDataLayout(TM->createDataLayout());
+  }
+
+  PhaseClock::time_point parseStart = PhaseClock::now();
   if (yyparse() != 0) {
     return 1;
   }
+  double parseMs = elapsedMs(parseStart);
   
+  PhaseClock::time_point irGenStart = PhaseClock::now();
   generateFunctions(root);
   
   FunctionType *mainType = FunctionType::get(Type::getInt32Ty(Context), false);
@@ -1818,6 +4621,9 @@ int main() {
   BasicBlock *curBB = Builder.GetInsertBlock();
   if (!curBB->getTerminator())
     Builder.CreateRet(ConstantInt::get(Type::getInt32Ty(Context), 0));
+  emitArrayCleanup(mainFunc);
+  emitMapCleanup(mainFunc);
+  emitChanCleanup(mainFunc);
   
   // Ensure main is not empty.
   if (mainFunc->empty()) {
@@ -1832,7 +4638,51 @@ int main() {
     std::cerr << "Error: " << errorStream.str() << "\n";
     return 1;
   }
+  double irGenMs = elapsedMs(irGenStart);
+  // The IR no longer references the AST, so drop the whole arena at once.
+  if (memStats)
+    printMemStats(stderr);
+  releaseAST();
+  root = nullptr;
+  if (optOpts.timePasses) {
+    printPhase("parse", parseMs);
+    printPhase("ir-gen", irGenMs);
+  }
+
+  PhaseClock::time_point optStart = PhaseClock::now();
+  optimizeModule(optOpts, TM.get());
+  double optMs = elapsedMs(optStart);
+  if (optOpts.timePasses)
+    printPhase("optimize", optMs);
+
+  if (runMode)
+    return runJIT(parseMs, irGenMs, optMs, optOpts.timePasses);
+
+  if (!outputPath.empty()) {
+    if (!TM)
+      return 1;
+    PhaseClock::time_point codegenStart = PhaseClock::now();
+    std::string objectPath = outputPath;
+    SmallString<128> tempObject;
+    if (!objectOnly) {
+      if (std::error_code EC = sys::fs::createTemporaryFile("cookie", "o", tempObject)) {
+        std::cerr << "Error: cannot create temporary object file: " << EC.message() << "\n";
+        return 1;
+      }
+      objectPath = std::string(tempObject.str());
+    }
+    bool ok = emitObjectFile(TM.get(), objectPath);
+    if (ok && !objectOnly)
+      ok = linkExecutable(objectPath, runtimePath, outputPath);
+    if (!objectOnly)
+      sys::fs::remove(objectPath);
+    if (optOpts.timePasses)
+      printPhase("codegen", elapsedMs(codegenStart));
+    delete TheModule;
+    return ok ? 0 : 1;
+  }
+
   TheModule->print(outs(), nullptr);
   delete TheModule;
   return 0;
-}
\ No newline at end of file
+}
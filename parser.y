@@ -6,6 +6,29 @@
 extern int yylex();
 void yyerror(const char *s);
 ASTNode *root;  // Global AST root.
+
+/* "Point" -> "Point[]", the type name of an array parameter. */
+static char *appendBrackets(const char *name) {
+  size_t len = strlen(name);
+  char *buf = malloc(len + 3);
+  memcpy(buf, name, len);
+  strcpy(buf + len, "[]");
+  char *interned = internString(buf);
+  free(buf);
+  return interned;
+}
+
+/* "int" -> "chan<int>", the type name of a channel parameter. */
+static char *chanTypeName(const char *elem) {
+  size_t len = strlen(elem);
+  char *buf = malloc(len + 7);
+  strcpy(buf, "chan<");
+  strcpy(buf + 5, elem);
+  strcpy(buf + 5 + len, ">");
+  char *interned = internString(buf);
+  free(buf);
+  return interned;
+}
 %}
 
 %code requires {
@@ -33,6 +56,8 @@ ASTNode *root;  // Global AST root.
 %token INLINE
 %token SIZE
 %token DOT
+%token MAP SOA CHAN
+%token PARALLEL REDUCE SPAWN YIELD MEMO
 %token INT_FROM_STRING FLOAT_FROM_STRING BOOL_FROM_STRING CHAR_FROM_STRING
 
 
@@ -49,7 +74,7 @@ ASTNode *root;  // Global AST root.
 %type <node> program global_declarations global_declaration statements statement loop_header expression logical_or_expression logical_and_expression equality_expression relational_expression additive_expression multiplicative_expression primary else_if_ladder_opt if_ladder
 %type <node> function_definition parameter_list_opt parameter_list parameter function_body argument_list_opt argument_list
 %type <node> case_list case_clause default_clause
-%type <node> element_list
+%type <node> element_list map_type index_list field_list field_decl reduction_opt reduction_list reduction
 
 /* Start symbol */
 %start program
@@ -61,8 +86,8 @@ program:
     ;
 
 global_declarations:
-      global_declaration { $$ = $1; }
-    | global_declarations global_declaration { $$ = createASTNode("GLOBAL_LIST", NULL, $1, $2); }
+      global_declaration { $$ = createListNode(NODE_GLOBAL_LIST, $1); }
+    | global_declarations global_declaration { $$ = appendChild($1, $2); }
     ;
 
 global_declaration:
@@ -73,7 +98,12 @@ global_declaration:
 /* --- Function Definitions --- */
 function_definition:
     FUN IDENTIFIER LPAREN parameter_list_opt RPAREN LBRACE function_body RBRACE
-          { $$ = createASTNode("FUNC_DEF", $2, $4, $7); }
+          { $$ = createASTNode(NODE_FUNC_DEF, $2, $4, $7); }
+    /* memo fun f(...) caches results by argument; memo[n] keeps at most n */
+    | MEMO FUN IDENTIFIER LPAREN parameter_list_opt RPAREN LBRACE function_body RBRACE
+          { $$ = createASTNode(NODE_MEMO, NULL, createASTNode(NODE_FUNC_DEF, $3, $5, $8), NULL); }
+    | MEMO LBRACKET NUMBER RBRACKET FUN IDENTIFIER LPAREN parameter_list_opt RPAREN LBRACE function_body RBRACE
+          { $$ = createASTNode(NODE_MEMO, $3, createASTNode(NODE_FUNC_DEF, $6, $8, $11), NULL); }
     ;
 
 /* Parameter List */
@@ -83,16 +113,27 @@ parameter_list_opt:
     ;
 
 parameter_list:
-      parameter { $$ = $1; }
-    | parameter_list COMMA parameter { $$ = createASTNode("PARAM_LIST", NULL, $1, $3); }
+      parameter { $$ = createListNode(NODE_PARAM_LIST, $1); }
+    | parameter_list COMMA parameter { $$ = appendChild($1, $3); }
     ;
 
 parameter:
-      INT IDENTIFIER { $$ = createASTNode("PARAM", $2, createASTNode("TYPE_LITERAL", "int", NULL, NULL), NULL); }
-    | FLOAT IDENTIFIER { $$ = createASTNode("PARAM", $2, createASTNode("TYPE_LITERAL", "float", NULL, NULL), NULL); }
-    | BOOL IDENTIFIER { $$ = createASTNode("PARAM", $2, createASTNode("TYPE_LITERAL", "bool", NULL, NULL), NULL); }
-    | CHAR IDENTIFIER { $$ = createASTNode("PARAM", $2, createASTNode("TYPE_LITERAL", "char", NULL, NULL), NULL); }
-    | STRING IDENTIFIER { $$ = createASTNode("PARAM", $2, createASTNode("TYPE_LITERAL", "string", NULL, NULL), NULL); }
+      INT IDENTIFIER { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "int", NULL, NULL), NULL); }
+    | FLOAT IDENTIFIER { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "float", NULL, NULL), NULL); }
+    | BOOL IDENTIFIER { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "bool", NULL, NULL), NULL); }
+    | CHAR IDENTIFIER { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "char", NULL, NULL), NULL); }
+    | STRING IDENTIFIER { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "string", NULL, NULL), NULL); }
+    /* Array parameters are passed as slices */
+    | INT IDENTIFIER LBRACKET RBRACKET { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "int[]", NULL, NULL), NULL); }
+    | FLOAT IDENTIFIER LBRACKET RBRACKET { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "float[]", NULL, NULL), NULL); }
+    | BOOL IDENTIFIER LBRACKET RBRACKET { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "bool[]", NULL, NULL), NULL); }
+    | CHAR IDENTIFIER LBRACKET RBRACKET { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "char[]", NULL, NULL), NULL); }
+    | STRING IDENTIFIER LBRACKET RBRACKET { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, "string[]", NULL, NULL), NULL); }
+    /* Record parameters: Point p, Point ps[] */
+    | IDENTIFIER IDENTIFIER { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, $1, NULL, NULL), NULL); }
+    | IDENTIFIER IDENTIFIER LBRACKET RBRACKET { $$ = createASTNode(NODE_PARAM, $2, createASTNode(NODE_TYPE_LITERAL, appendBrackets($1), NULL, NULL), NULL); }
+    /* Channel parameters: chan<int> c */
+    | CHAN LT map_type GT IDENTIFIER { $$ = createASTNode(NODE_PARAM, $5, createASTNode(NODE_TYPE_LITERAL, chanTypeName($3->value), NULL, NULL), NULL); }
     ;
 
 function_body:
@@ -106,8 +147,8 @@ argument_list_opt:
     ;
 
 argument_list:
-      expression { $$ = $1; }
-    | argument_list COMMA expression { $$ = createASTNode("ARG_LIST", NULL, $1, $3); }
+      expression { $$ = createListNode(NODE_ARG_LIST, $1); }
+    | argument_list COMMA expression { $$ = appendChild($1, $3); }
     ;
 
 /* --- Loop Header --- 
@@ -117,111 +158,202 @@ argument_list:
        - Simple loop: "loop exp { ... }"
 */
 loop_header:
-      IDENTIFIER ':' expression { $$ = createASTNode("FOR_LOOP", $1, createASTNode("RANGE", NULL, NULL, $3), NULL); }
-    | expression ':' expression { $$ = createASTNode("FOR_LOOP", NULL, createASTNode("RANGE", NULL, $1, $3), NULL); }
-    | expression { $$ = createASTNode("LOOP", NULL, $1, NULL); }
+      IDENTIFIER ':' expression { $$ = createASTNode(NODE_FOR_LOOP, $1, createASTNode(NODE_RANGE, NULL, NULL, $3), NULL); }
+    | expression ':' expression { $$ = createASTNode(NODE_FOR_LOOP, NULL, createASTNode(NODE_RANGE, NULL, $1, $3), NULL); }
+    | expression { $$ = createASTNode(NODE_LOOP, NULL, $1, NULL); }
+    ;
+
+/* --- Two or more subscripts: [i][j]... --- */
+index_list:
+      LBRACKET expression RBRACKET LBRACKET expression RBRACKET
+          { $$ = appendChild(createListNode(NODE_INDEX_LIST, $2), $5); }
+    | index_list LBRACKET expression RBRACKET { $$ = appendChild($1, $3); }
+    ;
+
+/* --- Key and value types of a map --- */
+map_type:
+      INT { $$ = createASTNode(NODE_TYPE_LITERAL, "int", NULL, NULL); }
+    | FLOAT { $$ = createASTNode(NODE_TYPE_LITERAL, "float", NULL, NULL); }
+    | BOOL { $$ = createASTNode(NODE_TYPE_LITERAL, "bool", NULL, NULL); }
+    | CHAR { $$ = createASTNode(NODE_TYPE_LITERAL, "char", NULL, NULL); }
+    | STRING { $$ = createASTNode(NODE_TYPE_LITERAL, "string", NULL, NULL); }
+    ;
+
+/* --- Fields of a record type --- */
+field_list:
+      field_decl { $$ = createListNode(NODE_FIELD_LIST, $1); }
+    | field_list field_decl { $$ = appendChild($1, $2); }
+    ;
+
+field_decl:
+      INT IDENTIFIER SEMICOLON { $$ = createASTNode(NODE_FIELD_DECL, $2, createASTNode(NODE_TYPE_LITERAL, "int", NULL, NULL), NULL); }
+    | FLOAT IDENTIFIER SEMICOLON { $$ = createASTNode(NODE_FIELD_DECL, $2, createASTNode(NODE_TYPE_LITERAL, "float", NULL, NULL), NULL); }
+    | BOOL IDENTIFIER SEMICOLON { $$ = createASTNode(NODE_FIELD_DECL, $2, createASTNode(NODE_TYPE_LITERAL, "bool", NULL, NULL), NULL); }
+    | CHAR IDENTIFIER SEMICOLON { $$ = createASTNode(NODE_FIELD_DECL, $2, createASTNode(NODE_TYPE_LITERAL, "char", NULL, NULL), NULL); }
+    | STRING IDENTIFIER SEMICOLON { $$ = createASTNode(NODE_FIELD_DECL, $2, createASTNode(NODE_TYPE_LITERAL, "string", NULL, NULL), NULL); }
+    ;
+
+/* --- Reduction clauses of a parallel loop: reduce sum(total), max(best) --- */
+reduction_opt:
+      /* empty */ { $$ = NULL; }
+    | REDUCE reduction_list { $$ = $2; }
+    ;
+
+reduction_list:
+      reduction { $$ = createListNode(NODE_REDUCTION_LIST, $1); }
+    | reduction_list COMMA reduction { $$ = appendChild($1, $3); }
+    ;
+
+reduction:
+      IDENTIFIER LPAREN IDENTIFIER RPAREN
+          { $$ = createASTNode(NODE_REDUCTION, $1, createASTNode(NODE_IDENTIFIER, $3, NULL, NULL), NULL); }
     ;
 
 /* --- Element List for Arrays --- */
 element_list:
-      expression { $$ = $1; }
-    | element_list COMMA expression { $$ = createASTNode("ARRAY_ELEM_LIST", NULL, $1, $3); }
+      expression { $$ = createListNode(NODE_ARRAY_ELEM_LIST, $1); }
+    | element_list COMMA expression { $$ = appendChild($1, $3); }
     ;
 
 /* --- Statements --- */
 statements:
-      statement { $$ = $1; }
-    | statements statement { $$ = createASTNode("STATEMENT_LIST", NULL, $1, $2); }
+      statement { $$ = createListNode(NODE_STATEMENT_LIST, $1); }
+    | statements statement { $$ = appendChild($1, $2); }
     ;
 
 statement:
     /* Unified INPUT alternative for both simple identifiers and complex expressions */
-    INPUT LPAREN expression RPAREN SEMICOLON { $$ = createASTNode("INPUT_EXPR", NULL, $3, NULL); }
+    INPUT LPAREN expression RPAREN SEMICOLON { $$ = createASTNode(NODE_INPUT_EXPR, NULL, $3, NULL); }
     | IF LPAREN expression RPAREN LBRACE statements RBRACE else_if_ladder_opt
           {
             if ($8 == NULL)
-              $$ = createASTNode("IF", NULL, $3, $6);
+              $$ = createASTNode(NODE_IF, NULL, $3, $6);
             else
-              $$ = createASTNode("IF_CHAIN", NULL, createASTNode("IF", NULL, $3, $6), $8);
+              $$ = createASTNode(NODE_IF_CHAIN, NULL, createASTNode(NODE_IF, NULL, $3, $6), $8);
           }
     /* Loop using the new loop_header (iterator/range-based) */
       | LOOP IDENTIFIER ':' IDENTIFIER LBRACE statements RBRACE
-          { $$ = createASTNode("ARRAY_ITERATOR", $2, createASTNode("IDENTIFIER", $4, NULL, NULL), $6); }
+          { $$ = createASTNode(NODE_ARRAY_ITERATOR, $2, createASTNode(NODE_IDENTIFIER, $4, NULL, NULL), $6); }
       | LOOP loop_header LBRACE statements RBRACE
           { $2->right = $4; $$ = $2; }
       | LOOP UNTIL LPAREN expression RPAREN LBRACE statements RBRACE
-          { $$ = createASTNode("LOOP_UNTIL", NULL, $4, $7); }
+          { $$ = createASTNode(NODE_LOOP_UNTIL, NULL, $4, $7); }
+      /* parallel loop i : n { ... } and parallel loop i : lo : hi { ... }:
+         a FOR_LOOP wrapped with its reduction clauses */
+      | PARALLEL LOOP IDENTIFIER ':' expression reduction_opt LBRACE statements RBRACE
+          { $$ = createASTNode(NODE_PARALLEL_LOOP, NULL,
+                               createASTNode(NODE_FOR_LOOP, $3, createASTNode(NODE_RANGE, NULL, NULL, $5), $8), $6); }
+      | PARALLEL LOOP IDENTIFIER ':' expression ':' expression reduction_opt LBRACE statements RBRACE
+          { $$ = createASTNode(NODE_PARALLEL_LOOP, NULL,
+                               createASTNode(NODE_FOR_LOOP, $3, createASTNode(NODE_RANGE, NULL, $5, $7), $10), $8); }
     | WHILE UNTIL expression LBRACE statements RBRACE
-          { $$ = createASTNode("LOOP_UNTIL", NULL, $3, $5); }
+          { $$ = createASTNode(NODE_LOOP_UNTIL, NULL, $3, $5); }
     | INT IDENTIFIER ASSIGN expression SEMICOLON
-          { $$ = createASTNode("ASSIGN_INT", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_INT, $2, $4, NULL); }
     | INT IDENTIFIER IS expression SEMICOLON
-          { $$ = createASTNode("ASSIGN_INT", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_INT, $2, $4, NULL); }
     | FLOAT IDENTIFIER ASSIGN expression SEMICOLON
-          { $$ = createASTNode("ASSIGN_FLOAT", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_FLOAT, $2, $4, NULL); }
     | FLOAT IDENTIFIER IS expression SEMICOLON
-          { $$ = createASTNode("ASSIGN_FLOAT", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_FLOAT, $2, $4, NULL); }
     | BOOL IDENTIFIER ASSIGN BOOLEAN SEMICOLON
-          { $$ = createASTNode("ASSIGN_BOOL", $2, createASTNode("BOOLEAN", $4, NULL, NULL), NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_BOOL, $2, createASTNode(NODE_BOOLEAN, $4, NULL, NULL), NULL); }
     | BOOL IDENTIFIER IS BOOLEAN SEMICOLON
-          { $$ = createASTNode("ASSIGN_BOOL", $2, createASTNode("BOOLEAN", $4, NULL, NULL), NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_BOOL, $2, createASTNode(NODE_BOOLEAN, $4, NULL, NULL), NULL); }
     | CHAR IDENTIFIER ASSIGN CHAR_LITERAL SEMICOLON
-          { $$ = createASTNode("ASSIGN_CHAR", $2, createASTNode("CHAR", $4, NULL, NULL), NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_CHAR, $2, createASTNode(NODE_CHAR, $4, NULL, NULL), NULL); }
     | CHAR IDENTIFIER IS CHAR_LITERAL SEMICOLON
-          { $$ = createASTNode("ASSIGN_CHAR", $2, createASTNode("CHAR", $4, NULL, NULL), NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_CHAR, $2, createASTNode(NODE_CHAR, $4, NULL, NULL), NULL); }
       | CHAR IDENTIFIER ASSIGN expression SEMICOLON 
-            { $$ = createASTNode("ASSIGN_CHAR", $2, $4, NULL); }
+            { $$ = createASTNode(NODE_ASSIGN_CHAR, $2, $4, NULL); }
 
     | STRING IDENTIFIER ASSIGN expression SEMICOLON
-          { $$ = createASTNode("ASSIGN_STRING", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_STRING, $2, $4, NULL); }
     | STRING IDENTIFIER IS expression SEMICOLON
-          { $$ = createASTNode("ASSIGN_STRING", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_ASSIGN_STRING, $2, $4, NULL); }
     | VAR IDENTIFIER ASSIGN expression SEMICOLON
-          { $$ = createASTNode("VAR_DECL", $2, $4, NULL); }
+          { $$ = createASTNode(NODE_VAR_DECL, $2, $4, NULL); }
     | VAR IDENTIFIER IS expression SEMICOLON
-          { $$ = createASTNode("VAR_DECL", $2, $4, NULL); }
-    | IDENTIFIER LBRACKET expression RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode("ARRAY_ASSIGN", $1, $3, $6); }
+          { $$ = createASTNode(NODE_VAR_DECL, $2, $4, NULL); }
+    | IDENTIFIER LBRACKET expression RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_ARRAY_ASSIGN, $1, $3, $6); }
+    | IDENTIFIER index_list ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_ARRAY_ASSIGN, $1, $2, $4); }
 
       | IDENTIFIER ASSIGN expression SEMICOLON
-            { $$ = createASTNode("REASSIGN", $1, $3, NULL); }
+            { $$ = createASTNode(NODE_REASSIGN, $1, $3, NULL); }
       | PRINT LPAREN expression RPAREN SEMICOLON
-            { $$ = createASTNode("PRINT", NULL, $3, NULL); }
+            { $$ = createASTNode(NODE_PRINT, NULL, $3, NULL); }
       | PRINT LPAREN RPAREN SEMICOLON 
-            { $$ = createASTNode("PRINT_NEWLINE", NULL, NULL, NULL); }
+            { $$ = createASTNode(NODE_PRINT_NEWLINE, NULL, NULL, NULL); }
     | INLINE LPAREN expression RPAREN SEMICOLON
-          { $$ = createASTNode("INLINE", NULL, $3, NULL); }
+          { $$ = createASTNode(NODE_INLINE, NULL, $3, NULL); }
     | INT IDENTIFIER SEMICOLON
-          { $$ = createASTNode("DECL_INT", $2, NULL, NULL); }
+          { $$ = createASTNode(NODE_DECL_INT, $2, NULL, NULL); }
     | FLOAT IDENTIFIER SEMICOLON
-          { $$ = createASTNode("DECL_FLOAT", $2, NULL, NULL); }
+          { $$ = createASTNode(NODE_DECL_FLOAT, $2, NULL, NULL); }
     | BOOL IDENTIFIER SEMICOLON
-          { $$ = createASTNode("DECL_BOOL", $2, NULL, NULL); }
+          { $$ = createASTNode(NODE_DECL_BOOL, $2, NULL, NULL); }
     | CHAR IDENTIFIER SEMICOLON
-          { $$ = createASTNode("DECL_CHAR", $2, NULL, NULL); }
+          { $$ = createASTNode(NODE_DECL_CHAR, $2, NULL, NULL); }
     | STRING IDENTIFIER SEMICOLON
-          { $$ = createASTNode("DECL_STRING", $2, NULL, NULL); }
+          { $$ = createASTNode(NODE_DECL_STRING, $2, NULL, NULL); }
     /* Array declarations without initializer (supporting variable sizes) */
-    | INT IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode("DECL_ARRAY", $2, $4, NULL); }
-    | FLOAT IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode("DECL_ARRAY_FLOAT", $2, $4, NULL); }
-    | BOOL IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode("DECL_ARRAY_BOOL", $2, $4, NULL); }
-    | CHAR IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode("DECL_ARRAY_CHAR", $2, $4, NULL); }
-    | STRING IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode("DECL_ARRAY_STRING", $2, $4, NULL); }
+    | INT IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY, $2, $4, NULL); }
+    | FLOAT IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_FLOAT, $2, $4, NULL); }
+    | BOOL IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_BOOL, $2, $4, NULL); }
+    | CHAR IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_CHAR, $2, $4, NULL); }
+    | STRING IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_STRING, $2, $4, NULL); }
+    /* Multi-dimensional arrays: the size is an INDEX_LIST of extents */
+    | INT IDENTIFIER index_list SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY, $2, $3, NULL); }
+    | FLOAT IDENTIFIER index_list SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_FLOAT, $2, $3, NULL); }
+    | BOOL IDENTIFIER index_list SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_BOOL, $2, $3, NULL); }
+    | CHAR IDENTIFIER index_list SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_CHAR, $2, $3, NULL); }
+    | STRING IDENTIFIER index_list SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_STRING, $2, $3, NULL); }
     /* Array declarations with initializer remain unchanged */
-    | INT IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode("DECL_ARRAY_INIT", $2, $7, NULL); }
-    | FLOAT IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode("DECL_ARRAY_INIT_FLOAT", $2, $7, NULL); }
-    | BOOL IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode("DECL_ARRAY_INIT_BOOL", $2, $7, NULL); }
-    | CHAR IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode("DECL_ARRAY_INIT_CHAR", $2, $7, NULL); }
-    | STRING IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode("DECL_ARRAY_INIT_STRING", $2, $7, NULL); }
+    | INT IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_INIT, $2, $7, NULL); }
+    | FLOAT IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_INIT_FLOAT, $2, $7, NULL); }
+    | BOOL IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_INIT_BOOL, $2, $7, NULL); }
+    | CHAR IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_INIT_CHAR, $2, $7, NULL); }
+    | STRING IDENTIFIER LBRACKET RBRACKET ASSIGN LBRACE element_list RBRACE SEMICOLON { $$ = createASTNode(NODE_DECL_ARRAY_INIT_STRING, $2, $7, NULL); }
+    /* Slice declaration: a view of an array, e.g. int s[] = arr[2:10]; */
+    | INT IDENTIFIER LBRACKET RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_DECL_SLICE, $2, createASTNode(NODE_TYPE_LITERAL, "int", NULL, NULL), $6); }
+    | FLOAT IDENTIFIER LBRACKET RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_DECL_SLICE, $2, createASTNode(NODE_TYPE_LITERAL, "float", NULL, NULL), $6); }
+    | BOOL IDENTIFIER LBRACKET RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_DECL_SLICE, $2, createASTNode(NODE_TYPE_LITERAL, "bool", NULL, NULL), $6); }
+    | CHAR IDENTIFIER LBRACKET RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_DECL_SLICE, $2, createASTNode(NODE_TYPE_LITERAL, "char", NULL, NULL), $6); }
+    | STRING IDENTIFIER LBRACKET RBRACKET ASSIGN expression SEMICOLON { $$ = createASTNode(NODE_DECL_SLICE, $2, createASTNode(NODE_TYPE_LITERAL, "string", NULL, NULL), $6); }
+    /* Record type: type Point { float x; float y; } */
+    | TYPE IDENTIFIER LBRACE field_list RBRACE { $$ = createASTNode(NODE_RECORD_DEF, $2, $4, NULL); }
+    /* Records: Point p; Point ps[n]; soa Point ps[n]; */
+    | IDENTIFIER IDENTIFIER SEMICOLON { $$ = createASTNode(NODE_DECL_RECORD, $2, createASTNode(NODE_TYPE_LITERAL, $1, NULL, NULL), NULL); }
+    | IDENTIFIER IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_RECORD_ARRAY, $2, createASTNode(NODE_TYPE_LITERAL, $1, NULL, NULL), $4); }
+    | SOA IDENTIFIER IDENTIFIER LBRACKET expression RBRACKET SEMICOLON { $$ = createASTNode(NODE_DECL_RECORD_SOA, $3, createASTNode(NODE_TYPE_LITERAL, $2, NULL, NULL), $5); }
+    | IDENTIFIER DOT IDENTIFIER ASSIGN expression SEMICOLON
+          { $$ = createASTNode(NODE_FIELD_ASSIGN, $3, createASTNode(NODE_IDENTIFIER, $1, NULL, NULL), $5); }
+    | IDENTIFIER LBRACKET expression RBRACKET DOT IDENTIFIER ASSIGN expression SEMICOLON
+          { $$ = createASTNode(NODE_FIELD_ASSIGN, $6, createASTNode(NODE_ARRAY_ACCESS, $1, $3, NULL), $8); }
+    /* Map declaration: map<K, V> name; */
+    | MAP LT map_type COMMA map_type GT IDENTIFIER SEMICOLON
+          { $$ = createASTNode(NODE_DECL_MAP, $7, $3, $5); }
+    /* Channel declaration: chan<T> name; or chan<T> name[capacity]; */
+    | CHAN LT map_type GT IDENTIFIER SEMICOLON
+          { $$ = createASTNode(NODE_DECL_CHAN, $5, $3, NULL); }
+    | CHAN LT map_type GT IDENTIFIER LBRACKET expression RBRACKET SEMICOLON
+          { $$ = createASTNode(NODE_DECL_CHAN, $5, $3, $7); }
     | RETURN LPAREN expression RPAREN SEMICOLON
-          { $$ = createASTNode("RETURN", NULL, $3, NULL); }
+          { $$ = createASTNode(NODE_RETURN, NULL, $3, NULL); }
+    /* yield (x); makes the enclosing function a generator */
+    | YIELD LPAREN expression RPAREN SEMICOLON
+          { $$ = createASTNode(NODE_YIELD, NULL, $3, NULL); }
     /* Function call as a statement */
     | IDENTIFIER LPAREN argument_list_opt RPAREN SEMICOLON
-          { $$ = createASTNode("CALL", $1, $3, NULL); }
+          { $$ = createASTNode(NODE_CALL, $1, $3, NULL); }
+    /* Method call as a statement (arr.push(x);) */
+    | IDENTIFIER DOT IDENTIFIER LPAREN argument_list_opt RPAREN SEMICOLON
+          { $$ = createASTNode(NODE_METHOD_CALL, $3, createASTNode(NODE_IDENTIFIER, $1, NULL, NULL), $5); }
     /* Switch-case statement with default clause */
     | SWITCH LPAREN expression RPAREN LBRACE case_list default_clause RBRACE
-          { $$ = createASTNode("SWITCH", NULL, $3, createASTNode("SWITCH_BODY", NULL, $6, $7)); }
+          { $$ = createASTNode(NODE_SWITCH, NULL, $3, createASTNode(NODE_SWITCH_BODY, NULL, $6, $7)); }
     /* Break statement */
-    | BREAK SEMICOLON { $$ = createASTNode("BREAK", NULL, NULL, NULL); }
+    | BREAK SEMICOLON { $$ = createASTNode(NODE_BREAK, NULL, NULL, NULL); }
     ;
     
 
@@ -232,26 +364,26 @@ else_if_ladder_opt:
 
 if_ladder:
     IF LPAREN expression RPAREN LBRACE statements RBRACE else_if_ladder_opt
-          { $$ = createASTNode("ELSE_IF", NULL, $3, createASTNode("IF_ELSE_BODY", NULL, $6, $8)); }
+          { $$ = createASTNode(NODE_ELSE_IF, NULL, $3, createASTNode(NODE_IF_ELSE_BODY, NULL, $6, $8)); }
     | LBRACE statements RBRACE
-          { $$ = createASTNode("ELSE", NULL, $2, NULL); }
+          { $$ = createASTNode(NODE_ELSE, NULL, $2, NULL); }
     ;
 
 /* Case list for switch-case */
 case_list:
-      case_clause { $$ = $1; }
-    | case_list case_clause { $$ = createASTNode("CASE_LIST", NULL, $1, $2); }
+      case_clause { $$ = createListNode(NODE_CASE_LIST, $1); }
+    | case_list case_clause { $$ = appendChild($1, $2); }
     ;
 
 /* A case clause */
 case_clause:
-      CASE expression statements { $$ = createASTNode("CASE", NULL, $2, $3); }
+      CASE expression statements { $$ = createASTNode(NODE_CASE, NULL, $2, $3); }
     ;
 
 /* Default clause for switch-case */
 default_clause:
       /* empty */ { $$ = NULL; }
-    | DEFAULT ':' statements { $$ = createASTNode("DEFAULT", NULL, $3, NULL); }
+    | DEFAULT ':' statements { $$ = createASTNode(NODE_DEFAULT, NULL, $3, NULL); }
     ;
 
 /* --- Expressions --- */
@@ -260,60 +392,65 @@ expression:
     ;
 
 logical_or_expression:
-    logical_or_expression OR logical_and_expression { $$ = createASTNode("OR", "||", $1, $3); }
+    logical_or_expression OR logical_and_expression { $$ = createASTNode(NODE_OR, "||", $1, $3); }
     | logical_and_expression { $$ = $1; }
     ;
 
 logical_and_expression:
-    logical_and_expression AND equality_expression { $$ = createASTNode("AND", "&&", $1, $3); }
+    logical_and_expression AND equality_expression { $$ = createASTNode(NODE_AND, "&&", $1, $3); }
     | equality_expression { $$ = $1; }
     ;
 
 equality_expression:
-    equality_expression EQ relational_expression { $$ = createASTNode("EQ", "==", $1, $3); }
-    | equality_expression NE relational_expression { $$ = createASTNode("NE", "!=", $1, $3); }
+    equality_expression EQ relational_expression { $$ = createASTNode(NODE_EQ, "==", $1, $3); }
+    | equality_expression NE relational_expression { $$ = createASTNode(NODE_NE, "!=", $1, $3); }
     | relational_expression { $$ = $1; }
     ;
 
 relational_expression:
-    relational_expression LT additive_expression { $$ = createASTNode("LT", "<", $1, $3); }
-    | relational_expression GT additive_expression { $$ = createASTNode("GT", ">", $1, $3); }
-    | relational_expression LE additive_expression { $$ = createASTNode("LE", "<=", $1, $3); }
-    | relational_expression GE additive_expression { $$ = createASTNode("GE", ">=", $1, $3); }
+    relational_expression LT additive_expression { $$ = createASTNode(NODE_LT, "<", $1, $3); }
+    | relational_expression GT additive_expression { $$ = createASTNode(NODE_GT, ">", $1, $3); }
+    | relational_expression LE additive_expression { $$ = createASTNode(NODE_LE, "<=", $1, $3); }
+    | relational_expression GE additive_expression { $$ = createASTNode(NODE_GE, ">=", $1, $3); }
     | additive_expression { $$ = $1; }
     ;
 
 additive_expression:
-    additive_expression PLUS multiplicative_expression { $$ = createASTNode("ADD", "+", $1, $3); }
-    | additive_expression MINUS multiplicative_expression { $$ = createASTNode("SUB", "-", $1, $3); }
+    additive_expression PLUS multiplicative_expression { $$ = createASTNode(NODE_ADD, "+", $1, $3); }
+    | additive_expression MINUS multiplicative_expression { $$ = createASTNode(NODE_SUB, "-", $1, $3); }
     | multiplicative_expression { $$ = $1; }
     ;
 
 multiplicative_expression:
-    multiplicative_expression MULTIPLY primary { $$ = createASTNode("MUL", "*", $1, $3); }
-    | multiplicative_expression DIVIDE primary { $$ = createASTNode("DIV", "/", $1, $3); }
+    multiplicative_expression MULTIPLY primary { $$ = createASTNode(NODE_MUL, "*", $1, $3); }
+    | multiplicative_expression DIVIDE primary { $$ = createASTNode(NODE_DIV, "/", $1, $3); }
     | primary { $$ = $1; }
     ;
 
 primary:
-    primary DOT IDENTIFIER LPAREN argument_list_opt RPAREN { $$ = createASTNode("METHOD_CALL", $3, $1, $5); }
-    | NOT primary { $$ = createASTNode("NOT", "!", $2, NULL); }
-    | MINUS primary { $$ = createASTNode("NEG", "-", $2, NULL); }
-    | SIZE LPAREN expression RPAREN { $$ = createASTNode("SIZE", NULL, $3, NULL); }
-    | NUMBER { $$ = createASTNode("NUMBER", $1, NULL, NULL); }
-    | FLOAT_NUMBER { $$ = createASTNode("FLOAT", $1, NULL, NULL); }
-    | BOOLEAN { $$ = createASTNode("BOOLEAN", $1, NULL, NULL); }
-    | CHAR_LITERAL { $$ = createASTNode("CHAR", $1, NULL, NULL); }
-    | STRING_LITERAL { $$ = createASTNode("STRING", $1, NULL, NULL); }
-    | INT LPAREN expression RPAREN    { $$ = createASTNode("CAST_INT", NULL, $3, NULL); }
-    | FLOAT LPAREN expression RPAREN  { $$ = createASTNode("CAST_FLOAT", NULL, $3, NULL); }
-    | STRING LPAREN expression RPAREN { $$ = createASTNode("CAST_STRING", NULL, $3, NULL); }
-    | CHAR LPAREN expression RPAREN   { $$ = createASTNode("CAST_CHAR", NULL, $3, NULL); }
-    | IDENTIFIER LPAREN argument_list_opt RPAREN { $$ = createASTNode("CALL", $1, $3, NULL); }
-    | IDENTIFIER LBRACKET expression RBRACKET { $$ = createASTNode("ARRAY_ACCESS", $1, $3, NULL); }
-    | IDENTIFIER { $$ = createASTNode("IDENTIFIER", $1, NULL, NULL); }
+    primary DOT IDENTIFIER LPAREN argument_list_opt RPAREN { $$ = createASTNode(NODE_METHOD_CALL, $3, $1, $5); }
+    | primary DOT IDENTIFIER { $$ = createASTNode(NODE_FIELD, $3, $1, NULL); }
+    | NOT primary { $$ = createASTNode(NODE_NOT, "!", $2, NULL); }
+    | MINUS primary { $$ = createASTNode(NODE_NEG, "-", $2, NULL); }
+    | SIZE LPAREN expression RPAREN { $$ = createASTNode(NODE_SIZE, NULL, $3, NULL); }
+    | NUMBER { $$ = createASTNode(NODE_NUMBER, $1, NULL, NULL); }
+    | FLOAT_NUMBER { $$ = createASTNode(NODE_FLOAT, $1, NULL, NULL); }
+    | BOOLEAN { $$ = createASTNode(NODE_BOOLEAN, $1, NULL, NULL); }
+    | CHAR_LITERAL { $$ = createASTNode(NODE_CHAR, $1, NULL, NULL); }
+    | STRING_LITERAL { $$ = createASTNode(NODE_STRING, $1, NULL, NULL); }
+    | INT LPAREN expression RPAREN    { $$ = createASTNode(NODE_CAST_INT, NULL, $3, NULL); }
+    | FLOAT LPAREN expression RPAREN  { $$ = createASTNode(NODE_CAST_FLOAT, NULL, $3, NULL); }
+    | STRING LPAREN expression RPAREN { $$ = createASTNode(NODE_CAST_STRING, NULL, $3, NULL); }
+    | CHAR LPAREN expression RPAREN   { $$ = createASTNode(NODE_CAST_CHAR, NULL, $3, NULL); }
+    | IDENTIFIER LPAREN argument_list_opt RPAREN { $$ = createASTNode(NODE_CALL, $1, $3, NULL); }
+    /* spawn f(a, b): run the call as a task; await(h) gets its result */
+    | SPAWN IDENTIFIER LPAREN argument_list_opt RPAREN { $$ = createASTNode(NODE_SPAWN, $2, $4, NULL); }
+    | IDENTIFIER LBRACKET expression RBRACKET { $$ = createASTNode(NODE_ARRAY_ACCESS, $1, $3, NULL); }
+    | IDENTIFIER index_list { $$ = createASTNode(NODE_ARRAY_ACCESS, $1, $2, NULL); }
+    | IDENTIFIER LBRACKET expression ':' expression RBRACKET { $$ = createASTNode(NODE_ARRAY_SLICE, $1, $3, $5); }
+    | IDENTIFIER { $$ = createASTNode(NODE_IDENTIFIER, $1, NULL, NULL); }
     | LPAREN expression RPAREN { $$ = $2; }
-    | TYPE LPAREN expression RPAREN { $$ = createASTNode("TYPE", NULL, $3, NULL); }
+    | TYPE LPAREN expression RPAREN { $$ = createASTNode(NODE_TYPE, NULL, $3, NULL); }
     ;
 
 %%
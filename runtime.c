@@ -2,58 +2,1635 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#endif
 
-// Runtime helper: Concatenates two strings.
-char* concat_strings(char* s1, char* s2) {
-    size_t len1 = strlen(s1);
-    size_t len2 = strlen(s2);
-    char* result = (char*) malloc(len1 + len2 + 1);
-    if (!result) return NULL;
-    strcpy(result, s1);
-    strcat(result, s2);
+// --- Strings ---
+// A Cookie string is a char* to NUL-terminated bytes, preceded by a CookieStr
+// header holding the length and capacity. The length is always available
+// without scanning, and the data can still be passed as a plain C string.
+// String literals are constant globals with the same layout. Short strings
+// are carved from a bump slab instead of individual mallocs, and one-char
+// strings come from a static table.
+typedef struct CookieStr {
+    uint32_t len;
+    uint32_t cap;   // bytes available for data, excluding the NUL; flags in the high bits
+} CookieStr;
+
+#define COOKIE_STR_HEAP 0x80000000u   // malloc'd block that may be resized or freed
+#define COOKIE_STR_UNIQUE 0x40000000u // builder buffer owned by exactly one variable
+#define COOKIE_STR_CAP_MASK 0x3fffffffu
+#define STR_SLAB_SIZE (64 * 1024)
+#define STR_SMALL_MAX 32              // strings up to this many bytes (with NUL) use the slab
+
+static inline CookieStr* str_header(const char* s) {
+    return (CookieStr*)(s - sizeof(CookieStr));
+}
+
+// --- Buffered output ---
+// print/inline write into one large buffer instead of calling printf per value.
+// The buffer is flushed when it fills, at a newline once it passes the flush
+// threshold (or at every newline when stdout is a terminal), before reading
+// input, and at exit. Each thread has a buffer of its own, so the workers of
+// a parallel loop print without locking; a worker flushes its buffer when it
+// finishes a piece of the loop.
+#define OUT_BUF_SIZE (64 * 1024)
+#define OUT_FLUSH_THRESHOLD (OUT_BUF_SIZE - 4096)
+
+static _Thread_local char out_buf[OUT_BUF_SIZE];
+static _Thread_local size_t out_len = 0;
+static _Thread_local int out_initialized = 0;
+static int out_is_tty = 0;
+static pthread_once_t out_once = PTHREAD_ONCE_INIT;
+
+void cookie_flush(void) {
+    if (out_len) {
+        fwrite(out_buf, 1, out_len, stdout);
+        out_len = 0;
+    }
+    fflush(stdout);
+}
+
+static void out_init_once(void) {
+    out_is_tty = isatty(fileno(stdout));
+    atexit(cookie_flush);
+}
+
+static void out_init(void) {
+    out_initialized = 1;
+    pthread_once(&out_once, out_init_once);
+}
+
+// Makes room for n more bytes; n must not exceed OUT_BUF_SIZE.
+static inline char* out_reserve(size_t n) {
+    if (!out_initialized)
+        out_init();
+    if (out_len + n > OUT_BUF_SIZE)
+        cookie_flush();
+    return out_buf + out_len;
+}
+
+static void out_bytes(const char* s, size_t n) {
+    if (n > OUT_BUF_SIZE / 2) {
+        cookie_flush();
+        fwrite(s, 1, n, stdout);
+        return;
+    }
+    memcpy(out_reserve(n), s, n);
+    out_len += n;
+}
+
+// Writes the decimal digits of v ending just before `end`; returns the first digit.
+static char* format_u64(char* end, uint64_t v) {
+    static const char digit_pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char* p = end;
+    while (v >= 100) {
+        unsigned pair = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = digit_pairs[pair + 1];
+        *--p = digit_pairs[pair];
+    }
+    if (v >= 10) {
+        *--p = digit_pairs[v * 2 + 1];
+        *--p = digit_pairs[v * 2];
+    } else {
+        *--p = (char)('0' + v);
+    }
+    return p;
+}
+
+void cookie_write_i32(int v) {
+    char tmp[16];
+    char* end = tmp + sizeof(tmp);
+    uint32_t mag = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    char* p = format_u64(end, mag);
+    if (v < 0)
+        *--p = '-';
+    out_bytes(p, (size_t)(end - p));
+}
+
+// Same output as printf("%.1f", v). A float times 10 is exact in a double, so
+// rounding that product half-to-even matches printf's correctly rounded result.
+void cookie_write_f32(float v) {
+    double d = v;
+    int negative = d < 0 || (d == 0 && 1 / d < 0);   // keeps the sign of -0.0
+    double mag = negative ? -d : d;
+    double scaled = mag * 10.0;
+    if (!(scaled < 1.8e19)) {   // inf, nan, or too large for a uint64_t
+        char tmp[64];
+        int n = snprintf(tmp, sizeof(tmp), "%.1f", d);
+        out_bytes(tmp, (size_t)n);
+        return;
+    }
+    uint64_t q = (uint64_t)scaled;
+    double rem = scaled - (double)q;
+    if (rem > 0.5 || (rem == 0.5 && (q & 1)))
+        q++;
+    char tmp[32];
+    char* end = tmp + sizeof(tmp);
+    *--end = (char)('0' + q % 10);
+    *--end = '.';
+    char* p = format_u64(end, q / 10);
+    if (negative)
+        *--p = '-';
+    out_bytes(p, (size_t)(tmp + sizeof(tmp) - p));
+}
+
+void cookie_write_str(const char* s) {
+    if (!s) {
+        out_bytes("(null)", 6);
+        return;
+    }
+    out_bytes(s, str_header(s)->len);
+}
+
+// For the runtime's own messages, which are plain C strings.
+static void write_cstr(const char* s) {
+    out_bytes(s, strlen(s));
+}
+
+void cookie_write_char(int c) {
+    *out_reserve(1) = (char)c;
+    out_len++;
+}
+
+void cookie_write_bool(int b) {
+    if (b)
+        out_bytes("true", 4);
+    else
+        out_bytes("false", 5);
+}
+
+void cookie_write_newline(void) {
+    *out_reserve(1) = '\n';
+    out_len++;
+    if (out_is_tty || out_len >= OUT_FLUSH_THRESHOLD)
+        cookie_flush();
+}
+
+// --- String allocation ---
+// Each thread carves its short strings from a slab of its own.
+static _Thread_local char* str_slab = NULL;
+static _Thread_local size_t str_slab_left = 0;
+
+static void str_out_of_memory(void) {
+    cookie_flush();
+    fprintf(stderr, "Runtime Error: out of memory allocating a string.\n");
+    exit(EXIT_FAILURE);
+}
+
+// Returns uninitialized room for a string of `len` bytes with its NUL already
+// written; the caller fills in the data.
+char* cookie_str_alloc(uint32_t len) {
+    size_t size = (sizeof(CookieStr) + len + 1 + 7) & ~(size_t)7;
+    CookieStr* h;
+    if (len + 1 <= STR_SMALL_MAX) {
+        if (str_slab_left < size) {
+            str_slab = (char*)malloc(STR_SLAB_SIZE);
+            if (!str_slab)
+                str_out_of_memory();
+            str_slab_left = STR_SLAB_SIZE;
+        }
+        h = (CookieStr*)str_slab;
+        str_slab += size;
+        str_slab_left -= size;
+        h->cap = (uint32_t)(size - sizeof(CookieStr) - 1);
+    } else {
+        h = (CookieStr*)malloc(size);
+        if (!h)
+            str_out_of_memory();
+        h->cap = (uint32_t)(size - sizeof(CookieStr) - 1) | COOKIE_STR_HEAP;
+    }
+    h->len = len;
+    char* data = (char*)(h + 1);
+    data[len] = '\0';
+    return data;
+}
+
+uint32_t cookie_str_len(const char* s) {
+    return s ? str_header(s)->len : 0;
+}
+
+// Concatenates two strings with one allocation and two copies.
+char* cookie_str_concat(const char* a, const char* b) {
+    uint32_t la = cookie_str_len(a), lb = cookie_str_len(b);
+    if ((uint64_t)la + lb > COOKIE_STR_CAP_MASK)
+        str_out_of_memory();
+    char* result = cookie_str_alloc(la + lb);
+    if (la) memcpy(result, a, la);
+    if (lb) memcpy(result + la, b, lb);
+    return result;
+}
+
+// Concatenates n strings into one allocation sized up front (a + b + c + ...).
+char* cookie_str_concat_n(const char** parts, int n) {
+    uint64_t total = 0;
+    for (int i = 0; i < n; i++)
+        total += cookie_str_len(parts[i]);
+    if (total > COOKIE_STR_CAP_MASK)
+        str_out_of_memory();
+    char* result = cookie_str_alloc((uint32_t)total);
+    char* p = result;
+    for (int i = 0; i < n; i++) {
+        uint32_t len = cookie_str_len(parts[i]);
+        memcpy(p, parts[i], len);
+        p += len;
+    }
+    return result;
+}
+
+// --- String builder ---
+// `s = s + x` compiles to s = cookie_str_append(s, x). The first append copies
+// s into a heap buffer marked UNIQUE with room to grow; later appends write in
+// place and double the capacity when it runs out, so building a string in a
+// loop is amortized O(n). Any read of the variable that can keep the pointer
+// calls cookie_str_share, which clears UNIQUE so the next append copies again
+// instead of changing a string someone else holds.
+char* cookie_str_append(char* s, const char* x) {
+    uint32_t ls = cookie_str_len(s), lx = cookie_str_len(x);
+    uint64_t need = (uint64_t)ls + lx;
+    if (need > COOKIE_STR_CAP_MASK)
+        str_out_of_memory();
+    CookieStr* h;
+    if (s && (str_header(s)->cap & COOKIE_STR_UNIQUE)) {
+        h = str_header(s);
+        uint32_t cap = h->cap & COOKIE_STR_CAP_MASK;
+        if (need > cap) {
+            uint64_t newCap = (uint64_t)cap * 2;
+            if (newCap < need) newCap = need;
+            if (newCap > COOKIE_STR_CAP_MASK) newCap = COOKIE_STR_CAP_MASK;
+            CookieStr* grown = (CookieStr*)realloc(h, sizeof(CookieStr) + newCap + 1);
+            if (!grown)
+                str_out_of_memory();
+            if (x == s)
+                x = (const char*)(grown + 1);
+            h = grown;
+            h->cap = (uint32_t)newCap | COOKIE_STR_HEAP | COOKIE_STR_UNIQUE;
+        }
+    } else {
+        uint64_t newCap = need * 2 < 32 ? 32 : need * 2;
+        if (newCap > COOKIE_STR_CAP_MASK) newCap = COOKIE_STR_CAP_MASK;
+        h = (CookieStr*)malloc(sizeof(CookieStr) + newCap + 1);
+        if (!h)
+            str_out_of_memory();
+        h->cap = (uint32_t)newCap | COOKIE_STR_HEAP | COOKIE_STR_UNIQUE;
+        if (ls)
+            memcpy(h + 1, s, ls);
+    }
+    char* data = (char*)(h + 1);
+    memcpy(data + ls, x, lx);
+    data[need] = '\0';
+    h->len = (uint32_t)need;
+    return data;
+}
+
+char* cookie_str_share(char* s) {
+    if (s && (str_header(s)->cap & COOKIE_STR_UNIQUE))
+        str_header(s)->cap &= ~COOKIE_STR_UNIQUE;
+    return s;
+}
+
+static struct {
+    CookieStr header;
+    char data[4];
+} one_char_strings[256];
+static pthread_once_t one_char_once = PTHREAD_ONCE_INIT;
+
+// Filled once, since parallel loop workers may ask for them at the same time.
+static void one_char_init(void) {
+    for (int c = 0; c < 256; c++) {
+        one_char_strings[c].data[0] = (char)c;
+        one_char_strings[c].header.cap = 1;
+        one_char_strings[c].header.len = 1;
+    }
+}
+
+char* cookie_str_from_char(int c) {
+    pthread_once(&one_char_once, one_char_init);
+    return one_char_strings[(unsigned char)c].data;
+}
+
+char* cookie_str_from_i32(int v) {
+    char tmp[16];
+    char* end = tmp + sizeof(tmp);
+    uint32_t mag = v < 0 ? 0u - (uint32_t)v : (uint32_t)v;
+    char* p = format_u64(end, mag);
+    if (v < 0)
+        *--p = '-';
+    uint32_t len = (uint32_t)(end - p);
+    char* result = cookie_str_alloc(len);
+    memcpy(result, p, len);
     return result;
 }
 
-// Reads a line from stdin into buffer (up to size-1 characters).
-// Returns 1 on success, 0 on failure.
-static int read_line(char *buffer, size_t size) {
-    if (fgets(buffer, size, stdin) == NULL)
+// s.at(index): 1-based character access with a bounds check.
+int cookie_str_at(const char* s, int index) {
+    uint32_t len = cookie_str_len(s);
+    if (index < 1 || (uint32_t)index > len) {
+        cookie_flush();
+        fprintf(stderr, "Runtime Error: index %d is out of range for a string of length %u.\n", index, len);
+        exit(EXIT_FAILURE);
+    }
+    return (unsigned char)s[index - 1];
+}
+
+// --- Arrays ---
+// Arrays whose size is only known at run time, or that grow with push/resize,
+// are a CookieArray header in the declaring function's frame. The data block
+// comes from malloc and grows geometrically, so push is amortized O(1). The
+// header starts zeroed; declaring the array again (inside a loop) reuses the
+// block, and the compiler frees it when the function returns.
+typedef struct CookieArray {
+    void* data;
+    int32_t len;
+    int32_t cap;
+} CookieArray;
+
+#define ARRAY_MIN_CAP 8
+
+static void array_fail(const char* fmt, ...) {
+    va_list ap;
+    cookie_flush();
+    fprintf(stderr, "Runtime Error: ");
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+// Ensure room for at least `need` elements, at least doubling the capacity.
+static void array_reserve(CookieArray* a, size_t elemSize, int64_t need) {
+    if (need <= a->cap)
+        return;
+    if (need > INT32_MAX)
+        array_fail("array size %lld is too large.", (long long)need);
+    int64_t cap = a->cap < ARRAY_MIN_CAP ? ARRAY_MIN_CAP : (int64_t)a->cap * 2;
+    if (cap < need)
+        cap = need;
+    if (cap > INT32_MAX)
+        cap = INT32_MAX;
+    void* data = realloc(a->data, (size_t)cap * elemSize);
+    if (!data)
+        array_fail("out of memory growing an array to %lld elements.", (long long)cap);
+    a->data = data;
+    a->cap = (int32_t)cap;
+}
+
+// Declaration: `len` zeroed elements.
+void cookie_array_init(CookieArray* a, size_t elemSize, int32_t len) {
+    if (len < 0)
+        array_fail("array size %d is negative.", len);
+    if (len > a->cap) {
+        // Nothing needs to be kept, so skip realloc's copy.
+        free(a->data);
+        a->data = calloc((size_t)len, elemSize);
+        if (!a->data)
+            array_fail("out of memory allocating an array of %d elements.", len);
+        a->cap = len;
+    } else if (len > 0) {
+        memset(a->data, 0, (size_t)len * elemSize);
+    }
+    a->len = len;
+}
+
+// push() slow path: the array is full.
+void cookie_array_grow(CookieArray* a, size_t elemSize) {
+    array_reserve(a, elemSize, (int64_t)a->len + 1);
+}
+
+void cookie_array_resize(CookieArray* a, size_t elemSize, int32_t len) {
+    if (len < 0)
+        array_fail("array size %d is negative.", len);
+    array_reserve(a, elemSize, len);
+    if (len > a->len)
+        memset((char*)a->data + (size_t)a->len * elemSize, 0,
+               (size_t)(len - a->len) * elemSize);
+    a->len = len;
+}
+
+// Whole-array arithmetic: every array operand must match the target's length.
+void cookie_array_check_length(int32_t expected, int32_t len) {
+    if (len != expected)
+        array_fail("array of length %d used where length %d is needed.", len, expected);
+}
+
+// Whole-array assignment between overlapping views of one array computes
+// into a temporary first.
+void* cookie_array_temp(int64_t bytes) {
+    void* p = malloc(bytes > 0 ? (size_t)bytes : 1);
+    if (!p)
+        array_fail("out of memory allocating %lld bytes.", (long long)bytes);
+    return p;
+}
+
+// min()/max() have no answer for an empty array.
+void cookie_array_check_nonempty(int32_t len, const char* what) {
+    if (len == 0)
+        array_fail("%s() of an empty array.", what);
+}
+
+// arr[lo:hi]: 1-based and inclusive; hi == lo - 1 is the empty slice.
+void cookie_array_check_slice(int32_t lo, int32_t hi, int32_t len) {
+    if (lo < 1 || hi > len || hi < lo - 1)
+        array_fail("slice [%d:%d] is out of range for an array of length %d.", lo, hi, len);
+}
+
+// pop(): removes the last element and returns its 0-based index.
+int32_t cookie_array_pop(CookieArray* a) {
+    if (a->len == 0)
+        array_fail("pop from an empty array.");
+    return --a->len;
+}
+
+// Bool arrays pack 64 elements into each uint64_t word, and for them len and
+// cap count bits. Bits at or past len are kept zero, so count/any/all can
+// work a word at a time without masking anything but the last word.
+#define BITS_WORDS(n) (((int64_t)(n) + 63) / 64)
+
+static void bits_reserve(CookieArray* a, int64_t need) {
+    if (need <= a->cap)
+        return;
+    CookieArray w = { a->data, 0, (int32_t)(a->cap / 64) };
+    array_reserve(&w, sizeof(uint64_t), BITS_WORDS(need));
+    memset((uint64_t*)w.data + a->cap / 64, 0, (size_t)(w.cap - a->cap / 64) * sizeof(uint64_t));
+    a->data = w.data;
+    a->cap = (int64_t)w.cap * 64 > INT32_MAX ? INT32_MAX : w.cap * 64;
+}
+
+// Clears bits [from, to), keeping the zero-past-len invariant.
+static void bits_clear(CookieArray* a, int32_t from, int32_t to) {
+    uint64_t* words = (uint64_t*)a->data;
+    if (from >= to)
+        return;
+    if (from % 64) {
+        words[from / 64] &= ((uint64_t)1 << (from % 64)) - 1;
+        from += 64 - from % 64;
+    }
+    if (from < to)
+        memset(words + from / 64, 0, (size_t)(BITS_WORDS(to) - from / 64) * sizeof(uint64_t));
+}
+
+void cookie_bits_init(CookieArray* a, int32_t len) {
+    if (len < 0)
+        array_fail("array size %d is negative.", len);
+    bits_reserve(a, len);
+    bits_clear(a, 0, len > a->len ? len : a->len);
+    a->len = len;
+}
+
+void cookie_bits_grow(CookieArray* a) {
+    bits_reserve(a, (int64_t)a->len + 1);
+}
+
+void cookie_bits_resize(CookieArray* a, int32_t len) {
+    if (len < 0)
+        array_fail("array size %d is negative.", len);
+    bits_reserve(a, len);
+    bits_clear(a, len, a->len);
+    a->len = len;
+}
+
+void cookie_array_free(CookieArray* a) {
+    free(a->data);
+    a->data = NULL;
+    a->len = 0;
+    a->cap = 0;
+}
+
+// --- Large arrays ---
+// Fixed-size arrays above the compiler's -stack-array-limit are not put on
+// the stack. main's become zeroed globals; other functions map them here.
+// Fresh anonymous pages read as zero, so nothing is touched until used.
+// With -huge-pages the block is 2 MB aligned and marked for transparent huge
+// pages, cutting TLB misses on big scans.
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+static size_t page_round(size_t bytes) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + page - 1) & ~(page - 1);
+}
+
+void cookie_array_advise(void* p, size_t bytes) {
+#if defined(MADV_HUGEPAGE)
+    madvise(p, page_round(bytes), MADV_HUGEPAGE);
+#else
+    (void)p; (void)bytes;
+#endif
+}
+
+// Returns `bytes` of zeroed memory. A non-null `old` block of the same size
+// (the array declared again in a loop) is cleared and reused.
+void* cookie_array_map(void* old, size_t bytes, int hugePages) {
+#if defined(__unix__) || defined(__APPLE__)
+    size_t size = page_round(bytes);
+    if (old) {
+#if defined(__linux__)
+        // Private anonymous pages are refilled with zeros on the next touch.
+        if (madvise(old, size, MADV_DONTNEED) == 0)
+            return old;
+#endif
+        memset(old, 0, bytes);
+        return old;
+    }
+    size_t extra = hugePages ? HUGE_PAGE_SIZE : 0;
+    char* p = (char*)mmap(NULL, size + extra, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == (char*)MAP_FAILED)
+        array_fail("out of memory mapping an array of %llu bytes.", (unsigned long long)bytes);
+    if (extra) {
+        // Trim to a 2 MB aligned block so it can be backed by huge pages.
+        char* aligned = (char*)(((uintptr_t)p + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1));
+        if (aligned > p)
+            munmap(p, (size_t)(aligned - p));
+        size_t tail = (size_t)(p + size + extra - (aligned + size));
+        if (tail)
+            munmap(aligned + size, tail);
+        p = aligned;
+        cookie_array_advise(p, size);
+    }
+    return p;
+#else
+    (void)hugePages;
+    if (old) {
+        memset(old, 0, bytes);
+        return old;
+    }
+    void* p = calloc(1, bytes);
+    if (!p)
+        array_fail("out of memory allocating an array of %llu bytes.", (unsigned long long)bytes);
+    return p;
+#endif
+}
+
+void cookie_array_unmap(void* p, size_t bytes) {
+    if (!p)
+        return;
+#if defined(__unix__) || defined(__APPLE__)
+    munmap(p, page_round(bytes));
+#else
+    (void)bytes;
+    free(p);
+#endif
+}
+
+// --- Sorting ---
+// sort(arr) sorts in place, ascending unless desc is nonzero. The algorithm
+// depends on the element type: int gets an LSD radix sort, char and bool are
+// counted, float uses pattern-defeating quicksort, and str uses multikey
+// quicksort.
+#define SORT_SMALL 24   // below this many elements insertion sort wins
+
+static void* sort_scratch(size_t bytes) {
+    void* p = malloc(bytes);
+    if (!p)
+        array_fail("out of memory while sorting %llu bytes.", (unsigned long long)bytes);
+    return p;
+}
+
+// Ints are sorted as unsigned keys. Flipping the sign bit puts negatives
+// first, and complementing the key reverses the order for desc.
+static inline uint32_t int_sort_key(int32_t v, uint32_t flip) {
+    return ((uint32_t)v ^ 0x80000000u) ^ flip;
+}
+
+// Four 8-bit passes, with the histograms for all of them built in one read.
+// A pass whose digit is the same in every key is skipped.
+void cookie_sort_i32(int32_t* data, int32_t n, int32_t desc) {
+    uint32_t flip = desc ? 0xffffffffu : 0;
+    if (n <= SORT_SMALL) {
+        for (int32_t i = 1; i < n; i++) {
+            int32_t v = data[i];
+            uint32_t k = int_sort_key(v, flip);
+            int32_t j = i;
+            for (; j > 0 && int_sort_key(data[j - 1], flip) > k; j--)
+                data[j] = data[j - 1];
+            data[j] = v;
+        }
+        return;
+    }
+    size_t counts[4][256] = {{0}};
+    for (int32_t i = 0; i < n; i++) {
+        uint32_t k = int_sort_key(data[i], flip);
+        counts[0][k & 255]++;
+        counts[1][(k >> 8) & 255]++;
+        counts[2][(k >> 16) & 255]++;
+        counts[3][k >> 24]++;
+    }
+    int32_t* buf = sort_scratch((size_t)n * sizeof(int32_t));
+    int32_t* src = data;
+    int32_t* dst = buf;
+    for (int pass = 0; pass < 4; pass++) {
+        size_t* c = counts[pass];
+        int shift = pass * 8;
+        if (c[(int_sort_key(src[0], flip) >> shift) & 255] == (size_t)n)
+            continue;
+        size_t sum = 0;
+        for (int d = 0; d < 256; d++) {
+            size_t t = c[d];
+            c[d] = sum;
+            sum += t;
+        }
+        for (int32_t i = 0; i < n; i++)
+            dst[c[(int_sort_key(src[i], flip) >> shift) & 255]++] = src[i];
+        int32_t* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != data)
+        memcpy(data, src, (size_t)n * sizeof(int32_t));
+    free(buf);
+}
+
+// Chars have one byte of key, so a single counting pass rewrites the array.
+void cookie_sort_char(char* data, int32_t n, int32_t desc) {
+    size_t counts[256] = {0};
+    for (int32_t i = 0; i < n; i++)
+        counts[(unsigned char)data[i]]++;
+    char* out = data;
+    for (int d = 0; d < 256; d++) {
+        int c = desc ? 255 - d : d;
+        memset(out, c, counts[c]);
+        out += counts[c];
+    }
+}
+
+static void bits_set(uint64_t* words, int64_t from, int64_t to) {
+    for (; from < to && (from & 63); from++)
+        words[from >> 6] |= 1ull << (from & 63);
+    for (; from + 64 <= to; from += 64)
+        words[from >> 6] = ~0ull;
+    for (; from < to; from++)
+        words[from >> 6] |= 1ull << (from & 63);
+}
+
+// Packed bools only need the number of true bits.
+void cookie_sort_bits(uint64_t* words, int32_t n, int32_t desc) {
+    int64_t nwords = BITS_WORDS(n);
+    int64_t ones = 0;
+    for (int64_t w = 0; w < nwords; w++)
+        ones += __builtin_popcountll(words[w]);
+    memset(words, 0, (size_t)nwords * sizeof(uint64_t));
+    if (desc)
+        bits_set(words, 0, ones);
+    else
+        bits_set(words, n - ones, n);
+}
+
+// Floats: pdqsort (Orson Peters). The partition is BlockQuicksort's branchless
+// scheme: a block of comparisons is recorded as offsets with no branch on the
+// result, then the misplaced elements on each side are swapped in bulk.
+// Patterns the pivot choice would degrade on are broken up by swaps, and a
+// run of bad partitions falls back to heapsort. NaNs are moved to the end
+// beforehand so everything else can be compared with <.
+#define PDQ_NINTHER 128
+#define PDQ_PARTIAL_LIMIT 8
+#define PDQ_BLOCK 64
+
+static inline void float_swap(float* a, float* b) {
+    float t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static inline void float_sort2(float* a, float* b) {
+    if (*b < *a)
+        float_swap(a, b);
+}
+
+static inline void float_sort3(float* a, float* b, float* c) {
+    float_sort2(a, b);
+    float_sort2(b, c);
+    float_sort2(a, b);
+}
+
+static void float_insertion_sort(float* begin, float* end) {
+    if (begin == end)
+        return;
+    for (float* cur = begin + 1; cur != end; cur++) {
+        float* sift = cur;
+        float v = *cur;
+        for (; sift != begin && v < sift[-1]; sift--)
+            *sift = sift[-1];
+        *sift = v;
+    }
+}
+
+// For a range that is not leftmost, the element before begin is no greater
+// than anything in it, which stops the scan without a bounds check.
+static void float_unguarded_insertion_sort(float* begin, float* end) {
+    if (begin == end)
+        return;
+    for (float* cur = begin + 1; cur != end; cur++) {
+        float* sift = cur;
+        float v = *cur;
+        for (; v < sift[-1]; sift--)
+            *sift = sift[-1];
+        *sift = v;
+    }
+}
+
+// Insertion sort that gives up once it has moved PDQ_PARTIAL_LIMIT elements.
+static int float_partial_insertion_sort(float* begin, float* end) {
+    if (begin == end)
+        return 1;
+    size_t moved = 0;
+    for (float* cur = begin + 1; cur != end; cur++) {
+        float* sift = cur;
+        float v = *cur;
+        for (; sift != begin && v < sift[-1]; sift--)
+            *sift = sift[-1];
+        *sift = v;
+        moved += (size_t)(cur - sift);
+        if (moved > PDQ_PARTIAL_LIMIT)
+            return 0;
+    }
+    return 1;
+}
+
+static void float_sift_down(float* heap, size_t n, size_t i) {
+    float v = heap[i];
+    for (size_t child; (child = 2 * i + 1) < n; i = child) {
+        if (child + 1 < n && heap[child] < heap[child + 1])
+            child++;
+        if (!(v < heap[child]))
+            break;
+        heap[i] = heap[child];
+    }
+    heap[i] = v;
+}
+
+static void float_heapsort(float* begin, float* end) {
+    size_t n = (size_t)(end - begin);
+    for (size_t i = n / 2; i-- > 0;)
+        float_sift_down(begin, n, i);
+    while (n > 1) {
+        float_swap(begin, begin + --n);
+        float_sift_down(begin, n, 0);
+    }
+}
+
+static void float_swap_offsets(float* first, float* last, const unsigned char* offsetsL,
+                               const unsigned char* offsetsR, size_t num, int useSwaps) {
+    if (useSwaps) {
+        // Equal counts on both sides need real swaps to keep descending input O(n).
+        for (size_t i = 0; i < num; i++)
+            float_swap(first + offsetsL[i], last - offsetsR[i]);
+    } else if (num > 0) {
+        // Otherwise rotate the elements through one temporary.
+        float* l = first + offsetsL[0];
+        float* r = last - offsetsR[0];
+        float tmp = *l;
+        *l = *r;
+        for (size_t i = 1; i < num; i++) {
+            l = first + offsetsL[i];
+            *r = *l;
+            r = last - offsetsR[i];
+            *l = *r;
+        }
+        *r = tmp;
+    }
+}
+
+// Partitions [begin, end) around *begin: smaller elements go left, the rest
+// right. Returns the pivot's final position and whether nothing had to move.
+static float* float_partition_right(float* begin, float* end, int* alreadyPartitioned) {
+    float pivot = *begin;
+    float* first = begin;
+    float* last = end;
+    while (*++first < pivot)
+        ;
+    if (first - 1 == begin)
+        while (first < last && !(*--last < pivot))
+            ;
+    else
+        while (!(*--last < pivot))
+            ;
+    *alreadyPartitioned = first >= last;
+    if (!*alreadyPartitioned) {
+        float_swap(first, last);
+        first++;
+        unsigned char offsetsL[PDQ_BLOCK], offsetsR[PDQ_BLOCK];
+        float* baseL = first;
+        float* baseR = last;
+        size_t numL = 0, numR = 0, startL = 0, startR = 0;
+        while (first < last) {
+            size_t unknown = (size_t)(last - first);
+            size_t splitL = numL == 0 ? (numR == 0 ? unknown / 2 : unknown) : 0;
+            size_t splitR = numR == 0 ? unknown - splitL : 0;
+            if (splitL > PDQ_BLOCK)
+                splitL = PDQ_BLOCK;
+            if (splitR > PDQ_BLOCK)
+                splitR = PDQ_BLOCK;
+            for (size_t i = 0; i < splitL; i++) {
+                offsetsL[numL] = (unsigned char)i;
+                numL += !(*first++ < pivot);
+            }
+            for (size_t i = 0; i < splitR;) {
+                offsetsR[numR] = (unsigned char)++i;
+                numR += *--last < pivot;
+            }
+            size_t num = numL < numR ? numL : numR;
+            float_swap_offsets(baseL, baseR, offsetsL + startL, offsetsR + startR, num, numL == numR);
+            numL -= num;
+            numR -= num;
+            startL += num;
+            startR += num;
+            if (numL == 0) {
+                startL = 0;
+                baseL = first;
+            }
+            if (numR == 0) {
+                startR = 0;
+                baseR = last;
+            }
+        }
+        // One side may still hold elements that belong on the other.
+        if (numL) {
+            while (numL--)
+                float_swap(baseL + offsetsL[startL + numL], --last);
+            first = last;
+        }
+        if (numR) {
+            while (numR--)
+                float_swap(baseR - offsetsR[startR + numR], first++);
+            last = first;
+        }
+    }
+    float* pivotPos = first - 1;
+    *begin = *pivotPos;
+    *pivotPos = pivot;
+    return pivotPos;
+}
+
+// Used when the pivot equals the element before the range: everything equal to
+// it goes left, where it is already in place.
+static float* float_partition_left(float* begin, float* end) {
+    float pivot = *begin;
+    float* first = begin;
+    float* last = end;
+    while (pivot < *--last)
+        ;
+    if (last + 1 == end)
+        while (first < last && !(pivot < *++first))
+            ;
+    else
+        while (!(pivot < *++first))
+            ;
+    while (first < last) {
+        float_swap(first, last);
+        while (pivot < *--last)
+            ;
+        while (!(pivot < *++first))
+            ;
+    }
+    *begin = *last;
+    *last = pivot;
+    return last;
+}
+
+static void float_pdqsort(float* begin, float* end, int badAllowed, int leftmost) {
+    for (;;) {
+        ptrdiff_t size = end - begin;
+        if (size < SORT_SMALL) {
+            if (leftmost)
+                float_insertion_sort(begin, end);
+            else
+                float_unguarded_insertion_sort(begin, end);
+            return;
+        }
+        // Median of three, or a pseudo-median of nine on large ranges, to *begin.
+        ptrdiff_t half = size / 2;
+        if (size > PDQ_NINTHER) {
+            float_sort3(begin, begin + half, end - 1);
+            float_sort3(begin + 1, begin + (half - 1), end - 2);
+            float_sort3(begin + 2, begin + (half + 1), end - 3);
+            float_sort3(begin + (half - 1), begin + half, begin + (half + 1));
+            float_swap(begin, begin + half);
+        } else {
+            float_sort3(begin + half, begin, end - 1);
+        }
+        if (!leftmost && !(begin[-1] < *begin)) {
+            begin = float_partition_left(begin, end) + 1;
+            continue;
+        }
+        int alreadyPartitioned;
+        float* pivotPos = float_partition_right(begin, end, &alreadyPartitioned);
+        ptrdiff_t sizeL = pivotPos - begin;
+        ptrdiff_t sizeR = end - (pivotPos + 1);
+        if (sizeL < size / 8 || sizeR < size / 8) {
+            if (--badAllowed == 0) {
+                float_heapsort(begin, end);
+                return;
+            }
+            if (sizeL >= SORT_SMALL) {
+                float_swap(begin, begin + sizeL / 4);
+                float_swap(pivotPos - 1, pivotPos - sizeL / 4);
+                if (sizeL > PDQ_NINTHER) {
+                    float_swap(begin + 1, begin + (sizeL / 4 + 1));
+                    float_swap(begin + 2, begin + (sizeL / 4 + 2));
+                    float_swap(pivotPos - 2, pivotPos - (sizeL / 4 + 1));
+                    float_swap(pivotPos - 3, pivotPos - (sizeL / 4 + 2));
+                }
+            }
+            if (sizeR >= SORT_SMALL) {
+                float_swap(pivotPos + 1, pivotPos + (1 + sizeR / 4));
+                float_swap(end - 1, end - sizeR / 4);
+                if (sizeR > PDQ_NINTHER) {
+                    float_swap(pivotPos + 2, pivotPos + (2 + sizeR / 4));
+                    float_swap(pivotPos + 3, pivotPos + (3 + sizeR / 4));
+                    float_swap(end - 2, end - (1 + sizeR / 4));
+                    float_swap(end - 3, end - (2 + sizeR / 4));
+                }
+            }
+        } else if (alreadyPartitioned && float_partial_insertion_sort(begin, pivotPos) &&
+                   float_partial_insertion_sort(pivotPos + 1, end)) {
+            return;
+        }
+        float_pdqsort(begin, pivotPos, badAllowed, leftmost);
+        begin = pivotPos + 1;
+        leftmost = 0;
+    }
+}
+
+void cookie_sort_f32(float* data, int32_t n, int32_t desc) {
+    int32_t m = 0;
+    for (int32_t i = 0; i < n; i++) {
+        if (data[i] == data[i])
+            float_swap(&data[m++], &data[i]);
+    }
+    int log2 = 0;
+    for (int32_t s = m; s > 1; s >>= 1)
+        log2++;
+    float_pdqsort(data, data + m, log2 + 1, 1);
+    if (desc) {
+        for (int32_t i = 0, j = m - 1; i < j; i++, j--)
+            float_swap(&data[i], &data[j]);
+    }
+}
+
+// Strings: multikey quicksort (Bentley and Sedgewick). Each step splits on one
+// byte at the current depth into less, equal and greater, and only the equal
+// part moves on to the next byte, so common prefixes are compared once.
+// Unassigned elements (NULL) sort as the empty string.
+static inline int str_byte(const char* s, size_t depth) {
+    return s ? (unsigned char)s[depth] : 0;
+}
+
+static inline void str_swap(char** a, char** b) {
+    char* t = *a;
+    *a = *b;
+    *b = t;
+}
+
+static void str_insertion_sort(char** a, size_t n, size_t depth) {
+    for (size_t i = 1; i < n; i++) {
+        char* v = a[i];
+        const char* vt = v ? v + depth : "";
+        size_t j = i;
+        for (; j > 0 && strcmp(a[j - 1] ? a[j - 1] + depth : "", vt) > 0; j--)
+            a[j] = a[j - 1];
+        a[j] = v;
+    }
+}
+
+static void str_mkqsort(char** a, size_t n, size_t depth) {
+    while (n > SORT_SMALL) {
+        // Median-of-three pivot byte.
+        int x = str_byte(a[0], depth), y = str_byte(a[n / 2], depth), z = str_byte(a[n - 1], depth);
+        int pivot = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+        size_t lt = 0, i = 0, gt = n;
+        while (i < gt) {
+            int c = str_byte(a[i], depth);
+            if (c < pivot)
+                str_swap(&a[lt++], &a[i++]);
+            else if (c > pivot)
+                str_swap(&a[i], &a[--gt]);
+            else
+                i++;
+        }
+        str_mkqsort(a, lt, depth);
+        str_mkqsort(a + gt, n - gt, depth);
+        // Strings that ended at this depth are all equal.
+        if (pivot == 0)
+            return;
+        a += lt;
+        n = gt - lt;
+        depth++;
+    }
+    str_insertion_sort(a, n, depth);
+}
+
+void cookie_sort_str(char** data, int32_t n, int32_t desc) {
+    str_mkqsort(data, (size_t)n, 0);
+    if (desc) {
+        for (int32_t i = 0, j = n - 1; i < j; i++, j--)
+            str_swap(&data[i], &data[j]);
+    }
+}
+
+// --- Maps ---
+// map<K,V> is an open-addressing hash table in the SwissTable layout. Every
+// slot has a control byte: EMPTY, DELETED, or the low 7 bits of the key's
+// hash when full. A lookup compares a whole group of control bytes against
+// those bits at once (16 with SSE2, 8 with plain 64-bit words). Only slots
+// whose byte matches are checked for the key, so a probe rarely touches more
+// than one slot. The table grows at 7/8 full. The first group of control
+// bytes is repeated after the last, so a group can be loaded at any slot
+// without wrapping.
+//
+// Each slot keeps its key's full hash. Rehashing never rehashes a string,
+// and a string key is only compared when its hash matches. Values are 8
+// bytes, read and written by compiled code at the map's value type. String
+// keys are shared when inserted so later appends to the caller's variable
+// copy instead of changing the key.
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define MAP_GROUP 16
+#else
+#define MAP_GROUP 8
+#endif
+#define MAP_EMPTY ((int8_t)-128)
+#define MAP_DELETED ((int8_t)-2)
+
+typedef struct MapSlot {
+    uint64_t hash;
+    union { int64_t i; char* s; } key;
+    uint64_t value;
+} MapSlot;
+
+typedef struct CookieMap {
+    int8_t* ctrl;        // cap + MAP_GROUP control bytes
+    MapSlot* slots;
+    int32_t len;
+    int32_t cap;         // a power of two, at least MAP_GROUP
+    int32_t growthLeft;  // inserts into EMPTY slots before the next rehash
+    int32_t strKeys;
+} CookieMap;
+
+static void map_out_of_memory(void) {
+    array_fail("out of memory growing a map.");
+}
+
+static inline uint64_t hash_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hash_str(const char* s) {
+    uint32_t len = cookie_str_len(s);
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+    uint32_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, s + i, 8);
+        h = (h ^ hash_mix(w)) * 0x9e3779b97f4a7c15ull;
+    }
+    uint64_t w = 0;
+    memcpy(&w, s + i, len - i);
+    return hash_mix(h ^ w);
+}
+
+static inline int str_equal(const char* a, const char* b) {
+    uint32_t len = cookie_str_len(a);
+    return len == cookie_str_len(b) && memcmp(a, b, len) == 0;
+}
+
+// Bit i of the result is set when control byte i of the group equals `tag`.
+// Without SSE2 the test runs on a 64-bit word and marks the high bit of each
+// matching byte.
+#if defined(__SSE2__)
+typedef uint32_t MapMask;
+static inline MapMask group_match(const int8_t* g, int8_t tag) {
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+}
+static inline MapMask group_match_empty(const int8_t* g) {
+    return group_match(g, MAP_EMPTY);
+}
+static inline MapMask group_match_free(const int8_t* g) {
+    return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)g));
+}
+static inline int group_next(MapMask* mask) {
+    int i = __builtin_ctz(*mask);
+    *mask &= *mask - 1;
+    return i;
+}
+// Slots before the first set bit, and after the last one.
+static inline int group_leading(MapMask mask) {
+    return __builtin_ctz(mask);
+}
+static inline int group_trailing(MapMask mask) {
+    return __builtin_clz(mask) - 16;
+}
+#else
+typedef uint64_t MapMask;
+static inline MapMask group_match(const int8_t* g, int8_t tag) {
+    uint64_t w, lsbs = 0x0101010101010101ull;
+    memcpy(&w, g, 8);
+    uint64_t x = w ^ (lsbs * (uint8_t)tag);
+    return (x - lsbs) & ~x & (lsbs << 7);
+}
+// EMPTY is the only control byte with the high bit set and bit 1 clear.
+static inline MapMask group_match_empty(const int8_t* g) {
+    uint64_t w;
+    memcpy(&w, g, 8);
+    return w & ~(w << 6) & 0x8080808080808080ull;
+}
+static inline MapMask group_match_free(const int8_t* g) {
+    uint64_t w;
+    memcpy(&w, g, 8);
+    return w & 0x8080808080808080ull;
+}
+static inline int group_next(MapMask* mask) {
+    int i = __builtin_ctzll(*mask) / 8;
+    *mask &= *mask - 1;
+    return i;
+}
+static inline int group_leading(MapMask mask) {
+    return __builtin_ctzll(mask) / 8;
+}
+static inline int group_trailing(MapMask mask) {
+    return __builtin_clzll(mask) / 8;
+}
+#endif
+
+static inline void map_set_ctrl(CookieMap* m, int32_t i, int8_t c) {
+    m->ctrl[i] = c;
+    if (i < MAP_GROUP)
+        m->ctrl[m->cap + i] = c;
+}
+
+// Finds the slot holding the key, or -1. Groups are probed at triangular
+// offsets, which visits every group of a power-of-two table. The subtraction
+// trick in the word version can report a false match next to a real one; the
+// key comparison filters it out.
+static int32_t map_find(const CookieMap* m, uint64_t hash, int64_t ikey, const char* skey) {
+    if (!m || m->len == 0)
+        return -1;
+    uint32_t mask = (uint32_t)m->cap - 1;
+    uint32_t pos = (uint32_t)(hash >> 7) & mask;
+    int8_t tag = (int8_t)(hash & 0x7f);
+    for (uint32_t step = MAP_GROUP;; step += MAP_GROUP) {
+        const int8_t* g = m->ctrl + pos;
+        for (MapMask hits = group_match(g, tag); hits;) {
+            int32_t i = (int32_t)((pos + group_next(&hits)) & mask);
+            const MapSlot* s = &m->slots[i];
+            if (m->strKeys ? s->hash == hash && str_equal(s->key.s, skey) : s->key.i == ikey)
+                return i;
+        }
+        if (group_match_empty(g))
+            return -1;
+        pos = (pos + step) & mask;
+    }
+}
+
+// First EMPTY or DELETED slot on the key's probe sequence.
+static int32_t map_find_free(const CookieMap* m, uint64_t hash) {
+    uint32_t mask = (uint32_t)m->cap - 1;
+    uint32_t pos = (uint32_t)(hash >> 7) & mask;
+    for (uint32_t step = MAP_GROUP;; step += MAP_GROUP) {
+        MapMask free = group_match_free(m->ctrl + pos);
+        if (free)
+            return (int32_t)((pos + group_next(&free)) & mask);
+        pos = (pos + step) & mask;
+    }
+}
+
+static void map_alloc(CookieMap* m, int32_t cap) {
+    m->ctrl = (int8_t*)malloc((size_t)cap + MAP_GROUP);
+    m->slots = (MapSlot*)malloc((size_t)cap * sizeof(MapSlot));
+    if (!m->ctrl || !m->slots)
+        map_out_of_memory();
+    memset(m->ctrl, MAP_EMPTY, (size_t)cap + MAP_GROUP);
+    m->cap = cap;
+    m->len = 0;
+    m->growthLeft = cap - cap / 8;
+}
+
+// Doubles the table, or rebuilds it at the same size when DELETED slots rather
+// than live keys used up the growth allowance.
+static void map_rehash(CookieMap* m) {
+    int32_t oldCap = m->cap;
+    int8_t* oldCtrl = m->ctrl;
+    MapSlot* oldSlots = m->slots;
+    int32_t cap = oldCap == 0 ? MAP_GROUP : oldCap;
+    if (m->len >= cap / 2 - cap / 16) {
+        if (cap > INT32_MAX / 2)
+            map_out_of_memory();
+        if (oldCap)
+            cap *= 2;
+    }
+    int32_t len = m->len;
+    map_alloc(m, cap);
+    for (int32_t i = 0; i < oldCap; i++) {
+        if (oldCtrl[i] < 0)
+            continue;
+        int32_t j = map_find_free(m, oldSlots[i].hash);
+        map_set_ctrl(m, j, oldCtrl[i]);
+        m->slots[j] = oldSlots[i];
+    }
+    m->len = len;
+    m->growthLeft -= len;
+    free(oldCtrl);
+    free(oldSlots);
+}
+
+// Returns the slot for the key, inserting it with a zero value if absent.
+static MapSlot* map_insert(CookieMap* m, uint64_t hash, int64_t ikey, char* skey) {
+    int32_t i = map_find(m, hash, ikey, skey);
+    if (i >= 0)
+        return &m->slots[i];
+    if (m->growthLeft == 0)
+        map_rehash(m);
+    i = map_find_free(m, hash);
+    if (m->ctrl[i] == MAP_EMPTY)
+        m->growthLeft--;
+    map_set_ctrl(m, i, (int8_t)(hash & 0x7f));
+    m->len++;
+    MapSlot* s = &m->slots[i];
+    s->hash = hash;
+    if (m->strKeys)
+        s->key.s = cookie_str_share(skey);
+    else
+        s->key.i = ikey;
+    s->value = 0;
+    return s;
+}
+
+// A removed slot can go back to EMPTY only if fewer than a group's worth of
+// non-empty slots surround it. Then every group that covers it also holds an
+// EMPTY, so no probe ever went past it to find a different key. Otherwise it
+// becomes DELETED, which probes continue through.
+static int map_erase(CookieMap* m, int32_t i) {
+    if (i < 0)
+        return 0;
+    uint32_t mask = (uint32_t)m->cap - 1;
+    MapMask after = group_match_empty(m->ctrl + i);
+    MapMask before = group_match_empty(m->ctrl + ((i - MAP_GROUP) & mask));
+    int emptyNearby = after && before && group_leading(after) + group_trailing(before) < MAP_GROUP;
+    map_set_ctrl(m, i, emptyNearby ? MAP_EMPTY : MAP_DELETED);
+    if (emptyNearby)
+        m->growthLeft++;
+    m->len--;
+    return 1;
+}
+
+// Declaring a map again (in a loop) clears the old table instead of leaking it.
+CookieMap* cookie_map_init(CookieMap* old, int32_t strKeys) {
+    CookieMap* m = old;
+    if (m) {
+        free(m->ctrl);
+        free(m->slots);
+    } else {
+        m = (CookieMap*)malloc(sizeof(CookieMap));
+        if (!m)
+            map_out_of_memory();
+    }
+    memset(m, 0, sizeof(CookieMap));
+    m->strKeys = strKeys;
+    return m;
+}
+
+void cookie_map_free(CookieMap* m) {
+    if (!m)
+        return;
+    free(m->ctrl);
+    free(m->slots);
+    free(m);
+}
+
+int32_t cookie_map_size(const CookieMap* m) {
+    return m ? m->len : 0;
+}
+
+// Pointer to the value for the key, or NULL when the key is absent.
+void* cookie_map_find_int(CookieMap* m, int64_t key) {
+    int32_t i = map_find(m, hash_mix((uint64_t)key), key, NULL);
+    return i < 0 ? NULL : &m->slots[i].value;
+}
+
+void* cookie_map_find_str(CookieMap* m, char* key) {
+    int32_t i = map_find(m, hash_str(key), 0, key);
+    return i < 0 ? NULL : &m->slots[i].value;
+}
+
+// Pointer to the value for the key, adding the key first if needed.
+void* cookie_map_put_int(CookieMap* m, int64_t key) {
+    return &map_insert(m, hash_mix((uint64_t)key), key, NULL)->value;
+}
+
+void* cookie_map_put_str(CookieMap* m, char* key) {
+    return &map_insert(m, hash_str(key), 0, key)->value;
+}
+
+int32_t cookie_map_remove_int(CookieMap* m, int64_t key) {
+    return map_erase(m, map_find(m, hash_mix((uint64_t)key), key, NULL));
+}
+
+int32_t cookie_map_remove_str(CookieMap* m, char* key) {
+    return map_erase(m, map_find(m, hash_str(key), 0, key));
+}
+
+// Iteration: index of the first full slot at or after pos, or -1 at the end.
+int32_t cookie_map_next(const CookieMap* m, int32_t pos) {
+    for (; pos < m->cap; pos++) {
+        if (m->ctrl[pos] >= 0)
+            return pos;
+    }
+    return -1;
+}
+
+void* cookie_map_key(CookieMap* m, int32_t pos) {
+    return &m->slots[pos].key;
+}
+
+// --- Buffered input ---
+// input() reads stdin through one buffer instead of fgets per value. A regular
+// file is mmap'd whole; pipes and terminals are read in large blocks into a
+// buffer that grows as needed, so lines of any length are handled. Values are
+// parsed in place without copying.
+#define IN_BLOCK_SIZE (1 << 20)
+
+static const char* in_data = NULL;   // mapped file or in_buf
+static char* in_buf = NULL;
+static size_t in_pos = 0, in_len = 0, in_cap = 0;
+static int in_initialized = 0;
+static int in_eof = 0;
+
+static void in_init(void) {
+    in_initialized = 1;
+#if defined(__unix__) || defined(__APPLE__)
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+#ifdef MAP_POPULATE
+        int flags = MAP_PRIVATE | MAP_POPULATE;   // prefault instead of one fault per page
+#else
+        int flags = MAP_PRIVATE;
+#endif
+        void* map = mmap(NULL, (size_t)st.st_size, PROT_READ, flags, STDIN_FILENO, 0);
+        if (map != MAP_FAILED) {
+            madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+            in_data = (const char*)map;
+            in_len = (size_t)st.st_size;
+            if (offset > 0)   // start where the shell left stdin
+                in_pos = (size_t)offset < in_len ? (size_t)offset : in_len;
+            in_eof = 1;
+            return;
+        }
+    }
+#endif
+    in_cap = IN_BLOCK_SIZE;
+    in_buf = (char*)malloc(in_cap);
+    if (!in_buf) {
+        fprintf(stderr, "Error: out of memory reading input.\n");
+        exit(EXIT_FAILURE);
+    }
+    in_data = in_buf;
+}
+
+// Appends more of stdin after the unread bytes, moving them to the front of
+// the buffer first. Pointers into the buffer are invalid afterwards; callers
+// keep offsets from in_pos instead. Returns 0 at end of input.
+static int in_more(void) {
+    if (in_eof)
+        return 0;
+    if (in_pos > 0) {
+        memmove(in_buf, in_buf + in_pos, in_len - in_pos);
+        in_len -= in_pos;
+        in_pos = 0;
+    }
+    if (in_len == in_cap) {
+        char* grown = (char*)realloc(in_buf, in_cap * 2);
+        if (!grown) {
+            fprintf(stderr, "Error: out of memory reading input.\n");
+            exit(EXIT_FAILURE);
+        }
+        in_buf = grown;
+        in_cap *= 2;
+        in_data = in_buf;
+    }
+    ssize_t n;
+    do {
+        n = read(STDIN_FILENO, in_buf + in_len, in_cap - in_len);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        in_eof = 1;
         return 0;
-    size_t len = strlen(buffer);
-    if (len > 0 && buffer[len - 1] == '\n')
-        buffer[len - 1] = '\0';
+    }
+    in_len += (size_t)n;
     return 1;
 }
 
+// Returns the next line (without its '\n') and its length, or NULL at end of input.
+static const char* in_next_line(size_t* len) {
+    if (!in_initialized)
+        in_init();
+    size_t scanned = 0;
+    for (;;) {
+        const char* start = in_data + in_pos;
+        const char* nl = (const char*)memchr(start + scanned, '\n', in_len - in_pos - scanned);
+        if (nl) {
+            *len = (size_t)(nl - start);
+            in_pos += *len + 1;
+            return start;
+        }
+        scanned = in_len - in_pos;
+        if (!in_more()) {
+            if (in_pos == in_len)
+                return NULL;
+            start = in_data + in_pos;
+            *len = in_len - in_pos;
+            in_pos = in_len;
+            return start;
+        }
+    }
+}
+
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline int is_space(char c) {
+    return c == ' ' || (unsigned)(c - '\t') < 5;   // \t \n \v \f \r
+}
+
+// Drops trailing blanks and the newline after the last token, so a following
+// line-based read starts on the next line rather than an empty remainder.
+static void in_finish_line(void) {
+    if (!in_initialized)
+        return;
+    for (;;) {
+        while (in_pos < in_len && is_blank(in_data[in_pos]))
+            in_pos++;
+        if (in_pos < in_len) {
+            if (in_data[in_pos] == '\n')
+                in_pos++;
+            return;
+        }
+        if (!in_more())
+            return;
+    }
+}
+
+// Returns the next whitespace-separated token (across lines), or NULL at end of input.
+static const char* in_next_token(size_t* len) {
+    if (!in_initialized)
+        in_init();
+    for (;;) {
+        while (in_pos < in_len && is_space(in_data[in_pos]))
+            in_pos++;
+        if (in_pos < in_len)
+            break;
+        if (!in_more())
+            return NULL;
+    }
+    size_t n = 0;
+    for (;;) {
+        while (in_pos + n < in_len && !is_space(in_data[in_pos + n]))
+            n++;
+        if (in_pos + n < in_len || !in_more())
+            break;
+    }
+    const char* start = in_data + in_pos;
+    *len = n;
+    in_pos += n;
+    return start;
+}
+
+
+// Parses a whole int from [p, end) allowing surrounding blanks. Returns 0 if
+// the text is not an int. Out-of-range values are truncated to 32 bits.
+static int parse_int(const char* p, const char* end, int* out) {
+    while (p < end && is_blank(*p)) p++;
+    int negative = 0;
+    if (p < end && (*p == '+' || *p == '-'))
+        negative = *p++ == '-';
+    const char* digits = p;
+    uint64_t v = 0;
+    while (p < end && (unsigned)(*p - '0') < 10) {
+        if (v < ((uint64_t)1 << 60))
+            v = v * 10 + (uint64_t)(*p - '0');
+        p++;
+    }
+    if (p == digits)
+        return 0;
+    while (p < end && is_blank(*p)) p++;
+    if (p != end)
+        return 0;
+    *out = (int)(uint32_t)(negative ? 0 - v : v);
+    return 1;
+}
+
+// Parses a whole float from [p, end) allowing surrounding blanks. Plain
+// decimals whose digits fit in 24 bits with at most 10 fractional digits are
+// converted exactly with one float multiply or divide (Clinger's fast path);
+// everything else (exponents, inf, hex, long mantissas) goes to strtof.
+static int parse_float(const char* p, const char* end, float* out) {
+    static const float pow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    while (p < end && is_blank(*p)) p++;
+    while (end > p && is_blank(end[-1])) end--;
+    if (p == end)
+        return 0;
+    const char* q = p;
+    int negative = 0;
+    if (*q == '+' || *q == '-')
+        negative = *q++ == '-';
+    uint32_t mantissa = 0;
+    int digits = 0, fraction = 0, fast = 1;
+    while (q < end && (unsigned)(*q - '0') < 10) {
+        mantissa = mantissa * 10 + (uint32_t)(*q++ - '0');
+        if (mantissa > (1u << 24)) { fast = 0; break; }
+        digits++;
+    }
+    if (fast && q < end && *q == '.') {
+        q++;
+        while (q < end && (unsigned)(*q - '0') < 10) {
+            mantissa = mantissa * 10 + (uint32_t)(*q++ - '0');
+            if (mantissa > (1u << 24) || ++fraction > 10) { fast = 0; break; }
+            digits++;
+        }
+    }
+    if (fast && digits > 0 && q == end) {
+        float v = fraction ? (float)mantissa / pow10f[fraction] : (float)mantissa;
+        *out = negative ? -v : v;
+        return 1;
+    }
+    char small[64];
+    size_t n = (size_t)(end - p);
+    char* copy = n < sizeof(small) ? small : (char*)malloc(n + 1);
+    if (!copy)
+        return 0;
+    memcpy(copy, p, n);
+    copy[n] = '\0';
+    char* endptr;
+    *out = strtof(copy, &endptr);
+    int ok = endptr != copy && *endptr == '\0';
+    if (copy != small)
+        free(copy);
+    return ok;
+}
+
+static int parse_bool(const char* p, size_t len, int* out) {
+    if (len == 4 && memcmp(p, "true", 4) == 0) { *out = 1; return 1; }
+    if (len == 5 && memcmp(p, "false", 5) == 0) { *out = 0; return 1; }
+    return 0;
+}
+
+static void input_type_error(const char* type) {
+    write_cstr("Input Is not of type: ");
+    write_cstr(type);
+    cookie_write_newline();
+}
+
+static const char* read_input_line(size_t* len) {
+    cookie_flush();
+    const char* line = in_next_line(len);
+    if (!line)
+        fprintf(stderr, "Error reading input.\n");
+    return line;
+}
+
 // read_int(): Reads and validates an integer.
 int read_int() {
-    char buffer[128];
-    if (!read_line(buffer, sizeof(buffer))) {
-        fprintf(stderr, "Error reading input.\n");
+    size_t len;
+    const char* line = read_input_line(&len);
+    int val;
+    if (!line)
         return 0;
-    }
-    char *endptr;
-    long val = strtol(buffer, &endptr, 10);
-    while (isspace((unsigned char)*endptr)) endptr++;
-    if (*endptr != '\0') {
-        printf("Input Is not of type: Int\n");
+    if (!parse_int(line, line + len, &val)) {
+        input_type_error("Int");
         return 0;
     }
-    return (int)val;
+    return val;
 }
 
 // read_float(): Reads and validates a float.
 float read_float() {
-    char buffer[128];
-    if (!read_line(buffer, sizeof(buffer))) {
-        fprintf(stderr, "Error reading input.\n");
+    size_t len;
+    const char* line = read_input_line(&len);
+    float val;
+    if (!line)
         return 0.0f;
-    }
-    char *endptr;
-    float val = strtof(buffer, &endptr);
-    while (isspace((unsigned char)*endptr)) endptr++;
-    if (*endptr != '\0') {
-        printf("Input Is not of type: Float\n");
+    if (!parse_float(line, line + len, &val)) {
+        input_type_error("Float");
         return 0.0f;
     }
     return val;
@@ -61,63 +1638,161 @@ float read_float() {
 
 // read_bool(): Reads and validates a boolean (only accepts "true" or "false").
 int read_bool() {
-    char buffer[128];
-    if (!read_line(buffer, sizeof(buffer))) {
-        fprintf(stderr, "Error reading input.\n");
-        return 0;
-    }
-    if (strcmp(buffer, "true") == 0)
-        return 1;
-    else if (strcmp(buffer, "false") == 0)
+    size_t len;
+    const char* line = read_input_line(&len);
+    int val;
+    if (!line)
         return 0;
-    else {
-        printf("Input Is not of type: Bool\n");
+    if (!parse_bool(line, len, &val)) {
+        input_type_error("Bool");
         return 0;
     }
+    return val;
 }
 
 // read_char(): Reads and validates a single character.
 char read_char() {
-    char buffer[128];
-    if (!read_line(buffer, sizeof(buffer))) {
-        fprintf(stderr, "Error reading input.\n");
+    size_t len;
+    const char* line = read_input_line(&len);
+    if (!line)
         return '\0';
-    }
-    char *ptr = buffer;
-    while (isspace((unsigned char)*ptr)) ptr++;
-    size_t len = strlen(ptr);
-    if (len != 1) {
-        printf("Input Is not of type: Char\n");
+    const char* end = line + len;
+    while (line < end && isspace((unsigned char)*line)) line++;
+    if (end - line != 1) {
+        input_type_error("Char");
         return '\0';
     }
-    return ptr[0];
+    return line[0];
 }
 
 // read_string(): Reads a line as a string (any input is accepted).
 char* read_string() {
-    char buffer[1024];
-    if (!read_line(buffer, sizeof(buffer))) {
-        fprintf(stderr, "Error reading input.\n");
-        return strdup("");
+    size_t len;
+    const char* line = read_input_line(&len);
+    if (!line)
+        return cookie_str_alloc(0);
+    char* s = cookie_str_alloc((uint32_t)len);
+    memcpy(s, line, len);
+    return s;
+}
+
+// --- Whole-array input ---
+// input(arr) fills every element from one call. Numbers, bools and chars are
+// whitespace-separated tokens (any mix of spaces and newlines); strings are
+// one line each. Running out of input reports once and zeroes the rest.
+static const char* read_array_token(size_t* len, int index, int count) {
+    const char* tok = in_next_token(len);
+    if (!tok)
+        fprintf(stderr, "Error reading input: expected %d values, got %d.\n", count, index);
+    return tok;
+}
+
+// Parses a plain int token straight out of the input buffer when it is
+// followed by whitespace already in the buffer, skipping the separate
+// token scan. Returns 0 when the caller should take the general path.
+static int in_fast_int(int* out) {
+    while (in_pos < in_len && is_space(in_data[in_pos]))
+        in_pos++;
+    const char* p = in_data + in_pos;
+    const char* end = in_data + in_len;
+    int negative = 0;
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    const char* digits = p;
+    uint32_t v = 0;
+    while (p < end && (unsigned)(*p - '0') < 10 && p - digits < 9)
+        v = v * 10 + (uint32_t)(*p++ - '0');
+    if (p == digits || (p < end ? !is_space(*p) : !in_eof))
+        return 0;
+    *out = negative ? -(int)v : (int)v;
+    in_pos = (size_t)(p - in_data);
+    return 1;
+}
+
+void read_int_array(int* data, int count) {
+    cookie_flush();
+    if (!in_initialized)
+        in_init();
+    for (int i = 0; i < count; i++) {
+        if (in_fast_int(&data[i]))
+            continue;
+        size_t len;
+        const char* tok = read_array_token(&len, i, count);
+        if (!tok) {
+            memset(data + i, 0, (size_t)(count - i) * sizeof(int));
+            return;
+        }
+        if (!parse_int(tok, tok + len, &data[i])) {
+            input_type_error("Int");
+            data[i] = 0;
+        }
     }
-    return strdup(buffer);
+    in_finish_line();
 }
 
-// Converts a char to its string representation.
-// Caller is responsible for freeing the returned string.
-char* char_to_string(char c) {
-    char buffer[2];
-    buffer[0] = c;
-    buffer[1] = '\0';
-    return strdup(buffer);
+void read_float_array(float* data, int count) {
+    cookie_flush();
+    for (int i = 0; i < count; i++) {
+        size_t len;
+        const char* tok = read_array_token(&len, i, count);
+        if (!tok) {
+            memset(data + i, 0, (size_t)(count - i) * sizeof(float));
+            return;
+        }
+        if (!parse_float(tok, tok + len, &data[i])) {
+            input_type_error("Float");
+            data[i] = 0.0f;
+        }
+    }
+    in_finish_line();
+}
+
+// Bool arrays are packed 64 per word (see cookie_bits_init).
+void read_bool_array(uint64_t* words, int count) {
+    cookie_flush();
+    for (int i = 0; i < count; i++) {
+        size_t len;
+        int val = 0;
+        const char* tok = read_array_token(&len, i, count);
+        if (!tok) {
+            for (; i < count; i++)
+                words[i / 64] &= ~((uint64_t)1 << (i % 64));
+            return;
+        }
+        if (!parse_bool(tok, len, &val))
+            input_type_error("Bool");
+        if (val)
+            words[i / 64] |= (uint64_t)1 << (i % 64);
+        else
+            words[i / 64] &= ~((uint64_t)1 << (i % 64));
+    }
+    in_finish_line();
+}
+
+void read_char_array(char* data, int count) {
+    cookie_flush();
+    for (int i = 0; i < count; i++) {
+        size_t len;
+        const char* tok = read_array_token(&len, i, count);
+        if (!tok) {
+            memset(data + i, 0, (size_t)(count - i));
+            return;
+        }
+        if (len != 1) {
+            input_type_error("Char");
+            data[i] = '\0';
+        } else {
+            data[i] = tok[0];
+        }
+    }
+    in_finish_line();
 }
 
-// Converts an int to its string representation.
-// Caller is responsible for freeing the returned string.
-char* int_to_string(int x) {
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%d", x);
-    return strdup(buffer);
+void read_string_array(char** data, int count) {
+    for (int i = 0; i < count; i++)
+        data[i] = read_string();
 }
 
 // Converts a string to an int.
@@ -130,4 +1805,749 @@ int string_to_int(const char* s) {
         exit(EXIT_FAILURE);
     }
     return (int)val;
-}
\ No newline at end of file
+}
+// --- Parallel loops ---
+// The body of `parallel loop i : lo : hi` is compiled into a function that
+// runs iterations [begin, end) and finds the loop's variables through env.
+// cookie_parallel_for runs it on a pool with one thread per core (the calling
+// thread is one of them; COOKIE_THREADS overrides the count). Each thread
+// keeps a deque of tasks. A task halves its range, pushes the back half and
+// carries on with the front until the range is down to the grain size, so
+// the oldest task in a deque is the largest; an idle thread steals that one
+// from another thread's deque. The caller runs tasks too until every
+// iteration is done, so a parallel loop inside another one cannot deadlock.
+typedef struct PoolTask PoolTask;
+struct PoolTask {
+    void (*run)(PoolTask* task);
+};
+
+typedef struct {
+    pthread_mutex_t lock;
+    PoolTask** items;   // the owner pushes and pops at tail, thieves take from head
+    int head, tail, cap;
+} PoolDeque;
+
+static int pool_size = 1;
+static PoolDeque* pool_deques = NULL;
+static pthread_once_t pool_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t pool_sleep_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static int pool_queued = 0;   // tasks in all deques
+static int pool_idle = 0;     // threads asleep on pool_wake
+static _Thread_local int pool_self = 0;   // this thread's deque; 0 for the main thread
+
+static void pool_fail(void) {
+    cookie_flush();
+    fprintf(stderr, "Runtime Error: out of memory in the parallel loop scheduler.\n");
+    exit(EXIT_FAILURE);
+}
+
+static void pool_push(PoolTask* task) {
+    PoolDeque* d = &pool_deques[pool_self];
+    pthread_mutex_lock(&d->lock);
+    if (d->tail == d->cap) {
+        if (d->head > 0) {
+            memmove(d->items, d->items + d->head, (size_t)(d->tail - d->head) * sizeof(PoolTask*));
+            d->tail -= d->head;
+            d->head = 0;
+        } else {
+            int cap = d->cap ? d->cap * 2 : 64;
+            PoolTask** items = (PoolTask**)realloc(d->items, (size_t)cap * sizeof(PoolTask*));
+            if (!items)
+                pool_fail();
+            d->items = items;
+            d->cap = cap;
+        }
+    }
+    d->items[d->tail++] = task;
+    pthread_mutex_unlock(&d->lock);
+    __atomic_add_fetch(&pool_queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool_idle, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&pool_sleep_lock);
+        pthread_cond_signal(&pool_wake);
+        pthread_mutex_unlock(&pool_sleep_lock);
+    }
+}
+
+// Takes the newest task of deque i (steal == 0, the owner) or its oldest
+// (a thief); null if it is empty.
+static PoolTask* pool_take(int i, int steal) {
+    PoolDeque* d = &pool_deques[i];
+    PoolTask* task = NULL;
+    pthread_mutex_lock(&d->lock);
+    if (d->head < d->tail) {
+        task = steal ? d->items[d->head++] : d->items[--d->tail];
+        if (d->head == d->tail)
+            d->head = d->tail = 0;
+    }
+    pthread_mutex_unlock(&d->lock);
+    if (task)
+        __atomic_sub_fetch(&pool_queued, 1, __ATOMIC_SEQ_CST);
+    return task;
+}
+
+static PoolTask* pool_find_task(void) {
+    PoolTask* task = pool_take(pool_self, 0);
+    for (int k = 1; !task && k < pool_size; k++)
+        task = pool_take((pool_self + k) % pool_size, 1);
+    return task;
+}
+
+static void* pool_worker(void* arg) {
+    pool_self = (int)(intptr_t)arg;
+    for (;;) {
+        PoolTask* task = pool_find_task();
+        if (task) {
+            task->run(task);
+            continue;
+        }
+        pthread_mutex_lock(&pool_sleep_lock);
+        __atomic_add_fetch(&pool_idle, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&pool_queued, __ATOMIC_SEQ_CST) == 0)
+            pthread_cond_wait(&pool_wake, &pool_sleep_lock);
+        __atomic_sub_fetch(&pool_idle, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&pool_sleep_lock);
+    }
+    return NULL;
+}
+
+static void pool_start(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    const char* env = getenv("COOKIE_THREADS");
+    if (env && atoi(env) > 0)
+        n = atoi(env);
+    pool_size = n > 1 ? (int)n : 1;
+    pool_deques = (PoolDeque*)calloc((size_t)pool_size, sizeof(PoolDeque));
+    if (!pool_deques)
+        pool_fail();
+    for (int i = 0; i < pool_size; i++)
+        pthread_mutex_init(&pool_deques[i].lock, NULL);
+    for (int i = 1; i < pool_size; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, pool_worker, (void*)(intptr_t)i) != 0) {
+            pool_size = i;   // run with the threads we have
+            break;
+        }
+        pthread_detach(thread);
+    }
+}
+
+// Ranges are int64_t so that the end of one reaching INT32_MAX is INT32_MAX + 1.
+typedef void (*CookieLoopBody)(void** env, int64_t begin, int64_t end);
+
+typedef struct {
+    CookieLoopBody body;
+    void** env;
+    int64_t grain;
+    int64_t remaining;   // iterations not yet run
+} ParallelLoop;
+
+typedef struct {
+    PoolTask task;
+    ParallelLoop* loop;
+    int64_t begin, end;
+} LoopTask;
+
+static void loop_task_run(PoolTask* task);
+
+static void loop_task_push(ParallelLoop* loop, int64_t begin, int64_t end) {
+    LoopTask* t = (LoopTask*)malloc(sizeof(LoopTask));
+    if (!t)
+        pool_fail();
+    t->task.run = loop_task_run;
+    t->loop = loop;
+    t->begin = begin;
+    t->end = end;
+    pool_push(&t->task);
+}
+
+static void loop_run_range(ParallelLoop* loop, int64_t begin, int64_t end) {
+    while (end - begin > loop->grain) {
+        int64_t mid = begin + (end - begin) / 2;
+        loop_task_push(loop, mid, end);
+        end = mid;
+    }
+    loop->body(loop->env, begin, end);
+    // Output from another thread must be out before the loop is seen as done.
+    if (pool_self != 0)
+        cookie_flush();
+    __atomic_sub_fetch(&loop->remaining, end - begin, __ATOMIC_RELEASE);
+}
+
+static void loop_task_run(PoolTask* task) {
+    LoopTask* t = (LoopTask*)task;
+    ParallelLoop* loop = t->loop;
+    int64_t begin = t->begin, end = t->end;
+    free(t);
+    loop_run_range(loop, begin, end);
+}
+
+// Runs body over [first, last], both inclusive, and returns when every
+// iteration has finished.
+void cookie_parallel_for(CookieLoopBody body, void** env, int32_t first, int32_t last) {
+    if (last < first)
+        return;
+    pthread_once(&pool_once, pool_start);
+    int64_t end = (int64_t)last + 1;
+    int64_t count = end - first;
+    // About eight tasks per thread, so a slow piece can be balanced by stealing.
+    int64_t grain = count / ((int64_t)pool_size * 8);
+    if (grain < 1)
+        grain = 1;
+    if (pool_size == 1 || count == 1) {
+        body(env, first, end);
+        return;
+    }
+    // Earlier output has to come out before anything a worker prints.
+    cookie_flush();
+    ParallelLoop loop = {body, env, grain, count};
+    loop_run_range(&loop, first, end);
+    while (__atomic_load_n(&loop.remaining, __ATOMIC_ACQUIRE) > 0) {
+        PoolTask* task = pool_find_task();
+        if (task)
+            task->run(task);
+        else
+            sched_yield();
+    }
+}
+
+// reduce clauses: each piece of a loop folds its partial result into the
+// shared variable while holding this lock.
+static pthread_mutex_t parallel_reduce_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void cookie_parallel_lock(void) {
+    pthread_mutex_lock(&parallel_reduce_lock);
+}
+
+void cookie_parallel_unlock(void) {
+    pthread_mutex_unlock(&parallel_reduce_lock);
+}
+
+// --- Tasks ---
+// `spawn f(a, b)` allocates a frame holding the arguments and a slot for the
+// result, with a TaskHeader in front of it, and pushes it on the calling
+// thread's deque of the parallel loop pool; the compiled thunk calls f and
+// stores the result. await(h) runs tasks (its own first, as the newest in its
+// deque) until the awaited one is done, then the compiled code reads the
+// result and frees the frame. With a single thread, spawn just runs the call,
+// except for tasks that use channels (see cookie_task_spawn_thread).
+typedef struct {
+    PoolTask task;
+    void (*thunk)(void* frame);
+    int done;
+} TaskHeader;
+
+static inline TaskHeader* task_header(void* frame) {
+    return (TaskHeader*)frame - 1;
+}
+
+static void task_run(PoolTask* task) {
+    TaskHeader* h = (TaskHeader*)task;
+    h->thunk(h + 1);
+    if (pool_self != 0)
+        cookie_flush();
+    __atomic_store_n(&h->done, 1, __ATOMIC_RELEASE);
+}
+
+void* cookie_task_new(int64_t frameSize) {
+    TaskHeader* h = (TaskHeader*)malloc(sizeof(TaskHeader) + (size_t)frameSize);
+    if (!h)
+        pool_fail();
+    h->task.run = task_run;
+    h->done = 0;
+    return h + 1;
+}
+
+void cookie_task_spawn(void* frame, void (*thunk)(void* frame)) {
+    TaskHeader* h = task_header(frame);
+    h->thunk = thunk;
+    pthread_once(&pool_once, pool_start);
+    if (pool_size == 1) {
+        task_run(&h->task);
+        return;
+    }
+    // Earlier output has to come out before anything the task prints.
+    if (out_len)
+        cookie_flush();
+    pool_push(&h->task);
+}
+
+// A task whose function takes a channel may block until the code that
+// spawned it sends, receives or closes. Run by a thread that is helping in
+// await, it could wait on that thread's own suspended caller forever, so it
+// gets a thread of its own instead of a place in the pool's deques. Tasks it
+// spawns go on deque 0, shared with the main thread.
+static void* task_thread(void* arg) {
+    TaskHeader* h = (TaskHeader*)arg;
+    h->thunk(h + 1);
+    cookie_flush();
+    __atomic_store_n(&h->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+void cookie_task_spawn_thread(void* frame, void (*thunk)(void* frame)) {
+    TaskHeader* h = task_header(frame);
+    h->thunk = thunk;
+    pthread_once(&pool_once, pool_start);
+    if (out_len)
+        cookie_flush();
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, task_thread, h) != 0) {
+        fprintf(stderr, "Runtime Error: could not start a thread for a task.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(thread);
+}
+
+void cookie_task_await(void* frame) {
+    if (!frame) {
+        cookie_flush();
+        fprintf(stderr, "Runtime Error: await on a task handle that was already awaited.\n");
+        exit(EXIT_FAILURE);
+    }
+    TaskHeader* h = task_header(frame);
+    while (!__atomic_load_n(&h->done, __ATOMIC_ACQUIRE)) {
+        PoolTask* task = pool_find_task();
+        if (task)
+            task->run(task);
+        else
+            sched_yield();
+    }
+}
+
+void cookie_task_free(void* frame) {
+    free(task_header(frame));
+}
+
+// --- Channels ---
+// chan<T> is a bounded queue that any number of threads send to and receive
+// from. The compiler converts each value to an int64_t cell value and back.
+// While the ring is neither full nor empty, send and recv take no lock: every
+// cell carries a sequence number saying whether it is ready to be written or
+// read in the current lap around the ring, and a thread claims a position
+// with one compare-and-swap (D. Vyukov's bounded MPMC queue). A thread that
+// finds the ring full (send) or empty (recv) retries a few times, then sleeps
+// on the channel's condition variable; the other side only takes the lock to
+// wake it when some thread is asleep. close() sets CHAN_CLOSED in send_pos, so
+// a send either claims a position before the close or sees it, and the
+// positions below the one close() left are exactly the values still to be
+// received.
+#define CHAN_SPINS 64
+#define CHAN_CLOSED (1ULL << 63)
+
+typedef struct {
+    uint64_t seq;
+    int64_t value;
+} ChanCell;
+
+typedef struct CookieChan {
+    uint64_t send_pos;  // with CHAN_CLOSED once closed
+    char pad0[56];      // keep senders and receivers off each other's cache line
+    uint64_t recv_pos;
+    char pad1[56];
+    ChanCell* cells;
+    uint64_t mask;      // capacity - 1; the capacity is a power of two
+    int sleepers;       // threads waiting on changed
+    int refs;           // the declaring scope and each running task given the channel
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} CookieChan;
+
+static void chan_fail(const char* msg) {
+    cookie_flush();
+    fprintf(stderr, "Runtime Error: %s\n", msg);
+    exit(EXIT_FAILURE);
+}
+
+// A task spawned with the channel as an argument holds a reference until its
+// function returns, so a scope that ends (or declares the channel again)
+// before such a task has finished leaves the channel to the task to free.
+void cookie_chan_retain(CookieChan* c) {
+    __atomic_add_fetch(&c->refs, 1, __ATOMIC_RELAXED);
+}
+
+void cookie_chan_release(CookieChan* c) {
+    if (!c || __atomic_sub_fetch(&c->refs, 1, __ATOMIC_ACQ_REL) > 0)
+        return;
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->changed);
+    free(c->cells);
+    free(c);
+}
+
+// Runs for each declaration; a loop that declares a channel again replaces
+// the previous one.
+CookieChan* cookie_chan_init(CookieChan* old, int32_t capacity) {
+    cookie_chan_release(old);
+    if (capacity <= 0)
+        array_fail("channel capacity %d is not positive.", capacity);
+    uint64_t cap = 2;   // the sequence scheme needs at least two cells
+    while (cap < (uint64_t)capacity)
+        cap *= 2;
+    CookieChan* c = (CookieChan*)calloc(1, sizeof(CookieChan));
+    ChanCell* cells = (ChanCell*)malloc((size_t)cap * sizeof(ChanCell));
+    if (!c || !cells)
+        chan_fail("out of memory allocating a channel.");
+    for (uint64_t i = 0; i < cap; i++)
+        cells[i].seq = i;
+    c->cells = cells;
+    c->mask = cap - 1;
+    c->refs = 1;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->changed, NULL);
+    return c;
+}
+
+static inline int chan_closed(CookieChan* c) {
+    return (__atomic_load_n(&c->send_pos, __ATOMIC_SEQ_CST) & CHAN_CLOSED) != 0;
+}
+
+// Returns 1 when the value is queued, 0 when the ring is full and -1 when the
+// channel is closed.
+static int chan_try_send(CookieChan* c, int64_t value) {
+    uint64_t pos = __atomic_load_n(&c->send_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        if (pos & CHAN_CLOSED)
+            return -1;
+        ChanCell* cell = &c->cells[pos & c->mask];
+        uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&c->send_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell->value = value;
+                __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;   // full: the cell still holds last lap's value
+        } else {
+            pos = __atomic_load_n(&c->send_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int chan_try_recv(CookieChan* c, int64_t* value) {
+    uint64_t pos = __atomic_load_n(&c->recv_pos, __ATOMIC_RELAXED);
+    for (;;) {
+        ChanCell* cell = &c->cells[pos & c->mask];
+        uint64_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        int64_t diff = (int64_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&c->recv_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *value = cell->value;
+                __atomic_store_n(&cell->seq, pos + c->mask + 1, __ATOMIC_RELEASE);
+                return 1;
+            }
+        } else if (diff < 0) {
+            return 0;   // empty: nothing has been written at this position yet
+        } else {
+            pos = __atomic_load_n(&c->recv_pos, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static int chan_full(CookieChan* c) {
+    uint64_t pos = __atomic_load_n(&c->send_pos, __ATOMIC_SEQ_CST) & ~CHAN_CLOSED;
+    uint64_t seq = __atomic_load_n(&c->cells[pos & c->mask].seq, __ATOMIC_SEQ_CST);
+    return (int64_t)(seq - pos) < 0;
+}
+
+static int chan_empty(CookieChan* c) {
+    uint64_t pos = __atomic_load_n(&c->recv_pos, __ATOMIC_SEQ_CST);
+    uint64_t seq = __atomic_load_n(&c->cells[pos & c->mask].seq, __ATOMIC_SEQ_CST);
+    return (int64_t)(seq - (pos + 1)) < 0;
+}
+
+static void chan_wake(CookieChan* c) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&c->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&c->lock);
+        pthread_cond_broadcast(&c->changed);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
+
+// Sleeps until the channel may have room (sending) or a value (receiving),
+// or is closed. The condition is checked again after sleepers is raised, so
+// a chan_wake that misses the increment cannot leave this thread asleep.
+static void chan_sleep(CookieChan* c, int sending) {
+    pthread_mutex_lock(&c->lock);
+    __atomic_add_fetch(&c->sleepers, 1, __ATOMIC_SEQ_CST);
+    while (!chan_closed(c) &&
+           (sending ? chan_full(c) : chan_empty(c)))
+        pthread_cond_wait(&c->changed, &c->lock);
+    __atomic_sub_fetch(&c->sleepers, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&c->lock);
+}
+
+void cookie_chan_send(CookieChan* c, int64_t value) {
+    for (int spins = 0;; spins++) {
+        int sent = chan_try_send(c, value);
+        if (sent < 0)
+            chan_fail("send on a closed channel.");
+        if (sent) {
+            chan_wake(c);
+            return;
+        }
+        if (spins < CHAN_SPINS) {
+            sched_yield();
+        } else {
+            // What this thread printed should not wait for the other side.
+            if (out_len)
+                cookie_flush();
+            chan_sleep(c, 1);
+        }
+    }
+}
+
+// Returns 1 and stores the next value, or returns 0 with *value = 0 once the
+// channel is closed and drained.
+int32_t cookie_chan_recv(CookieChan* c, int64_t* value) {
+    for (int spins = 0;; spins++) {
+        if (chan_try_recv(c, value)) {
+            chan_wake(c);
+            return 1;
+        }
+        // Values sent before close are still delivered: a position below
+        // the closing one whose sender has not stored its value yet is
+        // waited for.
+        uint64_t end = __atomic_load_n(&c->send_pos, __ATOMIC_SEQ_CST);
+        if (end & CHAN_CLOSED) {
+            if (__atomic_load_n(&c->recv_pos, __ATOMIC_SEQ_CST) >= (end & ~CHAN_CLOSED)) {
+                *value = 0;
+                return 0;
+            }
+            sched_yield();
+            continue;
+        }
+        if (spins < CHAN_SPINS) {
+            sched_yield();
+        } else {
+            if (out_len)
+                cookie_flush();
+            chan_sleep(c, 0);
+        }
+    }
+}
+
+void cookie_chan_close(CookieChan* c) {
+    __atomic_fetch_or(&c->send_pos, CHAN_CLOSED, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&c->lock);
+    pthread_cond_broadcast(&c->changed);
+    pthread_mutex_unlock(&c->lock);
+}
+
+// --- Memoized functions ---
+// `memo fun f(...)` compiles to a wrapper that packs the arguments into
+// int64_t words and asks f's cache for them before running the body. The
+// cache keeps its entries in one array and finds them through a table of
+// entry numbers with linear probing, at most half full. `memo[n] fun` bounds
+// the cache to n entries: the entries also form a most-recently-used list,
+// and a new result replaces the least recently used one (removed from the
+// table by shifting later probes back, so no tombstones build up). One lock
+// per cache lets memo functions run from tasks and parallel loops. With
+// COOKIE_MEMO_STATS set, the hit and miss counts are printed at exit.
+typedef struct {
+    uint64_t hash;
+    int32_t value;
+    int32_t prev, next;   // recency list (bounded caches), -1 at the ends
+} MemoEntry;
+
+typedef struct CookieMemo {
+    const char* name;
+    int32_t arity;
+    int32_t limit;        // 0: unbounded
+    MemoEntry* entries;
+    int64_t* keys;        // arity words per entry
+    int32_t len, cap;     // entries in use, entries allocated
+    int32_t* table;       // entry number + 1, or 0 for an empty slot
+    uint32_t mask;        // table size - 1
+    int32_t head, tail;   // most and least recently used
+    uint64_t hits, misses, evictions;
+    pthread_mutex_t lock;
+    struct CookieMemo* nextMemo;
+} CookieMemo;
+
+static pthread_mutex_t memo_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static CookieMemo* memo_list = NULL;
+
+static void memo_fail(void) {
+    array_fail("out of memory growing a memo cache.");
+}
+
+static void memo_print_stats(void) {
+    cookie_flush();
+    for (CookieMemo* m = memo_list; m; m = m->nextMemo)
+        fprintf(stderr, "[cookie] memo %s: %llu hits, %llu misses, %llu evictions, %d entries\n", m->name,
+                (unsigned long long)m->hits, (unsigned long long)m->misses,
+                (unsigned long long)m->evictions, m->len);
+}
+
+static CookieMemo* memo_get(CookieMemo** slot, const char* name, int32_t arity, int32_t limit) {
+    CookieMemo* m = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+    if (m)
+        return m;
+    pthread_mutex_lock(&memo_registry_lock);
+    m = *slot;
+    if (!m) {
+        m = (CookieMemo*)calloc(1, sizeof(CookieMemo));
+        // The stats outlive the compiled code (and its string constants) under the JIT.
+        char* copy = strdup(name);
+        if (!m || !copy)
+            memo_fail();
+        m->name = copy;
+        m->arity = arity;
+        m->limit = limit;
+        m->head = m->tail = -1;
+        pthread_mutex_init(&m->lock, NULL);
+        if (!memo_list && getenv("COOKIE_MEMO_STATS"))
+            atexit(memo_print_stats);
+        m->nextMemo = memo_list;
+        memo_list = m;
+        __atomic_store_n(slot, m, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&memo_registry_lock);
+    return m;
+}
+
+static uint64_t memo_hash(const int64_t* key, int32_t arity) {
+    uint64_t h = (uint64_t)arity;
+    for (int32_t i = 0; i < arity; i++)
+        h = hash_mix(h ^ (uint64_t)key[i]) * 0x9e3779b97f4a7c15ull;
+    return hash_mix(h);
+}
+
+// The table slot holding an entry with this key, or the empty slot that
+// ends its probe.
+static uint32_t memo_probe(const CookieMemo* m, uint64_t hash, const int64_t* key) {
+    uint32_t i = (uint32_t)hash & m->mask;
+    for (;;) {
+        int32_t e = m->table[i] - 1;
+        if (e < 0)
+            return i;
+        if (m->entries[e].hash == hash &&
+            memcmp(m->keys + (size_t)e * m->arity, key, (size_t)m->arity * sizeof(int64_t)) == 0)
+            return i;
+        i = (i + 1) & m->mask;
+    }
+}
+
+static void memo_unlink(CookieMemo* m, int32_t e) {
+    MemoEntry* en = &m->entries[e];
+    if (en->prev >= 0) m->entries[en->prev].next = en->next; else m->head = en->next;
+    if (en->next >= 0) m->entries[en->next].prev = en->prev; else m->tail = en->prev;
+}
+
+static void memo_push_front(CookieMemo* m, int32_t e) {
+    m->entries[e].prev = -1;
+    m->entries[e].next = m->head;
+    if (m->head >= 0)
+        m->entries[m->head].prev = e;
+    m->head = e;
+    if (m->tail < 0)
+        m->tail = e;
+}
+
+// Empties slot i and moves later entries of the probe run back into the gap.
+static void memo_table_remove(CookieMemo* m, uint32_t i) {
+    uint32_t j = i;
+    for (;;) {
+        j = (j + 1) & m->mask;
+        int32_t e = m->table[j] - 1;
+        if (e < 0)
+            break;
+        uint32_t home = (uint32_t)m->entries[e].hash & m->mask;
+        // Move e into the gap unless its home lies cyclically in (i, j].
+        if (((j - home) & m->mask) >= ((j - i) & m->mask)) {
+            m->table[i] = m->table[j];
+            i = j;
+        }
+    }
+    m->table[i] = 0;
+}
+
+static void memo_grow_table(CookieMemo* m) {
+    uint32_t size = m->table ? (m->mask + 1) * 2 : 64;
+    int32_t* table = (int32_t*)calloc(size, sizeof(int32_t));
+    if (!table)
+        memo_fail();
+    free(m->table);
+    m->table = table;
+    m->mask = size - 1;
+    for (int32_t e = 0; e < m->len; e++) {
+        uint32_t i = (uint32_t)m->entries[e].hash & m->mask;
+        while (m->table[i])
+            i = (i + 1) & m->mask;
+        m->table[i] = e + 1;
+    }
+}
+
+// Looks the key up; on a hit stores the cached result and returns 1.
+int32_t cookie_memo_find(CookieMemo** slot, const char* name, int32_t arity, int32_t limit,
+                         const int64_t* key, int32_t* result) {
+    CookieMemo* m = memo_get(slot, name, arity, limit);
+    pthread_mutex_lock(&m->lock);
+    int32_t e = -1;
+    if (m->table)
+        e = m->table[memo_probe(m, memo_hash(key, arity), key)] - 1;
+    if (e >= 0) {
+        *result = m->entries[e].value;
+        m->hits++;
+        if (m->limit && m->head != e) {
+            memo_unlink(m, e);
+            memo_push_front(m, e);
+        }
+    } else {
+        m->misses++;
+    }
+    pthread_mutex_unlock(&m->lock);
+    return e >= 0;
+}
+
+// Records f's result for the key, evicting the least recently used entry of
+// a full bounded cache.
+void cookie_memo_store(CookieMemo** slot, const int64_t* key, int32_t value) {
+    CookieMemo* m = *slot;
+    pthread_mutex_lock(&m->lock);
+    uint64_t hash = memo_hash(key, m->arity);
+    if (!m->table || (uint32_t)m->len + 1 > (m->mask + 1) / 2)
+        memo_grow_table(m);
+    uint32_t i = memo_probe(m, hash, key);
+    int32_t e = m->table[i] - 1;
+    if (e < 0) {
+        // Another thread may have stored the same key first; otherwise add it.
+        if (m->limit && m->len == m->limit) {
+            e = m->tail;
+            memo_unlink(m, e);
+            MemoEntry* old = &m->entries[e];
+            memo_table_remove(m, memo_probe(m, old->hash, m->keys + (size_t)e * m->arity));
+            m->evictions++;
+            i = memo_probe(m, hash, key);
+        } else {
+            if (m->len == m->cap) {
+                int32_t cap = m->cap ? m->cap * 2 : 64;
+                if (m->limit && cap > m->limit)
+                    cap = m->limit;
+                MemoEntry* entries = (MemoEntry*)realloc(m->entries, (size_t)cap * sizeof(MemoEntry));
+                if (!entries)
+                    memo_fail();
+                m->entries = entries;
+                int64_t* keys = (int64_t*)realloc(m->keys, (size_t)cap * m->arity * sizeof(int64_t) + 1);
+                if (!keys)
+                    memo_fail();
+                m->keys = keys;
+                m->cap = cap;
+            }
+            e = m->len++;
+        }
+        m->entries[e].hash = hash;
+        memcpy(m->keys + (size_t)e * m->arity, key, (size_t)m->arity * sizeof(int64_t));
+        m->table[i] = e + 1;
+        if (m->limit)
+            memo_push_front(m, e);
+    }
+    m->entries[e].value = value;
+    pthread_mutex_unlock(&m->lock);
+}